@@ -0,0 +1,52 @@
+#ifndef CAKE_ALLOCATOR_H_
+#define CAKE_ALLOCATOR_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bench/benchmark.h"
+
+/// Where cake installs the allocators it finds nowhere else, with vcpkg.
+#define ALLOCATOR_DIRECTORY "./packages/cake-allocators"
+
+/// A malloc `--allocator` preloads into the binaries run.
+struct Allocator {
+	std::string name; ///< like `jemalloc`
+	std::string port; ///< of vcpkg, empty for `system`
+	std::vector<std::string> libraries; ///< shared libraries providing it, preferred first
+	std::string package; ///< of the distributions, like `libjemalloc2`
+};
+
+/// `system`, the allocator of glibc, `jemalloc`, `tcmalloc` and `mimalloc`.
+const std::vector<Allocator> &KnownAllocators();
+
+/// The allocator named `name`, nullptr if cake doesn't know it.
+const Allocator *FindAllocator(const std::string &name);
+
+/// Shared library of `allocator`, in the library paths of the system or
+/// installed by cake. Empty for `system`, or if it's not found.
+std::string AllocatorLibrary(const Allocator &allocator);
+
+/// Build `allocator` with the vcpkg of the project, as a shared library with
+/// the dynamic triplet of the host, into `ALLOCATOR_DIRECTORY`.
+bool InstallAllocator(const Allocator &allocator, const std::string &vcpkg);
+
+/// The benchmarks of a target run with one allocator of `cake bench --allocators`.
+struct AllocatorRun {
+	std::string allocator;
+	BenchmarkRun run; ///< times and peak RSS, without the heap profiler
+	uint64_t heap_peak = 0; ///< most bytes the program had allocated at once, 0 if unknown
+	int64_t heap_rss = 0; ///< KiB, peak RSS of the run measuring `heap_peak`
+};
+
+/// Peak RSS over the most bytes allocated at once, the memory the allocator
+/// holds for each byte in use. 0 if unknown.
+double Fragmentation(const AllocatorRun &run);
+
+/// The median time per iteration of each benchmark with each allocator and
+/// its change against the first allocator, then the peak RSS, heap peak and
+/// fragmentation of each target with each allocator.
+void PrintAllocatorComparison(const std::vector<std::string> &allocators, const std::vector<AllocatorRun> &runs);
+
+#endif // CAKE_ALLOCATOR_H_
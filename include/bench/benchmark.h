@@ -0,0 +1,150 @@
+#ifndef CAKE_BENCHMARK_H_
+#define CAKE_BENCHMARK_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bench/statistics.h"
+#include "cmake/file_api.h"
+#include "utility/common.h"
+#include "utility/json.h"
+
+/// Results of `cake bench`, one JSON line per benchmark executable run,
+/// only ever appended to.
+#define BENCH_STORE_FILE ".cake/bench/results.jsonl"
+
+/// Named baselines, `<name>.json` each.
+#define BENCH_BASELINE_DIRECTORY ".cake/bench/baselines"
+
+/// Worktrees and build directories of `cake bench --compare`, one per commit.
+#define BENCH_COMPARE_DIRECTORY ".cake/bench/compare"
+
+/// One measurement of a benchmark, times per iteration in nanoseconds.
+struct BenchmarkResult {
+	std::string name; ///< like `BM_Sort/1024`
+	double real_time = 0;
+	double cpu_time = 0;
+	int64_t iterations = 0;
+	double instructions = 0; ///< per iteration with `--instructions`, 0 if not counted
+	double l1_misses = 0; ///< simulated by cachegrind, per iteration
+	double ll_misses = 0; ///< simulated by cachegrind, per iteration
+};
+
+/// A run of one benchmark executable, and what it ran on.
+struct BenchmarkRun {
+	std::string target;
+	int64_t timestamp = 0; ///< unix seconds
+	std::string commit; ///< HEAD, empty outside of git
+	bool dirty = false; ///< with uncommitted changes
+	std::string build_type;
+	std::string compiler; ///< first line of its `--version`
+	std::string flags; ///< compile flags of the target
+	nlohmann::json machine; ///< cpu, cores, memory, kernel and host
+	nlohmann::json context; ///< the context Google Benchmark reports
+	nlohmann::json conditions; ///< cpus, ASLR, governor and turbo of `PrepareBenchEnvironment`
+	std::string counter; ///< what counted the instructions, `cachegrind` or `perf`, empty if nothing
+	int64_t peak_rss = 0; ///< KiB, most memory the benchmark process held
+	std::vector<BenchmarkResult> benchmarks;
+};
+
+/// Whether an executable target links Google Benchmark, from its link
+/// command fragments and its dependencies.
+bool IsBenchmarkTarget(const Target &target);
+
+/// Compile flags of a target, from its first compile group.
+std::string CompileFlagsOf(const Target &target);
+
+/// Fill in the commit, build type, compiler and machine of `run`.
+void DescribeBenchmarkEnvironment(const std::string &build_directory, BenchmarkRun &run);
+
+/// Run a Google Benchmark executable set up by `options` and read the
+/// results it writes to `json_file`.
+bool RunBenchmark(const std::string &executable, const std::vector<std::string> &args, const std::string &json_file, const ProcessOptions &options, BenchmarkRun &run);
+
+/// Tools counting instructions.
+#define CACHEGRIND_COMMAND "valgrind"
+
+/// The instruction counter to use for `requested`, `auto`, `cachegrind` or
+/// `perf`: cachegrind if valgrind is installed, else `perf_event_open` if
+/// this machine counts instructions. Empty if none is available.
+std::string InstructionCounter(const std::string &requested);
+
+/// Count the instructions per iteration of the benchmarks of `run` with
+/// `counter`, each alone in a process running a single iteration, minus a
+/// process running none. Cachegrind also simulates the cache misses.
+/// Deterministic, unlike times, for the same binary and inputs.
+bool CountInstructions(const std::string &counter, const std::string &executable, const std::vector<std::string> &args, const std::string &json_file, const ProcessOptions &options, BenchmarkRun &run);
+
+void AppendBenchmarkRun(const std::string &store, const BenchmarkRun &run);
+
+/// All runs of the store, oldest first.
+std::vector<BenchmarkRun> ReadBenchmarkRuns(const std::string &store);
+
+/// One line per benchmark: how many runs, the first, best and latest time,
+/// and the change of the latest run against the one before.
+void PrintBenchmarkReport(const std::vector<BenchmarkRun> &runs);
+
+/// Measurements of each benchmark, `<target>/<benchmark>` -> times per
+/// iteration in nanoseconds, one per repetition.
+using BenchmarkSamples = std::map<std::string, std::vector<double>>;
+
+BenchmarkSamples SamplesOf(const std::vector<BenchmarkRun> &runs);
+
+/// Instructions per iteration of each counted benchmark, `<target>/<benchmark>` -> count.
+using BenchmarkInstructions = std::map<std::string, double>;
+
+BenchmarkInstructions InstructionsOf(const std::vector<BenchmarkRun> &runs);
+
+/// Measurements of the benchmarks at some commit, to compare with later.
+struct BenchmarkBaseline {
+	std::string commit;
+	BenchmarkSamples samples;
+	BenchmarkInstructions instructions; ///< empty if not counted
+};
+
+void WriteBaseline(const std::string &file, const std::vector<BenchmarkRun> &runs);
+
+bool ReadBaseline(const std::string &file, BenchmarkBaseline &baseline);
+
+/// A benchmark of the current run against its baseline.
+struct BenchmarkComparison {
+	std::string name;
+	double baseline = 0; ///< median, in nanoseconds
+	double current = 0; ///< median, in nanoseconds
+	double change = 0; ///< `current / baseline - 1`
+	ConfidenceInterval interval; ///< of the change
+	double p_value = 1; ///< Mann-Whitney U
+	double threshold = 0; ///< relative change that matters
+	bool regression = false; ///< significantly slower, beyond the threshold
+	bool improvement = false; ///< significantly faster, beyond the threshold
+};
+
+/// Threshold of a benchmark: the one of the longest pattern (`fnmatch`)
+/// matching its name, or `threshold`.
+double ThresholdOf(const std::string &name, const std::vector<std::pair<std::string, double>> &patterns, double threshold);
+
+/// Compare the benchmarks in both sets of samples. A change is significant
+/// when the p-value is below `alpha` and the confidence interval excludes 0.
+std::vector<BenchmarkComparison> CompareBenchmarks(
+	const BenchmarkSamples &baseline,
+	const BenchmarkSamples &current,
+	const std::vector<std::pair<std::string, double>> &thresholds,
+	double threshold,
+	double alpha
+);
+
+void PrintBenchmarkComparison(const std::vector<BenchmarkComparison> &comparisons);
+
+/// Compare the instruction counts, without noise any change beyond the
+/// threshold is a regression or an improvement.
+std::vector<BenchmarkComparison> CompareInstructions(const BenchmarkInstructions &baseline, const BenchmarkInstructions &current, double threshold);
+
+void PrintInstructionComparison(const std::vector<BenchmarkComparison> &comparisons);
+
+/// `12.3 ns`, `4.56 ms`.
+std::string FormatNanoseconds(double nanoseconds);
+
+#endif // CAKE_BENCHMARK_H_
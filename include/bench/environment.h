@@ -0,0 +1,33 @@
+#ifndef CAKE_BENCH_ENVIRONMENT_H_
+#define CAKE_BENCH_ENVIRONMENT_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "utility/json.h"
+
+/// How a benchmark process is set up to measure with less noise, by
+/// `cake bench` and `cake run --bench-env`.
+struct BenchEnvironmentConfig {
+	std::string cpus; ///< cpu list the process is pinned to, like `2-3,6`, the last cpu cake may use if empty.
+	bool disable_aslr = true; ///< load everything at the same addresses every run.
+	int warmup = 200; ///< milliseconds the process spins before exec, so the clock of its cpu ramps up.
+};
+
+/// A cpu list like `0-3,6` -> {0, 1, 2, 3, 6}.
+bool ParseCpuList(const std::string &list, std::vector<int> &cpus);
+
+/// Resolve the cpus of `config`, warn about the frequency governor, turbo
+/// and SMT siblings that add noise, and return the conditions to record next
+/// to the results.
+nlohmann::json PrepareBenchEnvironment(const BenchEnvironmentConfig &config, std::vector<int> &cpus);
+
+/// Set up the environment in the child process, for
+/// `ProcessOptions::before_exec`: pin to `cpus`, disable ASLR and warm up.
+std::function<void()> BenchEnvironmentSetup(const BenchEnvironmentConfig &config, const std::vector<int> &cpus);
+
+/// `cpus 3, ASLR off, governor powersave, turbo on`.
+std::string DescribeBenchEnvironment(const nlohmann::json &conditions);
+
+#endif // CAKE_BENCH_ENVIRONMENT_H_
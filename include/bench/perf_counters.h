@@ -0,0 +1,62 @@
+#ifndef CAKE_PERF_COUNTERS_H_
+#define CAKE_PERF_COUNTERS_H_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+/// A counter of `perf_event_open`.
+struct PerfEvent {
+	std::string name; ///< like `instructions`
+	uint32_t type = 0; ///< `PERF_TYPE_*`
+	uint64_t config = 0; ///< `PERF_COUNT_*`
+	bool kernel = false; ///< count in the kernel too, needs a perf_event_paranoid below 2
+};
+
+/// `instructions` retired in user space.
+PerfEvent PerfInstructions();
+
+/// What `cake run --counters` counts: `cycles`, `instructions`,
+/// `L1-dcache-load-misses`, `LLC-misses`, `branch-misses`,
+/// `context-switches` and `page-faults`.
+std::vector<PerfEvent> PerfRunEvents();
+
+/// A pipe a child process waits on right before exec, so the parent can
+/// attach to it first. Returns what the child runs, for
+/// `ProcessOptions::before_exec`.
+std::function<void()> MakeExecGate(int gate[2]);
+
+/// Let the child waiting on `gate` exec.
+void ReleaseExecGate(int gate[2]);
+
+/// Counters of a child process. The child waits on the gate right before
+/// exec while the parent opens them, and the exec enables them, so they
+/// count the program and nothing of cake. They are inherited by the threads
+/// and processes it starts.
+struct PerfCounters {
+	std::vector<PerfEvent> events;
+	std::vector<int> fds; ///< per event, -1 if this machine can't count it
+	int gate[2] = { -1, -1 };
+	double enabled = 0; ///< seconds the counters counted, from exec to exit, once read
+};
+
+/// Create the gate of `counters`, and return what the child runs before
+/// exec to wait on it, for `ProcessOptions::before_exec`.
+std::function<void()> PerfCountersGate(PerfCounters &counters);
+
+/// Open the counters of the child `pid` waiting on the gate, then let it
+/// exec. Returns how many of them could be opened.
+size_t OpenPerfCounters(PerfCounters &counters, pid_t pid);
+
+/// Values of the counters once the child exited, by event name, scaled if
+/// the kernel multiplexed them. Events that could not be counted are left
+/// out. Closes the counters.
+std::map<std::string, double> ReadPerfCounters(PerfCounters &counters);
+
+/// Whether this machine counts `event` for the processes of this user.
+bool PerfEventSupported(const PerfEvent &event);
+
+#endif // CAKE_PERF_COUNTERS_H_
@@ -0,0 +1,22 @@
+#ifndef CAKE_STATISTICS_H_
+#define CAKE_STATISTICS_H_
+
+#include <vector>
+
+double Median(std::vector<double> values);
+
+/// Two-sided p-value of the Mann-Whitney U test, whether `a` and `b` come from
+/// the same distribution. Normal approximation with tie and continuity
+/// corrections, 1 when there is nothing to tell them apart.
+double MannWhitneyPValue(const std::vector<double> &a, const std::vector<double> &b);
+
+struct ConfidenceInterval {
+	double low = 0;
+	double high = 0;
+};
+
+/// Percentile bootstrap interval of `median(b) / median(a) - 1`, resampled
+/// with a fixed seed so the same samples give the same interval.
+ConfidenceInterval BootstrapMedianChange(const std::vector<double> &a, const std::vector<double> &b, double confidence = 0.95, int resamples = 2000);
+
+#endif // CAKE_STATISTICS_H_
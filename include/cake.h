@@ -1,15 +1,20 @@
 #ifndef CAKE_H_
 #define CAKE_H_
 
+#include <cstdint>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "bench/environment.h"
 #include "cmake/file_api.h"
+#include "vcpkg/triplet.h"
 
 /// ====================== APIs ==========================
 
 struct BuildConfig {
+	std::string profile; ///< which `[profile.<name>]` of the manifest, empty for `[profile]`.
 	std::string source_directory = "."; ///< current working directory
 	std::string build_directory = "out"; ///< where do you want to store the build files
 	bool vcpkg_support = false; ///< if support vcpkg
@@ -19,13 +24,22 @@ struct BuildConfig {
 	std::string vcpkg_packages_directory = "./packages/vcpkg_packages"; ///< vcpkg manifest file
 	std::string lib; ///< which library to build.
 	std::string bin; ///< which binary to build.
+	std::string affected_since; ///< only build targets affected by changes since this git revision.
 	std::vector<std::string> options; ///< build options passed to cake(actually cmake).
 	std::string generator; ///< which generator to use.
+	TripletConfig triplet; ///< how the vcpkg dependencies are built.
+	bool module_cache = false; ///< cache module scans and BMIs across build directories.
 };
 
 struct RunConfig {
 	std::string bin; ///< which binary to run.
 	std::vector<std::string> args; ///< run options passed to the binary.
+	bool bench_env = false; ///< run in the benchmark environment of `[bench]`.
+	BenchEnvironmentConfig environment; ///< cpus, ASLR and warm-up of `bench_env`.
+	bool counters = false; ///< summarize the hardware counters, wall time and peak RSS of the run.
+	size_t heap_profile = 0; ///< profile the heap, sampling a stack every this many bytes allocated, 0 if not.
+	size_t sample_resources = 0; ///< sample RSS, cpu, threads, io and context switches every this many milliseconds, 0 if not.
+	std::string allocator; ///< preload this malloc, `jemalloc`, `tcmalloc` or `mimalloc`, empty or `system` for the one of glibc.
 };
 
 struct DebugConfig {
@@ -41,17 +55,83 @@ struct InstallConfig {
 	std::vector<std::string> options; /// install options passed to the vcpkg.
 	std::string vcpkg_manifest_directory = "./packages/"; ///< vcpkg manifest file
 	std::string vcpkg_packages_directory = "./packages/vcpkg_packages"; ///< vcpkg manifest file
+	bool binary_cache = true; ///< whether let vcpkg restore and store built ports in a local cache.
+	std::string binary_cache_directory; ///< the binary cache, `<user cache>/vcpkg-archives` by default.
+	uintmax_t binary_cache_max_size = 10240; ///< size cap of the binary cache in MiB, 0 means no limit.
+	bool cache_stats = false; ///< report restored and built ports.
+	bool shared_store = false; ///< whether link installed packages from a store shared by all projects.
+	std::string store_directory; ///< the shared package store, `<user cache>/vcpkg-store` by default.
+	bool force = false; ///< run vcpkg install even if the manifest is unchanged since the last install.
+	TripletConfig triplet; ///< how the vcpkg dependencies are built.
 };
 
 struct CreateConfig {
 	std::string name; ///< which name to create.
 	std::string type; ///< which template to create.
 	std::vector<std::string> options; /// create options passed to the cake.
+	bool from_remote = false; ///< fetch the template from the cake repository instead of the embedded one.
 	
 	std::string template_basic_directory = "./template/basic";
 	std::string template_vcpkg_directory = "./template/vcpkg";
 };
 
+struct PackageConfig {
+	std::vector<std::string> libs; ///< which libraries to package.
+	std::vector<std::string> bins; ///< which binaries to package.
+	std::string output_directory; ///< the staging tree, `<build-directory>/package` by default.
+	std::string archive; ///< stream the artifacts into this tarball.
+	bool strip = false; ///< split debug info into `.debug/` and strip the artifacts.
+	size_t jobs = 0; ///< how many artifacts to strip in parallel, the number of cpus by default.
+};
+
+struct TestConfig {
+	std::string regex; ///< only run the tests whose name matches.
+	size_t jobs = 0; ///< how many tests run at the same time, the number of cpus by default.
+	double timeout = 0; ///< timeout of the tests without a `TIMEOUT` property in seconds, 0 means none.
+	bool shard_within = false; ///< split GoogleTest and Catch2 executables into processes running part of their cases.
+	size_t shards = 0; ///< how many processes per executable, `jobs` by default.
+	bool no_cache = false; ///< run tests whose inputs are unchanged since they passed.
+	std::vector<std::string> cache_environment; ///< inherited variables the cached results depend on, besides the default ones.
+	std::string affected_since; ///< only run the tests affected by the changes since this revision.
+	bool fork_server = false; ///< fork the tests from one initialized process per executable, see `runtime/fork_server.h`.
+};
+
+struct BenchConfig {
+	std::vector<std::string> targets; ///< benchmark targets tagged in the manifest, besides the ones linking Google Benchmark.
+	std::vector<std::string> bins; ///< only run these benchmark targets.
+	std::string filter; ///< only run the benchmarks matching, `--benchmark_filter`.
+	std::vector<std::string> args; ///< passed to the benchmark executables.
+	bool report = false; ///< summarize the stored results instead of running.
+	size_t repetitions = 0; ///< runs of each benchmark, 10 with a baseline, `--benchmark_repetitions`.
+	std::string baseline; ///< compare the results with this baseline, `[bench] baseline` with `--check`.
+	std::string save_baseline; ///< record the results as this baseline.
+	bool check = false; ///< fail on significant slowdowns against the baseline, or the first revision compared.
+	double threshold = 0.05; ///< relative slowdown failing the check.
+	std::vector<std::pair<std::string, double>> thresholds; ///< per benchmark pattern, overriding `threshold`.
+	double alpha = 0.05; ///< significance level of the comparison.
+	std::vector<std::string> compare; ///< two git revisions to build and compare, empty otherwise.
+	size_t jobs = 0; ///< build jobs shared by the revisions compared, the number of cpus by default.
+	BenchEnvironmentConfig environment; ///< cpus, ASLR and warm-up of the benchmark processes.
+	std::string instructions; ///< count instructions with `auto`, `cachegrind` or `perf`, empty if not.
+	double instruction_threshold = 0.01; ///< relative increase of the instructions failing the check.
+	std::vector<std::string> allocators; ///< run the benchmarks with each of these allocators and compare them, empty if not.
+};
+
+struct ProfileConfig {
+	std::string bin; ///< which binary to profile.
+	std::vector<std::string> args; ///< run options passed to the binary.
+	int frequency = 999; ///< samples per second of cpu time.
+	size_t top = 20; ///< hotspots to print.
+	std::string engine = "auto"; ///< `perf`, `perf_event_open`, or `auto` for perf when installed.
+};
+
+struct PgoConfig {
+	std::string bin; ///< which binary to train.
+	std::string train; ///< args of the training runs, split like a shell.
+	size_t runs = 1; ///< training runs, their profiles add up.
+	double drift_threshold = 0.1; ///< share of the sources profiled that may change before the profile is dropped.
+};
+
 struct MetaData {
 	std::vector<std::string> Libs()
 	{
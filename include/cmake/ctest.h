@@ -5,6 +5,26 @@
 #include <vector>
 #include "utility/json.h"
 
+#define CTEST_COMMAND "ctest"
+
+/// A test registered with `add_test`, as `ctest --show-only=json-v1` describes it.
+struct TestCase {
+	std::string name;
+	std::vector<std::string> command; ///< the executable and its arguments
+	std::string working_directory;
+	std::vector<std::string> environment; ///< `ENVIRONMENT`, `KEY=VALUE`
+	std::vector<std::string> required_files; ///< `REQUIRED_FILES`
+	double timeout = 0; ///< `TIMEOUT` in seconds, 0 means none
+	size_t processors = 1; ///< `PROCESSORS`
+	bool will_fail = false; ///< `WILL_FAIL`
+	bool disabled = false; ///< `DISABLED`
+	bool run_serial = false; ///< `RUN_SERIAL`
+};
+
+/// Names of all tests of the build directory.
 std::vector<std::string> ListAllTests(const std::string &build_directory);
 
+/// All tests of the build directory, with the properties cake understands.
+std::vector<TestCase> ResolveTests(const std::string &build_directory);
+
 #endif  // CAKE_CTEST_H_
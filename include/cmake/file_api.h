@@ -25,4 +25,7 @@ CodemodelV2 ResolveCodemodelFile(const std::string &build_directory, const Reply
 /// Read the `target-*.json`
 Target ResolveTargetFile(const std::string &build_directory, const std::string &target_json_file);
 
+/// The value of `KEY:TYPE=VALUE` in `CMakeCache.txt`, empty if not set.
+std::string CMakeCacheValue(const std::string &build_directory, const std::string &key);
+
 #endif // CAKE_FILE_API_H_
@@ -0,0 +1,40 @@
+#ifndef CAKE_TARGET_GRAPH_H_
+#define CAKE_TARGET_GRAPH_H_
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cmake/file_api.h"
+
+/// Which targets own a file, and which targets depend on a target.
+/// All file paths are relative to the source directory.
+struct TargetGraph {
+	std::unordered_map<std::string, std::set<std::string>> owners; ///< source file -> targets listing it
+	std::unordered_map<std::string, std::set<std::string>> includers; ///< header -> targets including it, from dependency files
+	std::unordered_map<std::string, std::set<std::string>> dependents; ///< target -> targets linking or depending on it
+};
+
+/// Targets affected by a set of changed files.
+struct AffectedTargets {
+	bool all = false; ///< a change can't be attributed, everything is affected
+	std::set<std::string> targets; ///< affected targets, including reverse dependencies
+	std::vector<std::string> unattributed; ///< changed files owned by no target
+};
+
+/// Split a make-style dependency file into its prerequisites.
+std::vector<std::string> ParseDependencyFile(const std::string &content);
+
+/// Build the graph from the file-api target replies and the dependency files
+/// the compiler left in the build directory.
+TargetGraph ResolveTargetGraph(const std::string &source_directory, const std::string &build_directory, const std::unordered_map<std::string, Target> &targets);
+
+/// Documentation, licenses and editor settings, no build or test reads them.
+bool IsDocumentationFile(const std::string &file);
+
+/// Map changed files to owning targets and expand to reverse dependencies.
+/// Changes to CMake or manifest files affect all targets.
+AffectedTargets ResolveAffectedTargets(const TargetGraph &graph, const std::vector<std::string> &changed_files);
+
+#endif // CAKE_TARGET_GRAPH_H_
@@ -0,0 +1,37 @@
+#ifndef CAKE_TEMPLATE_H_
+#define CAKE_TEMPLATE_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/// A file of `template/`, embedded into cake at compile time.
+struct EmbeddedFile {
+	const char *path; ///< relative to `template/`, like `basic/CMakeLists.txt`
+	const unsigned char *data;
+	size_t size;
+};
+
+/// All embedded template files, generated by `embed_templates.cmake`.
+const std::vector<EmbeddedFile> &EmbeddedTemplateFiles();
+
+/// Headers of `include/runtime/`, like `fork_server.h`, embedded the same way.
+const std::vector<EmbeddedFile> &EmbeddedRuntimeFiles();
+
+/// Files of `src/profile/resources/`, like `flamegraph.html`, for `cake profile`.
+const std::vector<EmbeddedFile> &EmbeddedProfileResources();
+
+/// Template types embedded into cake, like `basic`.
+std::vector<std::string> EmbeddedTemplateTypes();
+
+/// Substitute the project name into a template file, `path` is relative to
+/// the template root.
+void SubstituteTemplateVariables(const std::string &path, const std::string &project_name, std::string &content);
+
+/// Write the embedded template `type` into `directory`.
+bool WriteEmbeddedTemplate(const std::string &type, const std::string &directory, const std::string &project_name);
+
+/// Substitute the project name into a template already on disk.
+bool SubstituteTemplateDirectory(const std::string &directory, const std::string &project_name);
+
+#endif // CAKE_TEMPLATE_H_
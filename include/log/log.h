@@ -1,6 +1,8 @@
 #ifndef CAKE_LOG_H_
 #define CAKE_LOG_H_
 
+#include <cerrno>
+#include <cstdlib>
 #include <memory>
 #include <mutex>
 #include <ostream>
@@ -86,13 +88,13 @@ public:
 	template <typename... T> inline void Error(const T &...msg)
 	{
 		Log(ERROR, msg...);
-		exit(errno);
+		exit(errno != 0 ? errno : EXIT_FAILURE);
 	}
 
 	template <typename... T> inline void Fatal(const T &...msg)
 	{
 		Log(FATAL, msg...);
-		exit(errno);
+		exit(errno != 0 ? errno : EXIT_FAILURE);
 	}
 
 public:
@@ -10,12 +10,29 @@ using Manifest = toml::table;
 
 Manifest ParseManifest();
 
-BuildConfig ParseBuildConfigFromManifest();
+/// `profile` selects `[profile.<profile>]`, which overrides `[profile]`.
+BuildConfig ParseBuildConfigFromManifest(const std::string &profile = "");
 
 RunConfig ParseRunConfigFromManifest();
 
-InstallConfig ParseInstallConfigFromManifest();
+InstallConfig ParseInstallConfigFromManifest(const std::string &profile = "");
 
 DebugConfig ParseDebugConfigFromManifest();
 
+TestConfig ParseTestConfigFromManifest();
+
+/// The build of `cake bench`, `[profile.bench]` by default, built in Release
+/// unless the profile sets its own `build-type`.
+BuildConfig ParseBenchBuildConfigFromManifest(const std::string &profile = "");
+
+BenchConfig ParseBenchConfigFromManifest();
+
+ProfileConfig ParseProfileConfigFromManifest();
+
+/// The build optimized with the profiles of `cake pgo`, `[profile.release]`
+/// by default, built in Release unless the profile sets its own `build-type`.
+BuildConfig ParsePgoBuildConfigFromManifest(const std::string &profile = "");
+
+PgoConfig ParsePgoConfigFromManifest();
+
 #endif // CAKE_MANIFEST_H_
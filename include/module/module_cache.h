@@ -0,0 +1,53 @@
+#ifndef CAKE_MODULE_CACHE_H_
+#define CAKE_MODULE_CACHE_H_
+
+#include <string>
+#include <vector>
+
+/// A persistent cache of C++20 module work, shared by all build directories.
+///
+/// cake installs itself as `CMAKE_CXX_COMPILER_LAUNCHER` (`cake launch`).
+/// Module dependency scans, compiles producing a BMI and compiles importing
+/// BMIs are looked up in `<user cache>/modules/<key>/`, where the key hashes
+/// the compiler, its arguments and the BMIs read, and each entry records the
+/// content hash of every file the compiler depended on.
+/// Other compiles run untouched.
+///
+/// The standard library module (`import std`) is cached in
+/// `<user cache>/std-modules/<key>/` instead, keyed by the compiler version
+/// and the flags only, so it is shared by all projects.
+
+/// The launcher appends its hits and misses to the file named by this variable.
+#define MODULE_CACHE_LOG_ENV "CAKE_MODULE_CACHE_LOG"
+
+/// Hits and misses of one build.
+struct ModuleCacheStats {
+	size_t interfaces = 0; ///< compiles producing a BMI
+	size_t interfaces_reused = 0;
+	size_t importers = 0; ///< compiles only importing BMIs
+	size_t importers_reused = 0;
+	size_t scans = 0; ///< module dependency scans
+	size_t scans_reused = 0;
+	size_t std_modules = 0; ///< compiles of the standard library module
+	size_t std_modules_reused = 0;
+};
+
+/// `<user cache>/modules`.
+std::string ModuleCacheDirectory();
+
+/// `<user cache>/std-modules`.
+std::string StdModuleCacheDirectory();
+
+/// Whether a source under `source_directory` has `import std;` or
+/// `import std.compat;`. Build trees and dependencies are skipped.
+bool ImportsStdModule(const std::string &source_directory, const std::string &build_directory);
+
+/// Run `command` (a compiler command line) as a compiler launcher, restoring
+/// its outputs from the module cache when possible. Returns the exit code.
+/// With `std_only`, only the standard library module is cached.
+int LaunchCompiler(const std::vector<std::string> &command, bool std_only = false);
+
+/// Sum up the log the launcher wrote during a build.
+ModuleCacheStats ReadModuleCacheLog(const std::string &file);
+
+#endif // CAKE_MODULE_CACHE_H_
@@ -0,0 +1,32 @@
+#ifndef CAKE_PACKAGE_H_
+#define CAKE_PACKAGE_H_
+
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+enum class StageMethod { kReflink = 0, kHardlink, kCopyFileRange };
+
+/// Place `from` at `to` without copying its bytes through user space.
+/// Tries a reflink (FICLONE), then a hardlink unless `hardlink` is false,
+/// then an in-kernel copy (copy_file_range). Permissions are preserved.
+bool StageFile(const std::string &from, const std::string &to, StageMethod &method, bool hardlink = true);
+
+/// A file stored in an archive.
+struct ArchiveEntry {
+	std::string path; ///< file on disk
+	std::string name; ///< name in the archive
+};
+
+/// Stream files into a ustar archive, without temporary files.
+/// `archive` ending with `.gz`, `.xz` or `.zst` is piped through the
+/// compressor, "-" writes to `standard_output`.
+bool WriteTarArchive(const std::string &archive, const std::vector<ArchiveEntry> &entries, int standard_output = STDOUT_FILENO);
+
+/// Keep the standard output for an archive: point it at the standard error,
+/// so the logs and child processes write there from now on, and return a
+/// descriptor of the original. The standard output itself if it can't.
+int DivertStandardOutput();
+
+#endif // CAKE_PACKAGE_H_
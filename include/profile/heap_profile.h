@@ -0,0 +1,45 @@
+#ifndef CAKE_HEAP_PROFILE_H_
+#define CAKE_HEAP_PROFILE_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "profile/profiler.h"
+
+/// The preloaded heap profiler, built next to cake, see `src/runtime/heap_profiler.cc`.
+#define HEAP_PROFILER_LIBRARY "libcake_heap_profiler.so"
+
+/// Where `cake run --heap-profile` writes, `<bin>/` each.
+#define HEAP_PROFILE_DIRECTORY ".cake/heap"
+
+/// Environment of the heap profiler: the file it writes, `.<pid>` appended,
+/// and the bytes between two stacks sampled.
+#define HEAP_PROFILE_ENV "CAKE_HEAP_PROFILE"
+#define HEAP_PROFILE_INTERVAL_ENV "CAKE_HEAP_PROFILE_INTERVAL"
+
+/// What the heap profiler wrote for a process.
+struct HeapProfile {
+	int pid = 0;
+	uint64_t interval = 0; ///< bytes between two stacks sampled
+	uint64_t allocations = 0;
+	uint64_t frees = 0;
+	uint64_t bytes = 0; ///< allocated, freed or not
+	uint64_t peak = 0; ///< most bytes in use at once
+	uint64_t lost = 0; ///< samples without room for their stack
+	Profile stacks; ///< estimated bytes of each stack sampled
+	std::map<std::vector<size_t>, uint64_t> counts; ///< estimated allocations of each stack sampled
+};
+
+/// Path of the heap profiler, empty if it's not next to cake.
+std::string HeapProfilerLibrary();
+
+/// Read `<prefix>.<pid>` of the processes the heap profiler ran in.
+std::vector<HeapProfile> ReadHeapProfiles(const std::string &prefix);
+
+/// Totals of `heap`, then the `top` allocation sites by bytes. A site is the
+/// innermost frame in the package, or with a source line otherwise.
+void PrintHeapProfile(const HeapProfile &heap, const std::vector<SourceLocation> &sources, const std::string &source_directory, size_t top);
+
+#endif // CAKE_HEAP_PROFILE_H_
@@ -0,0 +1,70 @@
+#ifndef CAKE_PGO_H_
+#define CAKE_PGO_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cmake/file_api.h"
+
+/// Where `cake pgo` keeps the profiles, in the build directory they optimize.
+#define PGO_DIRECTORY ".cake/pgo"
+
+/// What the profiles were trained with, `profile.json` of `PGO_DIRECTORY`.
+#define PGO_PROFILE_FILE "profile.json"
+
+#define LLVM_PROFDATA_COMMAND "llvm-profdata"
+
+/// The training of a build directory, and the sources it saw.
+struct PgoProfile {
+	std::string compiler; ///< `gcc` or `clang`
+	std::string build_type; ///< `CMAKE_BUILD_TYPE` of the training, the builds optimized with it use the same
+	std::string bin;
+	std::vector<std::string> train; ///< args of the training runs
+	size_t runs = 0;
+	int64_t timestamp = 0; ///< unix seconds
+	std::string commit; ///< HEAD, empty outside of git
+	double drift_threshold = 0; ///< share of `sources` changed dropping the profile
+	std::map<std::string, std::string> sources; ///< relative to the package -> hash of the content
+};
+
+/// `clang` for clang and Apple clang, `gcc` otherwise, from the compiler
+/// options of a build.
+std::string PgoCompiler(const std::vector<std::string> &options);
+
+/// Split `line` into args like a shell, with quotes and backslashes.
+std::vector<std::string> SplitArgs(const std::string &line);
+
+/// Instrumenting flags of `compiler` for `build_directory`, writing the
+/// profiles into the `PGO_DIRECTORY` of `profile_directory`.
+std::vector<std::string> PgoGenerateFlags(const std::string &compiler, const std::string &build_directory, const std::string &profile_directory);
+
+/// Flags of `compiler` optimizing `build_directory` with its profiles.
+/// Functions changed since the training are built without theirs.
+std::vector<std::string> PgoUseFlags(const std::string &compiler, const std::string &build_directory);
+
+/// Where the training runs write: the `.gcda` files of gcc, the `.profraw`
+/// files of clang.
+std::string PgoRawDirectory(const std::string &build_directory);
+
+/// The `LLVM_PROFILE_FILE` of the training runs with clang.
+std::string PgoProfileFilePattern(const std::string &build_directory);
+
+/// Merge the `.profraw` files of clang into the profile of `build_directory`
+/// with llvm-profdata. gcc adds up its own. Returns whether the training runs
+/// wrote profiles.
+bool MergePgoProfiles(const std::string &compiler, const std::string &cxx_compiler, const std::string &build_directory);
+
+/// Hash the sources of `targets` inside the package.
+std::map<std::string, std::string> HashPgoSources(const std::string &source_directory, const std::unordered_map<std::string, Target> &targets);
+
+/// Share of the sources of `profile` changed or removed since its training.
+double PgoSourceDrift(const PgoProfile &profile, const std::string &source_directory);
+
+bool ReadPgoProfile(const std::string &build_directory, PgoProfile &profile);
+
+void WritePgoProfile(const std::string &build_directory, const PgoProfile &profile);
+
+#endif // CAKE_PGO_H_
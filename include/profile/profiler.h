@@ -0,0 +1,79 @@
+#ifndef CAKE_PROFILER_H_
+#define CAKE_PROFILER_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cmake/file_api.h"
+#include "utility/common.h"
+
+#define PERF_COMMAND "perf"
+#define ADDR2LINE_COMMAND "addr2line"
+
+/// Where `cake profile` writes, `<bin>/` each.
+#define PROFILE_DIRECTORY ".cake/profile"
+
+/// A code location of the samples, an address in a binary, or a symbol of
+/// it when the address is unknown.
+struct ProfileLocation {
+	std::string binary; ///< executable or shared library, empty if unknown
+	uint64_t address = 0; ///< as linked, not as loaded, or from the start of `symbol` when there's one
+	std::string symbol; ///< mangled, when the address isn't known as linked
+
+	bool operator<(const ProfileLocation &other) const
+	{
+		return binary != other.binary ? binary < other.binary : address != other.address ? address < other.address : symbol < other.symbol;
+	}
+};
+
+/// What sampling a process collected.
+struct Profile {
+	std::string engine; ///< `perf` or `perf_event_open`
+	std::vector<ProfileLocation> locations;
+	std::map<std::vector<size_t>, uint64_t> stacks; ///< locations, leaf first -> samples
+	uint64_t samples = 0;
+	uint64_t lost = 0; ///< samples the kernel dropped
+	int exit_code = 0; ///< of the process sampled
+};
+
+/// Sample the call stacks of a process with `perf record -g`, its data goes
+/// to `directory`.
+bool SampleWithPerf(const std::string &cmd, const std::vector<std::string> &args, const ProcessOptions &options, int frequency, const std::string &directory, Profile &profile);
+
+/// Sample the call stacks of a process with `perf_event_open` and the cpu
+/// clock of the process, without perf. The kernel walks the frame pointers,
+/// stacks are complete for code built with `-fno-omit-frame-pointer`.
+bool SampleWithPerfEventOpen(const std::string &cmd, const std::vector<std::string> &args, const ProcessOptions &options, int frequency, Profile &profile);
+
+/// A location in the source.
+struct SourceLocation {
+	std::string function; ///< demangled, `[unknown]` if there's no symbol
+	std::string file; ///< absolute, empty without debug info
+	int line = 0;
+	std::string target; ///< the target of the package building the file, empty if none
+};
+
+/// Symbolize the locations of `profile` with the debug info of the binaries,
+/// through addr2line, and attribute them to the `targets` of the package.
+std::vector<SourceLocation> SymbolizeProfile(const Profile &profile, const std::string &source_directory, const std::string &build_directory, const std::unordered_map<std::string, Target> &targets);
+
+/// `src/main.cc:15 (hot)`, relative to the package if inside it, `-` without
+/// a file.
+std::string FormatSourceLocation(const std::string &file, int line, const std::string &target, const std::string &source_directory);
+
+/// `main;run;compute 42`, root first, one line per stack, for flamegraph.pl
+/// and friends.
+void WriteFoldedStacks(const std::string &file, const Profile &profile, const std::vector<SourceLocation> &sources);
+
+/// A flame graph in one HTML file, without anything to download.
+void WriteFlameGraph(const std::string &file, const std::string &title, const Profile &profile, const std::vector<SourceLocation> &sources);
+
+/// The `top` functions with the most samples: their own and with the functions
+/// they call, the line they're hottest at, and their target. Then the samples
+/// of each target.
+void PrintHotspots(const Profile &profile, const std::vector<SourceLocation> &sources, const std::string &source_directory, size_t top);
+
+#endif // CAKE_PROFILER_H_
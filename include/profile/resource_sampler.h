@@ -0,0 +1,34 @@
+#ifndef CAKE_RESOURCE_SAMPLER_H_
+#define CAKE_RESOURCE_SAMPLER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+/// Where `cake run --sample-resources` writes, `<bin>.csv` each.
+#define RESOURCE_SAMPLE_DIRECTORY ".cake/resources"
+
+/// What a process used at one point of its run, read from `/proc/<pid>`.
+struct ResourceSample {
+	double time = 0; ///< seconds since the first sample
+	int64_t rss = 0; ///< KiB
+	double cpu = 0; ///< percent of a cpu since the sample before, over 100 with several threads busy
+	int threads = 0;
+	uint64_t read_bytes = 0; ///< from storage, since the start
+	uint64_t write_bytes = 0; ///< to storage, since the start
+	uint64_t voluntary_switches = 0; ///< of the threads alive, since they started
+	uint64_t involuntary_switches = 0; ///< of the threads alive, since they started
+};
+
+/// Sample process `pid` every `interval` milliseconds until it exits, and
+/// append each sample to `csv` as it's taken. The process is left to be
+/// waited for, by `WaitCmd`. Reads a few small files of `/proc` per sample and
+/// thread, cheap enough for runs of hours.
+std::vector<ResourceSample> SampleResources(pid_t pid, size_t interval, const std::string &csv);
+
+/// A sparkline of each resource over the run, with its range or total.
+void PrintResourceSummary(const std::vector<ResourceSample> &samples);
+
+#endif // CAKE_RESOURCE_SAMPLER_H_
@@ -0,0 +1,119 @@
+#ifndef CAKE_FORK_SERVER_H_
+#define CAKE_FORK_SERVER_H_
+
+/// Fork server shim of `cake test --fork-server`, header only.
+///
+/// Wrap the main of a test executable:
+///
+///     #include <cake/fork_server.h>
+///
+///     int main(int argc, char **argv)
+///     {
+///     	return CakeForkServer(argc, argv, [](int argc, char **argv) {
+///     		testing::InitGoogleTest(&argc, argv);
+///     		return RUN_ALL_TESTS();
+///     	});
+///     }
+///
+/// Run by anything else, it calls `run(argc, argv)`. Run by cake, the process
+/// loads and initializes once, then forks a child calling `run` per test cake
+/// asks for, so the tests don't pay for the dynamic loader, static initializers
+/// and the setup done before `CakeForkServer` each.
+///
+/// Protocol, over the socket named by `CAKE_FORK_SERVER=<fd>`: a request is
+/// NUL terminated fields, the argument count, the output file and the
+/// arguments. The server replies `pid <child>` after forking, and
+/// `exit <wait status> <nanoseconds>` once the child exited. It returns when
+/// the socket is closed.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#define CAKE_FORK_SERVER_ENV "CAKE_FORK_SERVER"
+
+/// Read one NUL terminated field, false at the end of the requests.
+inline bool CakeForkServerReadField(FILE *requests, std::string &field)
+{
+	field.clear();
+	int c;
+	while ((c = getc(requests)) != EOF) {
+		if (c == '\0') {
+			return true;
+		}
+		field.push_back((char)c);
+	}
+	return false;
+}
+
+template <typename Run>
+int CakeForkServer(int argc, char **argv, Run run)
+{
+	int channel = -1;
+	const char *variable = getenv(CAKE_FORK_SERVER_ENV);
+	if (variable == nullptr || sscanf(variable, "%d", &channel) != 1) {
+		return run(argc, argv);
+	}
+	unsetenv(CAKE_FORK_SERVER_ENV);
+
+	FILE *requests = fdopen(channel, "r");
+	std::string field;
+	while (requests != nullptr && CakeForkServerReadField(requests, field)) {
+		size_t count = strtoul(field.c_str(), nullptr, 10);
+		std::string output;
+		std::vector<std::string> arguments(count);
+		bool complete = CakeForkServerReadField(requests, output);
+		for (size_t i = 0; complete && i < count; ++i) {
+			complete = CakeForkServerReadField(requests, arguments[i]);
+		}
+		if (!complete) {
+			break;
+		}
+
+		// buffered output of the server would be printed by the child too
+		fflush(stdout);
+		fflush(stderr);
+		struct timespec begin, end;
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		pid_t pid = fork();
+		if (pid == 0) {
+			setpgid(0, 0);
+			fclose(requests);
+			int fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (fd >= 0) {
+				dup2(fd, STDOUT_FILENO);
+				dup2(fd, STDERR_FILENO);
+				close(fd);
+			}
+			std::vector<char *> child_argv;
+			for (std::string &argument : arguments) {
+				child_argv.push_back(&argument[0]);
+			}
+			child_argv.push_back(nullptr);
+			exit(run((int)count, child_argv.data()));
+		}
+		if (pid < 0) {
+			dprintf(channel, "exit %d 0\n", 127 << 8);
+			continue;
+		}
+
+		// in the parent too, the group exists before cake can signal it
+		setpgid(pid, pid);
+		dprintf(channel, "pid %d\n", (int)pid);
+		int status = 0;
+		while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		long long nanoseconds = (end.tv_sec - begin.tv_sec) * 1000000000LL + (end.tv_nsec - begin.tv_nsec);
+		dprintf(channel, "exit %d %lld\n", status, nanoseconds);
+	}
+	return 0;
+}
+
+#endif // CAKE_FORK_SERVER_H_
@@ -0,0 +1,43 @@
+#ifndef CAKE_SHARDING_H_
+#define CAKE_SHARDING_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cmake/ctest.h"
+#include "cmake/file_api.h"
+
+enum class TestFramework { kNone = 0, kGoogleTest, kCatch2 };
+
+/// Case name -> seconds, of one test.
+using CaseDurations = std::unordered_map<std::string, double>;
+
+/// A test split into processes running a part of its cases each.
+struct ShardedTest {
+	std::string name; ///< of the test that was split
+	TestFramework framework = TestFramework::kNone;
+	std::vector<TestCase> shards;
+	std::vector<std::string> reports; ///< JUnit XML written by each shard
+	std::string merged_report; ///< all shard reports in one
+};
+
+/// Which test framework an executable target links, from its link command
+/// fragments and its dependencies, or from the executable itself.
+TestFramework DetectTestFramework(const std::string &build_directory, const Target &target);
+
+/// Split `test` into at most `count` shards, balanced with `durations`.
+/// Without durations GoogleTest shards through `GTEST_TOTAL_SHARDS` and
+/// `GTEST_SHARD_INDEX`, Catch2 round robin. Returns false if the test
+/// selects its cases already, or has too few of them.
+bool ShardTest(const TestCase &test, TestFramework framework, size_t count, const CaseDurations &durations, const std::string &report_directory, ShardedTest &sharded);
+
+/// Merge the shard reports into `merged_report`, and record the case durations.
+bool MergeShardReports(const ShardedTest &sharded, CaseDurations &durations);
+
+/// Recorded case durations, test name -> case durations.
+std::unordered_map<std::string, CaseDurations> ReadCaseDurations(const std::string &file);
+
+void WriteCaseDurations(const std::string &file, const std::unordered_map<std::string, CaseDurations> &durations);
+
+#endif // CAKE_SHARDING_H_
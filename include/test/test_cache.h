@@ -0,0 +1,40 @@
+#ifndef CAKE_TEST_CACHE_H_
+#define CAKE_TEST_CACHE_H_
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cmake/ctest.h"
+#include "cmake/file_api.h"
+
+/// A test that passed, and what it ran with.
+struct CachedTest {
+	std::string key; ///< hash of everything the run depended on
+	double duration = 0; ///< of the run that passed, in seconds
+};
+
+/// Test name -> its last passing run.
+using TestCache = std::unordered_map<std::string, CachedTest>;
+
+/// File path -> content hash, so files shared by tests are read once.
+using FileHashes = std::unordered_map<std::string, uint64_t>;
+
+TestCache ReadTestCache(const std::string &file);
+
+void WriteTestCache(const std::string &file, const TestCache &cache);
+
+/// Shared libraries `target` loads at runtime: the shared libraries of its
+/// link command, and the shared library targets it depends on.
+/// `targets` are all targets of the build directory, by name.
+std::vector<std::string> RuntimeLibraries(const std::string &build_directory, const std::unordered_map<std::string, Target> &targets, const Target &target);
+
+/// Hash the command of `test` with the content of the files it names, the
+/// `runtime_libraries`, its `REQUIRED_FILES`, its properties and the
+/// variables it inherits: `PATH`, the loader, locale and sanitizer variables,
+/// and `variables` (`PREFIX*` matches by prefix).
+/// Equal keys mean a rerun would see identical inputs.
+std::string TestCacheKey(const TestCase &test, const std::vector<std::string> &runtime_libraries, const std::vector<std::string> &variables, FileHashes &hashes);
+
+#endif // CAKE_TEST_CACHE_H_
@@ -0,0 +1,43 @@
+#ifndef CAKE_TEST_RUNNER_H_
+#define CAKE_TEST_RUNNER_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cmake/ctest.h"
+
+enum class TestStatus { kPassed = 0, kFailed, kTimeout, kNotRun, kCached };
+
+struct TestResult {
+	std::string name;
+	TestStatus status = TestStatus::kNotRun;
+	double duration = 0; ///< seconds
+	int exit_code = 0; ///< or 128 + signal number
+	std::string output_file; ///< what the test printed
+	std::string reason; ///< why it did not run
+};
+
+struct TestRunOptions {
+	size_t jobs = 1; ///< processors the tests may occupy at the same time
+	double timeout = 0; ///< for tests without `TIMEOUT`, in seconds, 0 means none
+	std::string output_directory; ///< where the output of each test goes
+	std::string durations_file; ///< durations recorded by previous runs
+	std::unordered_map<std::string, double> cached; ///< tests reported from a previous identical run, name -> its duration
+	bool fork_server = false; ///< run the tests of executables with the fork server shim in children of one initialized process
+};
+
+/// Recorded test durations, test name -> seconds.
+std::unordered_map<std::string, double> ReadTestDurations(const std::string &file);
+
+void WriteTestDurations(const std::string &file, const std::unordered_map<std::string, double> &durations);
+
+/// Run the tests in parallel, the longest recorded first so the suite takes
+/// about as long as its longest test. `RUN_SERIAL` tests run alone at the end.
+/// Streams one line per finished test, and records the durations.
+/// `cached` tests don't run and pass with their previous duration.
+/// With `fork_server`, executables including `runtime/fork_server.h` start
+/// once per job and fork a child per test, timed from fork to exit.
+std::vector<TestResult> RunTests(const std::vector<TestCase> &tests, const TestRunOptions &options);
+
+#endif // CAKE_TEST_RUNNER_H_
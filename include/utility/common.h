@@ -1,8 +1,12 @@
 #ifndef CAKE_HELPER_H_
 #define CAKE_HELPER_H_
 
+#include <cstdint>
 #include <functional>
 #include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/types.h>
 
 #include "log/log.h"
 
@@ -40,6 +44,39 @@ struct Tasks {
 /// Make a new process run a cmd, synchonized.
 bool RunCmdSync(const std::string &cmd, const std::vector<std::string> &args);
 
+/// Make a new process run a cmd, synchonized, and capture its standard output.
+/// Returns whether the cmd exited with code 0.
+bool RunCmdCapture(const std::string &cmd, const std::vector<std::string> &args, std::string &output);
+
+/// Like `RunCmdCapture`, but also forward the output to our standard output.
+bool RunCmdTee(const std::string &cmd, const std::vector<std::string> &args, std::string &output);
+
+/// Make a new process run a cmd, without waiting for it.
+pid_t SpawnCmd(const std::string &cmd, const std::vector<std::string> &args);
+
+/// How a process started by `SpawnCmd` is set up, between fork and exec.
+struct ProcessOptions {
+	std::string working_directory; ///< where the process runs, ours by default
+	std::vector<std::string> environment; ///< `KEY=VALUE` set on top of our environment
+	std::string output_file; ///< standard output and error go there, standard input is /dev/null
+	bool process_group = false; ///< lead a new process group, so `kill(-pid, ...)` reaches its children
+	std::function<void()> before_exec; ///< runs last in the child, right before exec
+};
+
+/// Make a new process run a cmd set up by `options`, without waiting for it.
+pid_t SpawnCmd(const std::string &cmd, const std::vector<std::string> &args, const ProcessOptions &options);
+
+/// Wait for a process started by `SpawnCmd`.
+/// Returns its exit code, or 128 + signal number if it was terminated.
+int WaitCmd(pid_t pid);
+
+/// Like `WaitCmd`, and fill the resources the process used.
+int WaitCmd(pid_t pid, struct rusage &usage);
+
+/// Run cmds (args[0] is the cmd), at most `jobs` at the same time.
+/// Returns whether all of them exited with code 0.
+bool RunCmdsParallel(const std::vector<std::vector<std::string>> &cmds, size_t jobs);
+
 /// Make a new directory, if not exists.
 bool MakeDirectory(std::string path);
 
@@ -52,5 +89,33 @@ bool WriteContentToFile(const std::string &content, const std::string &file);
 /// Whether file exists.
 bool FileExists(const std::string& file);
 
+/// Read the whole file into `content`.
+bool ReadFileContent(const std::string &file, std::string &content);
+
+/// Index of the first of `needles` found in `file`, -1 if none. Reads in
+/// chunks, test executables with debug info are hundreds of megabytes.
+int FindInFile(const std::string &file, const std::vector<std::string> &needles);
+
+/// 64-bit FNV-1a hash, chain calls by passing the previous hash as `seed`.
+uint64_t HashBytes(const std::string &bytes, uint64_t seed = 14695981039346656037ULL);
+
+/// Fixed width hex representation of a hash.
+std::string HashToHex(uint64_t hash);
+
+/// Absolute path of the running cake executable.
+std::string SelfExecutable();
+
+/// `1.23 M`, `456`.
+std::string FormatCount(double count);
+
+/// `12.3 MiB`, `456 B`.
+std::string FormatBytes(double bytes);
+
+/// Path of the program `name` in `PATH`, empty if not found.
+std::string FindProgram(const std::string &name);
+
+/// User-level cache of cake, `$XDG_CACHE_HOME/cake` or `~/.cache/cake`.
+std::string UserCacheDirectory();
+
 #endif // CAKE_HELPER_H_
 
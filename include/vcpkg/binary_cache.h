@@ -0,0 +1,33 @@
+#ifndef CAKE_BINARY_CACHE_H_
+#define CAKE_BINARY_CACHE_H_
+
+#include <cstdint>
+#include <string>
+
+/// What a `vcpkg install` did with the binary cache.
+struct BinaryCacheStats {
+	size_t restored = 0; ///< ports restored from the cache
+	size_t built = 0; ///< ports built from source
+	size_t archives = 0; ///< archives in the cache
+	uintmax_t bytes = 0; ///< size of the cache
+	size_t evicted = 0; ///< archives evicted to stay under the size cap
+};
+
+/// `VCPKG_BINARY_SOURCES` using `directory` as a read-write file cache,
+/// followed by the sources already configured in the environment, without
+/// their `clear`.
+std::string BinaryCacheSources(const std::string &directory);
+
+/// Count restored and built ports in the output of `vcpkg install`.
+void ParseVcpkgInstallOutput(const std::string &output, BinaryCacheStats &stats);
+
+/// Mark the archives of the packages installed in `packages_directory` as
+/// used, by their modification time, the ABI hashes of the status database
+/// name them. Access times are unreliable with `relatime` or `noatime`.
+void TouchInstalledArchives(const std::string &directory, const std::string &packages_directory);
+
+/// Remove the least recently used archives, by modification time, until the
+/// cache fits `max_bytes`, 0 means no limit.
+bool EvictBinaryCache(const std::string &directory, uintmax_t max_bytes, BinaryCacheStats &stats);
+
+#endif // CAKE_BINARY_CACHE_H_
@@ -0,0 +1,23 @@
+#ifndef CAKE_FINGERPRINT_H_
+#define CAKE_FINGERPRINT_H_
+
+#include <string>
+#include <vector>
+
+#define VCPKG_FINGERPRINT_FILE ".cake-fingerprint"
+
+/// Fingerprint of what `vcpkg install` resolves: the manifest and its
+/// baseline, the vcpkg checkout in `vcpkg_root` with its ports, the triplet,
+/// the content of its overlay triplet file and the options passed to vcpkg.
+std::string VcpkgManifestFingerprint(const std::string &manifest_directory, const std::string &vcpkg_root, const std::vector<std::string> &options);
+
+/// Fingerprint of a `vcpkg install`: the manifest fingerprint and the
+/// installed tree.
+std::string VcpkgInstallFingerprint(const std::string &manifest_directory, const std::string &vcpkg_root, const std::string &packages_directory, const std::vector<std::string> &options);
+
+/// The fingerprint recorded by the last successful install, empty if none.
+std::string ReadVcpkgInstallFingerprint(const std::string &packages_directory);
+
+bool WriteVcpkgInstallFingerprint(const std::string &packages_directory, const std::string &fingerprint);
+
+#endif // CAKE_FINGERPRINT_H_
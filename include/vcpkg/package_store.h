@@ -0,0 +1,28 @@
+#ifndef CAKE_PACKAGE_STORE_H_
+#define CAKE_PACKAGE_STORE_H_
+
+#include <string>
+
+/// A global store of installed vcpkg packages, shared by all projects.
+///
+/// `<store>/packages/<port>/<version>/<triplet>/<abi>/` holds the files of
+/// one package build, keyed by the hash of its `vcpkg_abi_info.txt`.
+/// `<store>/sets/<key>/` records which packages (and which vcpkg status
+/// database) an install of a manifest fingerprint `key` produced.
+/// Installed trees link their files from the store.
+
+struct PackageStoreStats {
+	size_t packages = 0; ///< packages in the installed tree
+	size_t stored = 0; ///< packages added to the store
+	size_t files = 0; ///< files linked from the store
+};
+
+/// Materialize the installed tree recorded for `key` from the store,
+/// replacing `packages_directory`. Returns false if the store lacks it.
+bool MaterializeFromPackageStore(const std::string &store_directory, const std::string &key, const std::string &packages_directory, PackageStoreStats &stats);
+
+/// Move the packages of the installed tree into the store, link them back,
+/// and record the tree for `key`.
+bool IngestIntoPackageStore(const std::string &store_directory, const std::string &key, const std::string &packages_directory, PackageStoreStats &stats);
+
+#endif // CAKE_PACKAGE_STORE_H_
@@ -0,0 +1,35 @@
+#ifndef CAKE_TRIPLET_H_
+#define CAKE_TRIPLET_H_
+
+#include <string>
+#include <vector>
+
+/// Optimization settings of a profile, applied to the vcpkg dependencies
+/// through a generated overlay triplet.
+struct TripletConfig {
+	std::string profile; ///< the profile the triplet is generated for.
+	std::string base; ///< the vcpkg triplet to derive from, the host triplet by default.
+	bool release_only = false; ///< build dependencies in release only.
+	bool lto = false; ///< link time optimization.
+	std::string march; ///< `-march=` of the target cpu.
+	std::string directory = "./packages/cake-triplets"; ///< where the generated triplets go.
+	std::string vcpkg_root = "./packages/vcpkg"; ///< where the base triplets are looked up.
+
+	/// Whether the profile needs a generated triplet.
+	bool Custom() const
+	{
+		return release_only || lto || !march.empty();
+	}
+};
+
+/// The vcpkg triplet of the host, like `x64-linux`.
+std::string HostTriplet();
+
+/// Write the overlay triplet of `config` into `config.directory` if it
+/// changed, and return its name. Returns the base triplet if nothing is custom.
+std::string WriteOverlayTriplet(const TripletConfig &config);
+
+/// Compiler flags of the profile, shared by the triplet and the project.
+std::vector<std::string> TripletCompileFlags(const TripletConfig &config);
+
+#endif // CAKE_TRIPLET_H_
@@ -0,0 +1,31 @@
+#ifndef CAKE_GIT_H_
+#define CAKE_GIT_H_
+
+#include <string>
+#include <vector>
+
+#define GIT_COMMAND "git"
+
+/// Files changed since the merge base of `revision` and HEAD, including
+/// uncommitted and untracked files, relative to the current directory.
+bool ChangedFilesSince(const std::string &revision, std::vector<std::string> &files);
+
+/// Commit of HEAD, and whether the working tree has uncommitted changes.
+bool CurrentCommit(std::string &commit, bool &dirty);
+
+/// Commit a revision names, `main`, `HEAD~3`, a tag or a hash.
+bool ResolveCommit(const std::string &revision, std::string &commit);
+
+/// Commit checked out in `directory`, a clone or a submodule of its own,
+/// not the one of a repository around it.
+bool CheckoutCommit(const std::string &directory, std::string &commit);
+
+/// Current directory relative to the top of the working tree, empty or
+/// ending with `/`.
+bool WorkingTreePrefix(std::string &prefix);
+
+/// Check out `commit` detached in the worktree `directory`, adding the
+/// worktree if it does not exist yet.
+bool CheckoutWorktree(const std::string &directory, const std::string &commit);
+
+#endif // CAKE_GIT_H_
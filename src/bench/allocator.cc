@@ -0,0 +1,148 @@
+#include "bench/allocator.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <map>
+#include <sstream>
+
+#include "bench/statistics.h"
+
+#include "utility/common.h"
+#include "vcpkg/triplet.h"
+
+namespace fs = std::filesystem;
+
+const std::vector<Allocator> &KnownAllocators()
+{
+	static const std::vector<Allocator> allocators = {
+		{ "system", "", {}, "" },
+		{ "jemalloc", "jemalloc", { "libjemalloc.so.2", "libjemalloc.so" }, "libjemalloc2" },
+		{ "tcmalloc", "gperftools", { "libtcmalloc.so.4", "libtcmalloc_minimal.so.4", "libtcmalloc.so", "libtcmalloc_minimal.so" }, "libgoogle-perftools4" },
+		{ "mimalloc", "mimalloc", { "libmimalloc.so.2", "libmimalloc.so" }, "libmimalloc2.0" },
+	};
+	return allocators;
+}
+
+const Allocator *FindAllocator(const std::string &name)
+{
+	for (const Allocator &allocator : KnownAllocators()) {
+		if (allocator.name == name) {
+			return &allocator;
+		}
+	}
+	return nullptr;
+}
+
+/// The triplet allocators are installed with, shared libraries of the host.
+static
+std::string AllocatorTriplet()
+{
+	return HostTriplet() + "-dynamic";
+}
+
+/// `libjemalloc.so.2 (libc6,x86-64) => /lib/x86_64-linux-gnu/libjemalloc.so.2`
+/// lines of `ldconfig -p`, by library name.
+static
+std::string SystemLibrary(const std::string &name)
+{
+	std::string ldconfig = FindProgram("ldconfig");
+	if (ldconfig.empty() && fs::exists("/sbin/ldconfig")) {
+		ldconfig = "/sbin/ldconfig";
+	}
+	std::string output;
+	if (ldconfig.empty() || !RunCmdCapture(ldconfig, { ldconfig, "-p" }, output)) {
+		return "";
+	}
+	std::stringstream ss(output);
+	std::string line;
+	while (std::getline(ss, line)) {
+		size_t begin = line.find_first_not_of(" \t");
+		size_t arrow = line.find(" => ");
+		if (begin != std::string::npos && arrow != std::string::npos && line.compare(begin, name.size() + 1, name + " ") == 0) {
+			return line.substr(arrow + 4);
+		}
+	}
+	return "";
+}
+
+std::string AllocatorLibrary(const Allocator &allocator)
+{
+	for (const std::string &library : allocator.libraries) {
+		fs::path installed = fs::path(ALLOCATOR_DIRECTORY) / AllocatorTriplet() / "lib" / library;
+		if (fs::exists(installed)) {
+			return fs::absolute(installed).lexically_normal().string();
+		}
+		std::string system = SystemLibrary(library);
+		if (!system.empty()) {
+			return system;
+		}
+	}
+	return "";
+}
+
+bool InstallAllocator(const Allocator &allocator, const std::string &vcpkg)
+{
+	// classic mode, the manifest of the project is left alone
+	std::vector<std::string> args{
+		vcpkg,
+		"install",
+		"--classic",
+		allocator.port + ":" + AllocatorTriplet(),
+		"--x-install-root=" ALLOCATOR_DIRECTORY,
+	};
+	return RunCmdSync(vcpkg, args) && !AllocatorLibrary(allocator).empty();
+}
+
+double Fragmentation(const AllocatorRun &run)
+{
+	if (run.heap_peak == 0 || run.heap_rss <= 0) {
+		return 0;
+	}
+	return run.heap_rss * 1024.0 / run.heap_peak;
+}
+
+void PrintAllocatorComparison(const std::vector<std::string> &allocators, const std::vector<AllocatorRun> &runs)
+{
+	// `<target>/<benchmark>` -> allocator -> median time per iteration
+	std::map<std::string, std::map<std::string, double>> medians;
+	for (const AllocatorRun &run : runs) {
+		for (const auto &item : SamplesOf({ run.run })) {
+			medians[item.first][run.allocator] = Median(item.second);
+		}
+	}
+	size_t width = 9;
+	for (const auto &item : medians) {
+		width = std::max(width, item.first.size());
+	}
+	printf("%-*s", (int)width, "Benchmark");
+	for (const std::string &allocator : allocators) {
+		printf(" %19s", allocator.c_str());
+	}
+	printf("\n");
+	for (const auto &item : medians) {
+		printf("%-*s", (int)width, item.first.c_str());
+		auto first = item.second.find(allocators.front());
+		for (const std::string &allocator : allocators) {
+			auto it = item.second.find(allocator);
+			char cell[32] = "-";
+			if (it != item.second.end() && first != item.second.end() && it != first && first->second > 0) {
+				snprintf(cell, sizeof(cell), "%s %+6.1f%%", FormatNanoseconds(it->second).c_str(), (it->second / first->second - 1) * 100);
+			} else if (it != item.second.end()) {
+				snprintf(cell, sizeof(cell), "%s", FormatNanoseconds(it->second).c_str());
+			}
+			printf(" %19s", cell);
+		}
+		printf("\n");
+	}
+
+	printf("\n%-*s %-10s %10s %10s %10s\n", (int)width, "Target", "Allocator", "Peak RSS", "Heap peak", "RSS/heap");
+	for (const AllocatorRun &run : runs) {
+		double fragmentation = Fragmentation(run);
+		char ratio[16] = "-";
+		if (fragmentation > 0) {
+			snprintf(ratio, sizeof(ratio), "%.2fx", fragmentation);
+		}
+		printf("%-*s %-10s %10s %10s %10s\n", (int)width, run.run.target.c_str(), run.allocator.c_str(),
+			FormatBytes(run.run.peak_rss * 1024.0).c_str(), run.heap_peak > 0 ? FormatBytes(run.heap_peak).c_str() : "-", ratio);
+	}
+}
@@ -0,0 +1,615 @@
+#include "bench/benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fnmatch.h>
+#include <fstream>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <sys/utsname.h>
+#include <thread>
+#include <unistd.h>
+
+#include "bench/perf_counters.h"
+#include "cmake/file_api.h"
+#include "utility/common.h"
+#include "vcs/git.h"
+
+namespace fs = std::filesystem;
+using nlohmann::json;
+
+bool IsBenchmarkTarget(const Target &target)
+{
+	// `/usr/lib/libbenchmark.so.1`, `-lbenchmark_main`, `benchmark::@6890427a1f51a3e7e1df`
+	static const std::regex library(R"((^|[/\\]|-l)(lib)?benchmark(_main)?(\.so[.0-9]*|\.a|\.lib|\.dylib)?$)");
+
+	if (target["type"] != "EXECUTABLE") {
+		return false;
+	}
+	if (target.contains("link") && target["link"].contains("commandFragments")) {
+		for (const auto &fragment : target["link"]["commandFragments"]) {
+			if (std::regex_search(fragment["fragment"].get<std::string>(), library)) {
+				return true;
+			}
+		}
+	}
+	if (target.contains("dependencies")) {
+		for (const auto &dependency : target["dependencies"]) {
+			std::string id = dependency["id"];
+			std::string name = id.substr(0, id.find("::@"));
+			if (name == "benchmark" || name == "benchmark_main") {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+std::string CompileFlagsOf(const Target &target)
+{
+	std::string flags;
+	if (target.contains("compileGroups") && !target["compileGroups"].empty()) {
+		const json &group = target["compileGroups"][0];
+		if (group.contains("compileCommandFragments")) {
+			for (const auto &fragment : group["compileCommandFragments"]) {
+				std::string value = fragment["fragment"];
+				if (!value.empty()) {
+					flags += flags.empty() ? value : " " + value;
+				}
+			}
+		}
+	}
+	return flags;
+}
+
+/// Value of the first `key : value` line of a `/proc` file.
+static
+std::string ProcValue(const std::string &file, const std::string &key)
+{
+	std::ifstream input(file);
+	std::string line;
+	while (std::getline(input, line)) {
+		if (line.compare(0, key.size(), key) == 0) {
+			size_t colon = line.find(':');
+			if (colon != std::string::npos) {
+				std::string value = line.substr(colon + 1);
+				value.erase(0, value.find_first_not_of(" \t"));
+				return value;
+			}
+		}
+	}
+	return "";
+}
+
+static
+json MachineInfo()
+{
+	json machine = json::object();
+	char host[256] = {};
+	if (gethostname(host, sizeof(host) - 1) == 0) {
+		machine["host"] = host;
+	}
+	struct utsname name;
+	if (uname(&name) == 0) {
+		machine["kernel"] = std::string(name.sysname) + " " + name.release;
+		machine["arch"] = name.machine;
+	}
+	machine["cpu"] = ProcValue("/proc/cpuinfo", "model name");
+	machine["cpus"] = std::thread::hardware_concurrency();
+	machine["memory"] = ProcValue("/proc/meminfo", "MemTotal");
+	return machine;
+}
+
+void DescribeBenchmarkEnvironment(const std::string &build_directory, BenchmarkRun &run)
+{
+	run.timestamp = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	if (!CurrentCommit(run.commit, run.dirty)) {
+		run.commit.clear();
+	}
+	run.build_type = CMakeCacheValue(build_directory, "CMAKE_BUILD_TYPE");
+
+	std::string compiler = CMakeCacheValue(build_directory, "CMAKE_CXX_COMPILER");
+	std::string version;
+	if (!compiler.empty() && RunCmdCapture(compiler, { compiler, "--version" }, version)) {
+		compiler = version.substr(0, version.find('\n'));
+	}
+	run.compiler = compiler;
+	run.machine = MachineInfo();
+}
+
+/// Times of Google Benchmark are in `time_unit`.
+static
+double ToNanoseconds(double time, const std::string &unit)
+{
+	if (unit == "us") {
+		return time * 1e3;
+	} else if (unit == "ms") {
+		return time * 1e6;
+	} else if (unit == "s") {
+		return time * 1e9;
+	}
+	return time;
+}
+
+bool RunBenchmark(const std::string &executable, const std::vector<std::string> &args, const std::string &json_file, const ProcessOptions &options, BenchmarkRun &run)
+{
+	MakeDirectory(fs::path(json_file).parent_path().string());
+	fs::remove(json_file);
+	std::vector<std::string> command{ executable };
+	command.insert(command.end(), args.begin(), args.end());
+	command.push_back("--benchmark_out=" + json_file);
+	command.push_back("--benchmark_out_format=json");
+	struct rusage usage {};
+	if (WaitCmd(SpawnCmd(executable, command, options), usage) != 0) {
+		return false;
+	}
+	run.peak_rss = usage.ru_maxrss;
+
+	std::string content;
+	if (!ReadFileContent(json_file, content)) {
+		return false;
+	}
+	json output = json::parse(content, nullptr, false);
+	if (!output.is_object() || !output.contains("benchmarks")) {
+		return false;
+	}
+	run.context = output.value("context", json::object());
+	for (const auto &benchmark : output["benchmarks"]) {
+		// repetitions are kept one by one, their aggregates are recomputed
+		if (benchmark.value("run_type", "iteration") != "iteration" || benchmark.value("error_occurred", false)) {
+			continue;
+		}
+		BenchmarkResult result;
+		result.name = benchmark.value("run_name", benchmark.value("name", ""));
+		std::string unit = benchmark.value("time_unit", "ns");
+		result.real_time = ToNanoseconds(benchmark.value("real_time", 0.0), unit);
+		result.cpu_time = ToNanoseconds(benchmark.value("cpu_time", 0.0), unit);
+		result.iterations = benchmark.value("iterations", (int64_t)0);
+		run.benchmarks.push_back(result);
+	}
+	return true;
+}
+
+std::string InstructionCounter(const std::string &requested)
+{
+	if ((requested == "auto" || requested == "cachegrind") && !FindProgram(CACHEGRIND_COMMAND).empty()) {
+		return "cachegrind";
+	}
+	if ((requested == "auto" || requested == "perf") && PerfEventSupported(PerfInstructions())) {
+		return "perf";
+	}
+	return "";
+}
+
+/// A regex matching exactly `name`, for `--benchmark_filter`.
+static
+std::string ExactFilter(const std::string &name)
+{
+	static const std::regex special(R"([.^$|()\[\]{}*+?\\])");
+	return "^" + std::regex_replace(name, special, "\\$&") + "$";
+}
+
+/// Instructions, and simulated cache misses with cachegrind.
+struct InstructionCounts {
+	double instructions = 0;
+	double l1_misses = 0;
+	double ll_misses = 0;
+};
+
+/// `events:` and `summary:` of a cachegrind output file.
+static
+bool ReadCachegrindSummary(const std::string &file, InstructionCounts &counts)
+{
+	std::ifstream input(file);
+	std::string line;
+	std::vector<std::string> events;
+	std::map<std::string, double> values;
+	while (std::getline(input, line)) {
+		std::stringstream ss(line);
+		std::string word;
+		ss >> word;
+		if (word == "events:") {
+			while (ss >> word) {
+				events.push_back(word);
+			}
+		} else if (word == "summary:") {
+			double value;
+			for (size_t i = 0; i < events.size() && ss >> value; ++i) {
+				values[events[i]] = value;
+			}
+		}
+	}
+	if (values.count("Ir") == 0) {
+		return false;
+	}
+	counts.instructions = values["Ir"];
+	counts.l1_misses = values["I1mr"] + values["D1mr"] + values["D1mw"];
+	counts.ll_misses = values["ILmr"] + values["DLmr"] + values["DLmw"];
+	return true;
+}
+
+/// Count a run of the executable with the benchmarks matching `filter`.
+static
+bool CountRun(const std::string &counter, const std::string &executable, const std::vector<std::string> &args, const std::string &filter, const std::string &json_file, const ProcessOptions &options, InstructionCounts &counts)
+{
+	std::vector<std::string> command;
+	if (counter == "cachegrind") {
+		command = { CACHEGRIND_COMMAND, "--tool=cachegrind", "--cache-sim=yes", "--cachegrind-out-file=" + json_file + ".cachegrind" };
+	}
+	command.push_back(executable);
+	command.insert(command.end(), args.begin(), args.end());
+	// a single iteration of a single repetition
+	command.push_back("--benchmark_filter=" + filter);
+	command.push_back("--benchmark_min_time=0");
+	command.push_back("--benchmark_repetitions=1");
+	command.push_back("--benchmark_out=" + json_file);
+	command.push_back("--benchmark_out_format=json");
+
+	ProcessOptions counted = options;
+	if (counter == "cachegrind") {
+		if (WaitCmd(SpawnCmd(command[0], command, counted)) != 0) {
+			return false;
+		}
+		return ReadCachegrindSummary(json_file + ".cachegrind", counts);
+	}
+
+	PerfCounters counters;
+	counters.events = { PerfInstructions() };
+	std::function<void()> gate = PerfCountersGate(counters);
+	counted.before_exec = [options, gate]() {
+		if (options.before_exec) {
+			options.before_exec();
+		}
+		gate();
+	};
+	pid_t pid = SpawnCmd(command[0], command, counted);
+	OpenPerfCounters(counters, pid);
+	int status = WaitCmd(pid);
+	std::map<std::string, double> values = ReadPerfCounters(counters);
+	if (status != 0 || values.count("instructions") == 0) {
+		return false;
+	}
+	counts.instructions = values["instructions"];
+	return true;
+}
+
+/// Iterations of `name` a run recorded in `json_file`, 0 if it did not run.
+static
+int64_t IterationsOf(const std::string &json_file, const std::string &name)
+{
+	std::string content;
+	if (!ReadFileContent(json_file, content)) {
+		return 0;
+	}
+	json output = json::parse(content, nullptr, false);
+	if (!output.is_object() || !output.contains("benchmarks")) {
+		return 0;
+	}
+	for (const auto &benchmark : output["benchmarks"]) {
+		if (benchmark.value("run_type", "iteration") == "iteration" && benchmark.value("run_name", benchmark.value("name", "")) == name) {
+			return benchmark.value("iterations", (int64_t)0);
+		}
+	}
+	return 0;
+}
+
+bool CountInstructions(const std::string &counter, const std::string &executable, const std::vector<std::string> &args, const std::string &json_file, const ProcessOptions &options, BenchmarkRun &run)
+{
+	// what starting and exiting the executable costs, without any benchmark
+	InstructionCounts empty;
+	if (!CountRun(counter, executable, args, "^cake-no-benchmark$", json_file, options, empty)) {
+		return false;
+	}
+
+	std::map<std::string, InstructionCounts> counted;
+	for (const BenchmarkResult &result : run.benchmarks) {
+		if (counted.count(result.name)) {
+			continue;
+		}
+		InstructionCounts counts;
+		if (!CountRun(counter, executable, args, ExactFilter(result.name), json_file, options, counts)) {
+			return false;
+		}
+		int64_t iterations = std::max<int64_t>(1, IterationsOf(json_file, result.name));
+		counts.instructions = std::max(0.0, counts.instructions - empty.instructions) / iterations;
+		counts.l1_misses = std::max(0.0, counts.l1_misses - empty.l1_misses) / iterations;
+		counts.ll_misses = std::max(0.0, counts.ll_misses - empty.ll_misses) / iterations;
+		counted[result.name] = counts;
+	}
+	for (BenchmarkResult &result : run.benchmarks) {
+		const InstructionCounts &counts = counted[result.name];
+		result.instructions = counts.instructions;
+		result.l1_misses = counts.l1_misses;
+		result.ll_misses = counts.ll_misses;
+	}
+	run.counter = counter;
+	return true;
+}
+
+void AppendBenchmarkRun(const std::string &store, const BenchmarkRun &run)
+{
+	json record = {
+		{ "target", run.target },
+		{ "timestamp", run.timestamp },
+		{ "commit", run.commit },
+		{ "dirty", run.dirty },
+		{ "build_type", run.build_type },
+		{ "compiler", run.compiler },
+		{ "flags", run.flags },
+		{ "machine", run.machine },
+		{ "context", run.context },
+		{ "conditions", run.conditions },
+		{ "counter", run.counter },
+		{ "peak_rss_kib", run.peak_rss },
+		{ "benchmarks", json::array() },
+	};
+	for (const BenchmarkResult &result : run.benchmarks) {
+		json benchmark = {
+			{ "name", result.name },
+			{ "real_time", result.real_time },
+			{ "cpu_time", result.cpu_time },
+			{ "iterations", result.iterations },
+		};
+		if (result.instructions > 0) {
+			benchmark["instructions"] = result.instructions;
+		}
+		if (run.counter == "cachegrind") {
+			benchmark["l1_misses"] = result.l1_misses;
+			benchmark["ll_misses"] = result.ll_misses;
+		}
+		record["benchmarks"].push_back(benchmark);
+	}
+	MakeDirectory(fs::path(store).parent_path().string());
+	std::ofstream output(store, std::ios::app);
+	output << record.dump() << "\n";
+}
+
+std::vector<BenchmarkRun> ReadBenchmarkRuns(const std::string &store)
+{
+	std::vector<BenchmarkRun> runs;
+	std::ifstream input(store);
+	std::string line;
+	while (std::getline(input, line)) {
+		json record = json::parse(line, nullptr, false);
+		if (!record.is_object()) {
+			continue;
+		}
+		BenchmarkRun run;
+		run.target = record.value("target", "");
+		run.timestamp = record.value("timestamp", (int64_t)0);
+		run.commit = record.value("commit", "");
+		run.dirty = record.value("dirty", false);
+		run.build_type = record.value("build_type", "");
+		run.compiler = record.value("compiler", "");
+		run.flags = record.value("flags", "");
+		run.machine = record.value("machine", json::object());
+		run.context = record.value("context", json::object());
+		run.conditions = record.value("conditions", json::object());
+		run.counter = record.value("counter", "");
+		run.peak_rss = record.value("peak_rss_kib", (int64_t)0);
+		for (const auto &benchmark : record.value("benchmarks", json::array())) {
+			BenchmarkResult result;
+			result.name = benchmark.value("name", "");
+			result.real_time = benchmark.value("real_time", 0.0);
+			result.cpu_time = benchmark.value("cpu_time", 0.0);
+			result.iterations = benchmark.value("iterations", (int64_t)0);
+			result.instructions = benchmark.value("instructions", 0.0);
+			result.l1_misses = benchmark.value("l1_misses", 0.0);
+			result.ll_misses = benchmark.value("ll_misses", 0.0);
+			run.benchmarks.push_back(result);
+		}
+		runs.push_back(run);
+	}
+	return runs;
+}
+
+std::string FormatNanoseconds(double nanoseconds)
+{
+	static const char *units[] = { "ns", "us", "ms", "s" };
+	size_t unit = 0;
+	while (unit < 3 && nanoseconds >= 1000) {
+		nanoseconds /= 1000;
+		unit++;
+	}
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%.3g %s", nanoseconds, units[unit]);
+	return buffer;
+}
+
+void PrintBenchmarkReport(const std::vector<BenchmarkRun> &runs)
+{
+	/// The median time of a benchmark in each run, oldest first.
+	struct History {
+		std::vector<double> times;
+		std::vector<std::string> commits;
+	};
+	std::map<std::string, History> histories;
+	for (const BenchmarkRun &run : runs) {
+		std::map<std::string, std::vector<double>> repetitions;
+		for (const BenchmarkResult &result : run.benchmarks) {
+			repetitions[run.target + "/" + result.name].push_back(result.real_time);
+		}
+		for (const auto &item : repetitions) {
+			History &history = histories[item.first];
+			history.times.push_back(Median(item.second));
+			history.commits.push_back(run.commit.substr(0, 8) + (run.dirty ? "+" : ""));
+		}
+	}
+	if (histories.empty()) {
+		logger->Info("No benchmark results recorded yet, run cake bench first");
+		return;
+	}
+
+	size_t width = 9;
+	for (const auto &item : histories) {
+		width = std::max(width, item.first.size());
+	}
+	printf("%-*s %5s %10s %10s %10s %8s  %s\n", (int)width, "Benchmark", "Runs", "First", "Best", "Latest", "Change", "Commit");
+	for (const auto &item : histories) {
+		const History &history = item.second;
+		double latest = history.times.back();
+		double best = *std::min_element(history.times.begin(), history.times.end());
+		char change[16] = "-";
+		if (history.times.size() > 1 && history.times[history.times.size() - 2] > 0) {
+			snprintf(change, sizeof(change), "%+.1f%%", (latest / history.times[history.times.size() - 2] - 1) * 100);
+		}
+		printf("%-*s %5zu %10s %10s %10s %8s  %s\n", (int)width, item.first.c_str(), history.times.size(),
+			FormatNanoseconds(history.times.front()).c_str(), FormatNanoseconds(best).c_str(),
+			FormatNanoseconds(latest).c_str(), change, history.commits.back().c_str());
+	}
+}
+
+BenchmarkSamples SamplesOf(const std::vector<BenchmarkRun> &runs)
+{
+	BenchmarkSamples samples;
+	for (const BenchmarkRun &run : runs) {
+		for (const BenchmarkResult &result : run.benchmarks) {
+			samples[run.target + "/" + result.name].push_back(result.real_time);
+		}
+	}
+	return samples;
+}
+
+BenchmarkInstructions InstructionsOf(const std::vector<BenchmarkRun> &runs)
+{
+	BenchmarkInstructions instructions;
+	for (const BenchmarkRun &run : runs) {
+		for (const BenchmarkResult &result : run.benchmarks) {
+			if (result.instructions > 0) {
+				instructions[run.target + "/" + result.name] = result.instructions;
+			}
+		}
+	}
+	return instructions;
+}
+
+void WriteBaseline(const std::string &file, const std::vector<BenchmarkRun> &runs)
+{
+	json record = {
+		{ "commit", runs.empty() ? "" : runs.front().commit },
+		{ "timestamp", runs.empty() ? 0 : runs.front().timestamp },
+		{ "samples", SamplesOf(runs) },
+		{ "instructions", InstructionsOf(runs) },
+	};
+	MakeDirectory(fs::path(file).parent_path().string());
+	std::ofstream output(file);
+	output << record.dump(1, '\t');
+}
+
+bool ReadBaseline(const std::string &file, BenchmarkBaseline &baseline)
+{
+	std::string content;
+	if (!ReadFileContent(file, content)) {
+		return false;
+	}
+	json record = json::parse(content, nullptr, false);
+	if (!record.is_object() || !record.contains("samples") || !record["samples"].is_object()) {
+		return false;
+	}
+	baseline.commit = record.value("commit", "");
+	for (auto it = record["samples"].begin(); it != record["samples"].end(); ++it) {
+		baseline.samples[it.key()] = it.value().get<std::vector<double>>();
+	}
+	baseline.instructions = record.value("instructions", BenchmarkInstructions());
+	return true;
+}
+
+double ThresholdOf(const std::string &name, const std::vector<std::pair<std::string, double>> &patterns, double threshold)
+{
+	size_t longest = 0;
+	for (const auto &pattern : patterns) {
+		if (pattern.first.size() > longest && fnmatch(pattern.first.c_str(), name.c_str(), 0) == 0) {
+			longest = pattern.first.size();
+			threshold = pattern.second;
+		}
+	}
+	return threshold;
+}
+
+std::vector<BenchmarkComparison> CompareBenchmarks(
+	const BenchmarkSamples &baseline,
+	const BenchmarkSamples &current,
+	const std::vector<std::pair<std::string, double>> &thresholds,
+	double threshold,
+	double alpha
+)
+{
+	std::vector<BenchmarkComparison> comparisons;
+	for (const auto &item : current) {
+		auto base = baseline.find(item.first);
+		if (base == baseline.end() || base->second.empty() || item.second.empty()) {
+			continue;
+		}
+		BenchmarkComparison comparison;
+		comparison.name = item.first;
+		comparison.baseline = Median(base->second);
+		comparison.current = Median(item.second);
+		comparison.change = comparison.baseline > 0 ? comparison.current / comparison.baseline - 1 : 0;
+		comparison.interval = BootstrapMedianChange(base->second, item.second, 1 - alpha);
+		comparison.p_value = MannWhitneyPValue(base->second, item.second);
+		comparison.threshold = ThresholdOf(item.first, thresholds, threshold);
+		// noise moves the median, not the whole interval past 0
+		bool significant = comparison.p_value < alpha && (comparison.interval.low > 0 || comparison.interval.high < 0);
+		comparison.regression = significant && comparison.change > comparison.threshold;
+		comparison.improvement = significant && comparison.change < -comparison.threshold;
+		comparisons.push_back(comparison);
+	}
+	return comparisons;
+}
+
+void PrintBenchmarkComparison(const std::vector<BenchmarkComparison> &comparisons)
+{
+	size_t width = 9;
+	for (const BenchmarkComparison &comparison : comparisons) {
+		width = std::max(width, comparison.name.size());
+	}
+	printf("%-*s %10s %10s %8s %19s %8s\n", (int)width, "Benchmark", "Baseline", "Current", "Change", "Interval", "p");
+	for (const BenchmarkComparison &comparison : comparisons) {
+		char interval[32];
+		snprintf(interval, sizeof(interval), "[%+.1f%%, %+.1f%%]", comparison.interval.low * 100, comparison.interval.high * 100);
+		const char *verdict = comparison.regression ? "SLOWER" : comparison.improvement ? "faster" : "";
+		printf("%-*s %10s %10s %+7.1f%% %19s %8.4f  %s\n", (int)width, comparison.name.c_str(),
+			FormatNanoseconds(comparison.baseline).c_str(), FormatNanoseconds(comparison.current).c_str(),
+			comparison.change * 100, interval, comparison.p_value, verdict);
+	}
+}
+
+std::vector<BenchmarkComparison> CompareInstructions(const BenchmarkInstructions &baseline, const BenchmarkInstructions &current, double threshold)
+{
+	std::vector<BenchmarkComparison> comparisons;
+	for (const auto &item : current) {
+		auto base = baseline.find(item.first);
+		if (base == baseline.end() || base->second <= 0) {
+			continue;
+		}
+		BenchmarkComparison comparison;
+		comparison.name = item.first;
+		comparison.baseline = base->second;
+		comparison.current = item.second;
+		comparison.change = comparison.current / comparison.baseline - 1;
+		comparison.interval = { comparison.change, comparison.change };
+		comparison.p_value = 0;
+		comparison.threshold = threshold;
+		comparison.regression = comparison.change > threshold;
+		comparison.improvement = comparison.change < -threshold;
+		comparisons.push_back(comparison);
+	}
+	return comparisons;
+}
+
+void PrintInstructionComparison(const std::vector<BenchmarkComparison> &comparisons)
+{
+	size_t width = 9;
+	for (const BenchmarkComparison &comparison : comparisons) {
+		width = std::max(width, comparison.name.size());
+	}
+	printf("%-*s %12s %12s %9s\n", (int)width, "Benchmark", "Baseline", "Current", "Change");
+	for (const BenchmarkComparison &comparison : comparisons) {
+		const char *verdict = comparison.regression ? "MORE" : comparison.improvement ? "fewer" : "";
+		printf("%-*s %12s %12s %+8.2f%%  %s\n", (int)width, comparison.name.c_str(),
+			FormatCount(comparison.baseline).c_str(), FormatCount(comparison.current).c_str(),
+			comparison.change * 100, verdict);
+	}
+}
@@ -0,0 +1,196 @@
+#include "bench/environment.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <sched.h>
+#include <set>
+#include <sstream>
+#include <string.h>
+#include <sys/personality.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utility/common.h"
+
+using nlohmann::json;
+
+#define CPU_SYSFS "/sys/devices/system/cpu"
+
+bool ParseCpuList(const std::string &list, std::vector<int> &cpus)
+{
+	std::stringstream ss(list);
+	std::string range;
+	while (std::getline(ss, range, ',')) {
+		int first = 0, last = 0;
+		char dash = 0;
+		std::stringstream rs(range);
+		if (!(rs >> first)) {
+			return false;
+		}
+		last = first;
+		if (rs >> dash && (dash != '-' || !(rs >> last))) {
+			return false;
+		}
+		if (first < 0 || last < first) {
+			return false;
+		}
+		for (int cpu = first; cpu <= last; ++cpu) {
+			cpus.push_back(cpu);
+		}
+	}
+	return !cpus.empty();
+}
+
+/// First line of a sysfs file, empty if it can't be read.
+static
+std::string ReadSysfs(const std::string &file)
+{
+	std::string content;
+	if (!ReadFileContent(file, content)) {
+		return "";
+	}
+	return content.substr(0, content.find('\n'));
+}
+
+/// Whether the kernel lets a process disable ASLR, containers may forbid it.
+static
+bool CanDisableAslr()
+{
+	pid_t pid = fork();
+	if (pid == 0) {
+		int persona = personality(0xffffffff);
+		_exit(persona != -1 && personality(persona | ADDR_NO_RANDOMIZE) != -1 && (personality(0xffffffff) & ADDR_NO_RANDOMIZE) ? 0 : 1);
+	}
+	int status = 0;
+	return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+json PrepareBenchEnvironment(const BenchEnvironmentConfig &config, std::vector<int> &cpus)
+{
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	sched_getaffinity(0, sizeof(allowed), &allowed);
+	cpus.clear();
+	if (config.cpus.empty()) {
+		// cpu 0 handles most of the interrupts and housekeeping
+		for (int cpu = CPU_SETSIZE - 1; cpu >= 0; --cpu) {
+			if (CPU_ISSET(cpu, &allowed)) {
+				cpus.push_back(cpu);
+				break;
+			}
+		}
+	} else if (!ParseCpuList(config.cpus, cpus)) {
+		logger->Error("Invalid cpu list ", config.cpus, ", expected something like 2-3,6");
+	}
+	for (int cpu : cpus) {
+		if (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed)) {
+			logger->Error("cpu ", cpu, " is not available to pin the benchmarks to");
+		}
+	}
+
+	std::set<std::string> governors;
+	std::set<int> siblings;
+	for (int cpu : cpus) {
+		std::string directory = CPU_SYSFS "/cpu" + std::to_string(cpu);
+		std::string governor = ReadSysfs(directory + "/cpufreq/scaling_governor");
+		governors.insert(governor.empty() ? "unknown" : governor);
+		std::vector<int> threads;
+		if (ParseCpuList(ReadSysfs(directory + "/topology/thread_siblings_list"), threads)) {
+			for (int thread : threads) {
+				if (thread != cpu) {
+					siblings.insert(thread);
+				}
+			}
+		}
+	}
+	std::string governor;
+	for (const std::string &name : governors) {
+		governor += governor.empty() ? name : "," + name;
+	}
+	if (governor != "performance" && governor != "unknown") {
+		logger->Warning("The cpu frequency governor is ", governor, ", the clock changes with the load. Set it to performance with `cpupower frequency-set -g performance`");
+	}
+
+	std::string turbo = "unknown";
+	std::string no_turbo = ReadSysfs(CPU_SYSFS "/intel_pstate/no_turbo");
+	std::string boost = ReadSysfs(CPU_SYSFS "/cpufreq/boost");
+	if (!no_turbo.empty()) {
+		turbo = no_turbo == "1" ? "off" : "on";
+	} else if (!boost.empty()) {
+		turbo = boost == "1" ? "on" : "off";
+	}
+	if (turbo == "on") {
+		logger->Warning("Turbo boost is on, the clock depends on temperature and the load of other cores. Turn it off through ", no_turbo.empty() ? CPU_SYSFS "/cpufreq/boost" : CPU_SYSFS "/intel_pstate/no_turbo");
+	}
+
+	for (int sibling : siblings) {
+		if (std::find(cpus.begin(), cpus.end(), sibling) == cpus.end()) {
+			logger->Warning("cpu ", sibling, " shares a core with the benchmark cpus, keep it idle or turn SMT off");
+		}
+	}
+
+	bool aslr = !config.disable_aslr || !CanDisableAslr();
+	if (config.disable_aslr && aslr) {
+		logger->Warning("Could not disable ASLR, addresses change from run to run");
+	}
+	if (aslr && ReadSysfs("/proc/sys/kernel/randomize_va_space") == "0") {
+		aslr = false;
+	}
+
+	return {
+		{ "cpus", cpus },
+		{ "governor", governor },
+		{ "turbo", turbo },
+		{ "smt_siblings", siblings },
+		{ "aslr", aslr },
+		{ "warmup_ms", config.warmup },
+	};
+}
+
+std::function<void()> BenchEnvironmentSetup(const BenchEnvironmentConfig &config, const std::vector<int> &cpus)
+{
+	return [config, cpus]() {
+		if (!cpus.empty()) {
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			for (int cpu : cpus) {
+				CPU_SET(cpu, &set);
+			}
+			if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+				fprintf(stderr, "Could not pin to the benchmark cpus: %s\n", strerror(errno));
+			}
+		}
+		if (config.disable_aslr) {
+			// kept across exec
+			int persona = personality(0xffffffff);
+			if (persona != -1) {
+				personality(persona | ADDR_NO_RANDOMIZE);
+			}
+		}
+		if (config.warmup > 0) {
+			struct timespec begin, now;
+			clock_gettime(CLOCK_MONOTONIC, &begin);
+			volatile unsigned long spin = 0;
+			do {
+				for (int i = 0; i < 100000; ++i) {
+					spin = spin + i;
+				}
+				clock_gettime(CLOCK_MONOTONIC, &now);
+			} while ((now.tv_sec - begin.tv_sec) * 1000 + (now.tv_nsec - begin.tv_nsec) / 1000000 < config.warmup);
+		}
+	};
+}
+
+std::string DescribeBenchEnvironment(const json &conditions)
+{
+	std::string cpus;
+	for (const auto &cpu : conditions.value("cpus", json::array())) {
+		cpus += (cpus.empty() ? "" : ",") + std::to_string(cpu.get<int>());
+	}
+	return "cpus " + cpus +
+		", ASLR " + (conditions.value("aslr", true) ? "on" : "off") +
+		", governor " + conditions.value("governor", "unknown") +
+		", turbo " + conditions.value("turbo", "unknown") +
+		", warm-up " + std::to_string(conditions.value("warmup_ms", 0)) + " ms";
+}
@@ -0,0 +1,122 @@
+#include "bench/perf_counters.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+PerfEvent PerfInstructions()
+{
+	return { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS };
+}
+
+std::vector<PerfEvent> PerfRunEvents()
+{
+	return {
+		{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		PerfInstructions(),
+		{ "L1-dcache-load-misses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+		{ "LLC-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+		{ "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+		// switches happen in the kernel
+		{ "context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, true },
+		{ "page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+	};
+}
+
+/// Open `event` of `pid`, disabled until it executes.
+static
+int OpenPerfEvent(const PerfEvent &event, pid_t pid)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = event.type;
+	attr.config = event.config;
+	attr.disabled = 1;
+	attr.enable_on_exec = 1;
+	attr.inherit = 1;
+	// counting the kernel needs privileges with the default perf_event_paranoid
+	attr.exclude_kernel = !event.kernel;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return (int)syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+std::function<void()> MakeExecGate(int gate[2])
+{
+	if (pipe2(gate, O_CLOEXEC) != 0) {
+		gate[0] = gate[1] = -1;
+		return []() {};
+	}
+	int read_end = gate[0], write_end = gate[1];
+	return [read_end, write_end]() {
+		close(write_end);
+		char go;
+		while (read(read_end, &go, 1) < 0 && errno == EINTR) {
+		}
+	};
+}
+
+void ReleaseExecGate(int gate[2])
+{
+	if (gate[0] >= 0) {
+		close(gate[0]);
+	}
+	if (gate[1] >= 0) {
+		// the child reads the end of the pipe
+		close(gate[1]);
+	}
+	gate[0] = gate[1] = -1;
+}
+
+std::function<void()> PerfCountersGate(PerfCounters &counters)
+{
+	return MakeExecGate(counters.gate);
+}
+
+size_t OpenPerfCounters(PerfCounters &counters, pid_t pid)
+{
+	size_t opened = 0;
+	counters.fds.clear();
+	for (const PerfEvent &event : counters.events) {
+		int fd = pid > 0 ? OpenPerfEvent(event, pid) : -1;
+		counters.fds.push_back(fd);
+		opened += fd >= 0;
+	}
+	ReleaseExecGate(counters.gate);
+	return opened;
+}
+
+std::map<std::string, double> ReadPerfCounters(PerfCounters &counters)
+{
+	std::map<std::string, double> values;
+	counters.enabled = 0;
+	for (size_t i = 0; i < counters.fds.size(); ++i) {
+		uint64_t value[3] = { 0, 0, 0 };
+		if (counters.fds[i] < 0) {
+			continue;
+		}
+		if (read(counters.fds[i], value, sizeof(value)) == (ssize_t)sizeof(value)) {
+			// value, time enabled, time running
+			values[counters.events[i].name] = value[2] > 0 && value[2] < value[1] ? (double)value[0] * value[1] / value[2] : (double)value[0];
+			counters.enabled = std::max(counters.enabled, value[1] / 1e9);
+		}
+		close(counters.fds[i]);
+	}
+	counters.fds.clear();
+	return values;
+}
+
+bool PerfEventSupported(const PerfEvent &event)
+{
+	int fd = OpenPerfEvent(event, 0);
+	if (fd < 0) {
+		return false;
+	}
+	close(fd);
+	return true;
+}
@@ -0,0 +1,91 @@
+#include "bench/statistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+double Median(std::vector<double> values)
+{
+	if (values.empty()) {
+		return 0;
+	}
+	std::sort(values.begin(), values.end());
+	size_t middle = values.size() / 2;
+	return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+double MannWhitneyPValue(const std::vector<double> &a, const std::vector<double> &b)
+{
+	size_t n1 = a.size(), n2 = b.size(), n = n1 + n2;
+	if (n1 == 0 || n2 == 0) {
+		return 1;
+	}
+
+	// rank both samples together, ties get their average rank
+	std::vector<std::pair<double, bool>> values; ///< value, whether from `a`
+	for (double value : a) {
+		values.push_back({ value, true });
+	}
+	for (double value : b) {
+		values.push_back({ value, false });
+	}
+	std::sort(values.begin(), values.end());
+	double rank_sum = 0, ties = 0;
+	for (size_t i = 0; i < n;) {
+		size_t j = i;
+		while (j < n && values[j].first == values[i].first) {
+			j++;
+		}
+		double rank = (i + 1 + j) / 2.0;
+		for (size_t k = i; k < j; ++k) {
+			if (values[k].second) {
+				rank_sum += rank;
+			}
+		}
+		double t = j - i;
+		ties += t * t * t - t;
+		i = j;
+	}
+
+	double u = rank_sum - n1 * (n1 + 1) / 2.0;
+	double mean = n1 * n2 / 2.0;
+	double variance = n1 * n2 / 12.0 * ((n + 1) - ties / (n * (n - 1.0)));
+	if (variance <= 0) {
+		return 1;
+	}
+	double difference = std::fabs(u - mean) - 0.5;
+	double z = std::max(0.0, difference) / std::sqrt(variance);
+	return std::erfc(z / std::sqrt(2.0));
+}
+
+ConfidenceInterval BootstrapMedianChange(const std::vector<double> &a, const std::vector<double> &b, double confidence, int resamples)
+{
+	ConfidenceInterval interval;
+	if (a.empty() || b.empty()) {
+		return interval;
+	}
+
+	std::mt19937_64 random(0x6361'6b65); // "cake"
+	std::uniform_int_distribution<size_t> pick_a(0, a.size() - 1), pick_b(0, b.size() - 1);
+	std::vector<double> changes, resample_a(a.size()), resample_b(b.size());
+	for (int i = 0; i < resamples; ++i) {
+		for (double &value : resample_a) {
+			value = a[pick_a(random)];
+		}
+		for (double &value : resample_b) {
+			value = b[pick_b(random)];
+		}
+		double base = Median(resample_a);
+		if (base > 0) {
+			changes.push_back(Median(resample_b) / base - 1);
+		}
+	}
+	if (changes.empty()) {
+		return interval;
+	}
+	std::sort(changes.begin(), changes.end());
+	double tail = (1 - confidence) / 2;
+	interval.low = changes[(size_t)(tail * (changes.size() - 1))];
+	interval.high = changes[(size_t)((1 - tail) * (changes.size() - 1))];
+	return interval;
+}
@@ -1,16 +1,45 @@
 #include "cake.h"
 
 #include "manifest/manifest.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <map>
 #include <ostream>
+#include <regex>
+#include <set>
 #include <sstream>
+#include <thread>
 #include <vector>
+#include "bench/allocator.h"
+#include "bench/benchmark.h"
+#include "bench/perf_counters.h"
+#include "cmake/ctest.h"
 #include "cmake/file_api.h"
+#include "cmake/target_graph.h"
+#include "create/template.h"
+#include "module/module_cache.h"
+#include "package/package.h"
+#include "profile/heap_profile.h"
+#include "profile/pgo.h"
+#include "profile/profiler.h"
+#include "profile/resource_sampler.h"
+#include "test/sharding.h"
+#include "test/test_cache.h"
+#include "test/test_runner.h"
 #include "utility/common.h"
+#include "vcpkg/binary_cache.h"
+#include "vcpkg/fingerprint.h"
+#include "vcpkg/package_store.h"
+#include "vcs/git.h"
 
 #include "utility/cxxopts.hpp"
 
 #define CMAKE_COMMAND "cmake"
+#define MODULE_CACHE_LOG_FILE ".cake/module-cache.log"
+#define RUNTIME_INCLUDE_DIRECTORY ".cake/include"
 
 using nlohmann::json;
 
@@ -31,6 +60,83 @@ bool QueryCodeModelTask(const std::string &build_directory, Task &task)
 	return true;
 }
 
+/// Write the runtime headers into `<build-directory>/.cake/include/cake/`,
+/// for the targets of the package to include.
+static
+void WriteRuntimeHeaders(const std::string &build_directory)
+{
+	std::string directory = build_directory + "/" + RUNTIME_INCLUDE_DIRECTORY + "/cake";
+	MakeDirectory(directory);
+	for (const EmbeddedFile &file : EmbeddedRuntimeFiles())
+	{
+		std::string content((const char *)file.data, file.size), previous;
+		std::string path = directory + "/" + file.path;
+		// an unchanged header keeps its timestamp, the targets including it don't rebuild
+		if (!ReadFileContent(path, previous) || previous != content)
+		{
+			std::ofstream(path, std::ios::binary) << content;
+		}
+	}
+}
+
+/// The cmake command configuring `build_directory`.
+static
+std::vector<std::string> CMakeGenerateArgs(
+	const std::string &source_directory,
+	const std::string &build_directory,
+	bool vcpkg_support,
+	const std::string &vcpkg_toolchain_file,
+	const std::string &vcpkg_manifest_directory,
+	const std::string &vcpkg_packages_directory,
+	const std::vector<std::string> &options,
+	const std::string &generator,
+	const TripletConfig &triplet
+)
+{
+	std::vector<std::string> args {
+		CMAKE_COMMAND,
+		"-S", source_directory,
+		"-B", build_directory
+	};
+	if (vcpkg_support) {
+		args.push_back("-DCMAKE_TOOLCHAIN_FILE=" + vcpkg_toolchain_file);
+		args.push_back("-DVCPKG_MANIFEST_DIR=" + vcpkg_manifest_directory);
+		args.push_back("-DVCPKG_INSTALLED_DIR=" + vcpkg_packages_directory);
+		args.push_back("-DVCPKG_MANIFEST_INSTALL=OFF"); // don't automatically install dependencies
+		if (triplet.Custom())
+		{
+			args.push_back("-DVCPKG_OVERLAY_TRIPLETS=" + triplet.directory);
+		}
+		if (triplet.Custom() || !triplet.base.empty())
+		{
+			args.push_back("-DVCPKG_TARGET_TRIPLET=" + WriteOverlayTriplet(triplet));
+		}
+		if (triplet.release_only)
+		{
+			// link the release builds of the dependencies in every configuration
+			args.push_back("-DCMAKE_MAP_IMPORTED_CONFIG_DEBUG=Release;RelWithDebInfo;MinSizeRel;");
+			args.push_back("-DCMAKE_MAP_IMPORTED_CONFIG_RELWITHDEBINFO=Release;RelWithDebInfo;MinSizeRel;");
+		}
+	}
+	// the code linking the dependencies is built with the same flags
+	std::string flags;
+	for (const std::string &flag : TripletCompileFlags(triplet)) {
+		flags += flags.empty() ? flag : " " + flag;
+	}
+	if (!flags.empty()) {
+		args.push_back("-DCMAKE_C_FLAGS=" + flags);
+		args.push_back("-DCMAKE_CXX_FLAGS=" + flags);
+	}
+	if (triplet.lto) {
+		args.push_back("-DCMAKE_INTERPROCEDURAL_OPTIMIZATION=ON");
+	}
+	for (const std::string &option : options) {
+		args.push_back("-D" + option);
+	}
+	args.push_back("-G "+ generator);
+	return args;
+}
+
 static
 bool CMakeGenerateTask(
 	const std::string &source_directory,
@@ -41,48 +147,1091 @@ bool CMakeGenerateTask(
 	const std::string &vcpkg_packages_directory,
 	const std::vector<std::string> &options,
 	const std::string &generator,
+	const TripletConfig &triplet,
 	Task &task
 )
 {
-	std::function<bool()> fn = [source_directory, build_directory, vcpkg_support, vcpkg_toolchain_file, vcpkg_manifest_directory, vcpkg_packages_directory, options, generator]() {
-		std::vector<std::string> args {
-			CMAKE_COMMAND,
-			"-S", source_directory,
-			"-B", build_directory
-		};
-		if (vcpkg_support) {
-			args.push_back("-DCMAKE_TOOLCHAIN_FILE=" + vcpkg_toolchain_file);
-			args.push_back("-DVCPKG_MANIFEST_DIR=" + vcpkg_manifest_directory);
-			args.push_back("-DVCPKG_INSTALLED_DIR=" + vcpkg_packages_directory);
-			args.push_back("-DVCPKG_MANIFEST_INSTALL=OFF"); // don't automatically install dependencies
-		}
-		for (const std::string &option : options) {
-			args.push_back("-D" + option);
-		}
-		args.push_back("-G "+ generator);
+	std::function<bool()> fn = [source_directory, build_directory, vcpkg_support, vcpkg_toolchain_file, vcpkg_manifest_directory, vcpkg_packages_directory, options, generator, triplet]() {
+		WriteRuntimeHeaders(build_directory);
+		RunCmdSync(CMAKE_COMMAND, CMakeGenerateArgs(source_directory, build_directory, vcpkg_support, vcpkg_toolchain_file, vcpkg_manifest_directory, vcpkg_packages_directory, options, generator, triplet));
+		return true;
+	};
+	task = Task(fn);
+
+	return true;
+}
+
+/// Read the targets of `build_directory` from the replies of the file api.
+static
+void ResolveMetaData(const std::string &build_directory, MetaData &data)
+{
+	ReplyIndexV1 reply_index = ResolveReplyIndexFile(build_directory);
+	CodemodelV2 codemodel_v2 = ResolveCodemodelFile(build_directory, reply_index);
+	json targets = codemodel_v2["configurations"][0]["targets"];
+	for (json::iterator it = targets.begin(); it != targets.end(); ++it) {
+		std::string target_json_file = (*it)["jsonFile"].template get<std::string>();
+		Target target = ResolveTargetFile(build_directory, target_json_file);
+		data.libs[target["name"]] = target;
+
+		if (target["type"] == "EXECUTABLE")
+		{
+			data.bins[target["name"]] = target;
+		}
+	}
+}
+
+static
+bool CMakeResolveMetaDataTask(const std::string &build_directory, Task &task)
+{
+	std::function<bool()> fn = [build_directory]() ->bool {
+		ResolveMetaData(build_directory, meta);
+
+		return true;
+	};
+
+	task = Task(fn);
+	return true;
+}
+
+static
+bool CMakeBuildTask(
+	const std::string &source_directory,
+	const std::string &build_directory,
+	const std::string &lib,
+	const std::string &bin,
+	const std::string &affected_since,
+	Task &task
+)
+{
+	std::function<bool()> fn = [source_directory, build_directory, lib, bin, affected_since]() {
+		std::vector<std::string> args{ CMAKE_COMMAND, "--build", build_directory };
+
+		if (!lib.empty())
+		{
+			if (meta.libs.count(lib) == 0)
+			{
+				logger->Error(lib, " is not avaliable, the avaliable libs are: [", meta.Libs(), "]");
+				return false;
+			}
+			args.push_back("--target");
+			args.push_back(lib);
+		} else if (!bin.empty())
+		{
+			if (meta.bins.count(bin) == 0)
+			{
+				logger->Error(bin, " is not avaliable, the avaliable binaries are: [", meta.Bins(), "]");
+				return false;
+			}
+			args.push_back("--target");
+			args.push_back(bin);
+		} else if (!affected_since.empty())
+		{
+			std::vector<std::string> changed_files;
+			if (!ChangedFilesSince(affected_since, changed_files))
+			{
+				logger->Error("Could not list the files changed since ", affected_since);
+				return false;
+			}
+
+			TargetGraph graph = ResolveTargetGraph(source_directory, build_directory, meta.libs);
+			AffectedTargets affected = ResolveAffectedTargets(graph, changed_files);
+			// a header no target lists and no dependency file names yet, like in a fresh build directory
+			auto unattributed = std::find_if(affected.unattributed.begin(), affected.unattributed.end(), [](const std::string &file) {
+				return !IsDocumentationFile(file);
+			});
+			if (affected.all)
+			{
+				logger->Info("Build files changed since ", affected_since, ", building all targets");
+				args.push_back("--target");
+				args.push_back("all");
+			} else if (unattributed != affected.unattributed.end())
+			{
+				logger->Info(*unattributed, " changed since ", affected_since, " but belongs to no target, building all targets");
+				args.push_back("--target");
+				args.push_back("all");
+			} else if (affected.targets.empty())
+			{
+				logger->Info("No target is affected by the changes since ", affected_since);
+				return true;
+			} else
+			{
+				logger->Info("Building ", affected.targets.size(), " of ", meta.libs.size(), " targets affected since ", affected_since);
+				args.push_back("--target");
+				args.insert(args.end(), affected.targets.begin(), affected.targets.end());
+			}
+		} else
+		{
+			args.push_back("--target");
+			args.push_back("all");
+		}
+
 		RunCmdSync(CMAKE_COMMAND, args);
+
+		return true;
+	};
+
+	task = Task(fn);
+
+	return true;
+}
+
+/// The compiler launcher reports to a log in the build directory, start it afresh.
+static
+bool ModuleCacheLogTask(const std::string &build_directory, Task &task)
+{
+	std::function<bool()> fn = [build_directory]() {
+		std::string log = build_directory + "/" + MODULE_CACHE_LOG_FILE;
+		MakeDirectory(std::filesystem::path(log).parent_path().string());
+		MakeFile(log);
+		setenv(MODULE_CACHE_LOG_ENV, std::filesystem::absolute(log).c_str(), 1);
+		return true;
+	};
+
+	task = Task(fn);
+
+	return true;
+}
+
+static
+bool ModuleCacheReportTask(const std::string &build_directory, Task &task)
+{
+	std::function<bool()> fn = [build_directory]() {
+		ModuleCacheStats stats = ReadModuleCacheLog(build_directory + "/" + MODULE_CACHE_LOG_FILE);
+		if (stats.std_modules_reused > 0) {
+			logger->Info("Reused ", stats.std_modules_reused, " prebuilt standard library module(s) from ", StdModuleCacheDirectory());
+		} else if (stats.std_modules > 0) {
+			logger->Info("Built and cached ", stats.std_modules, " standard library module(s) in ", StdModuleCacheDirectory());
+		}
+		if (stats.interfaces + stats.importers + stats.scans == 0) {
+			return true;
+		}
+		logger->Info("Module cache: reused ", stats.interfaces_reused, " of ", stats.interfaces, " module interfaces, ",
+			stats.importers_reused, " of ", stats.importers, " importers, ",
+			stats.scans_reused, " of ", stats.scans, " dependency scans");
 		return true;
 	};
+
 	task = Task(fn);
 
 	return true;
 }
 
+/// One line of what a run took: wall time, peak RSS, and the counters which
+/// could be read, context switches and page faults from `usage` otherwise.
+static
+void PrintRunCounters(const std::string &bin, int exit_code, double seconds, const struct rusage &usage, std::map<std::string, double> values)
+{
+	if (values.count("context-switches") == 0)
+	{
+		values["context-switches"] = usage.ru_nvcsw + usage.ru_nivcsw;
+	}
+	if (values.count("page-faults") == 0)
+	{
+		values["page-faults"] = usage.ru_minflt + usage.ru_majflt;
+	}
+	char line[128];
+	snprintf(line, sizeof(line), "%.3f s, peak RSS %.1f MiB", seconds, usage.ru_maxrss / 1024.0);
+	std::string summary = bin + " exited with " + std::to_string(exit_code) + " in " + line;
+	const std::vector<std::pair<std::string, std::string>> counters{
+		{ "cycles", "cycles" },
+		{ "instructions", "instructions" },
+		{ "L1-dcache-load-misses", "L1 misses" },
+		{ "LLC-misses", "LLC misses" },
+		{ "branch-misses", "branch misses" },
+		{ "context-switches", "context switches" },
+		{ "page-faults", "page faults" },
+	};
+	for (const auto &counter : counters)
+	{
+		if (values.count(counter.first))
+		{
+			summary += ", " + FormatCount(values[counter.first]) + " " + counter.second;
+		}
+		if (counter.first == "instructions" && values.count("cycles") && values.count("instructions") && values["cycles"] > 0)
+		{
+			snprintf(line, sizeof(line), ", %.2f IPC", values["instructions"] / values["cycles"]);
+			summary += line;
+		}
+	}
+	logger->Info(summary);
+}
+
+/// Find the allocators `names`, or build the ones missing with the vcpkg of
+/// the project.
+static
+bool AllocatorInstallTask(const InstallConfig &config, const std::vector<std::string> &names, Task &task)
+{
+	std::function<bool()> fn = [config, names]() {
+		std::string vcpkg_path = "./packages/vcpkg/vcpkg";
+		for (const std::string &name : names)
+		{
+			const Allocator *allocator = FindAllocator(name);
+			if (allocator == nullptr)
+			{
+				logger->Error("Unknown allocator ", name, ", expected system, jemalloc, tcmalloc or mimalloc");
+				return false;
+			}
+			if (allocator->port.empty() || !AllocatorLibrary(*allocator).empty())
+			{
+				continue;
+			}
+			if (!std::filesystem::exists(vcpkg_path))
+			{
+				logger->Error(name, " is not installed, install ", allocator->package, " or enable vcpkg to build it");
+				return false;
+			}
+			if (config.binary_cache)
+			{
+				// the child inherits the binary sources
+				MakeDirectory(config.binary_cache_directory);
+				setenv("VCPKG_BINARY_SOURCES", BinaryCacheSources(config.binary_cache_directory).c_str(), 1);
+			}
+			logger->Info("Building ", name, " with vcpkg into ", ALLOCATOR_DIRECTORY);
+			if (!InstallAllocator(*allocator, vcpkg_path))
+			{
+				logger->Error("Could not build ", name, " with vcpkg");
+				return false;
+			}
+		}
+		return true;
+	};
+
+	task = Task(fn);
+	return true;
+}
+
+/// `LD_PRELOAD` with `libraries` first, then the one cake runs with.
+static
+std::string PreloadEnvironment(const std::vector<std::string> &libraries)
+{
+	std::string preload;
+	for (const std::string &library : libraries)
+	{
+		if (!library.empty())
+		{
+			preload += (preload.empty() ? "" : ":") + library;
+		}
+	}
+	const char *inherited = getenv("LD_PRELOAD");
+	if (inherited && *inherited)
+	{
+		preload += (preload.empty() ? "" : ":") + std::string(inherited);
+	}
+	return "LD_PRELOAD=" + preload;
+}
+
+static
+bool RunTargetTask(const std::string &source_directory, const std::string &build_directory, const RunConfig &config, Task &task)
+{
+	std::function<bool()> fn = [source_directory, build_directory, config]() {
+		const std::string &bin = config.bin;
+		if (meta.bins.count(bin) == 0)
+		{
+			logger->Error(bin, " is not avaliable, the avaliable binaries are: [", meta.Bins(), "]");
+			return false;
+		}
+		std::string binpath = build_directory + "/" + meta.bins[bin]["artifacts"][0]["path"].template get<std::string>();
+
+		std::vector<std::string> args{ binpath };
+		for (auto &arg: config.args) {
+			args.push_back(arg);
+		}
+		std::string allocator;
+		if (!config.allocator.empty())
+		{
+			allocator = AllocatorLibrary(*FindAllocator(config.allocator));
+			if (!allocator.empty())
+			{
+				logger->Info("Running ", bin, " with ", config.allocator, " from ", allocator);
+			}
+		}
+		if (!config.bench_env && !config.counters && config.heap_profile == 0 && config.sample_resources == 0 && allocator.empty())
+		{
+			RunCmdSync(binpath, args);
+			return true;
+		}
+		ProcessOptions options;
+		if (config.bench_env)
+		{
+			std::vector<int> cpus;
+			nlohmann::json conditions = PrepareBenchEnvironment(config.environment, cpus);
+			logger->Info("Running on ", DescribeBenchEnvironment(conditions));
+			options.before_exec = BenchEnvironmentSetup(config.environment, cpus);
+		}
+		PerfCounters counters;
+		if (config.counters)
+		{
+			// the gate comes last, the warm-up is not counted
+			counters.events = PerfRunEvents();
+			std::function<void()> setup = options.before_exec;
+			std::function<void()> wait = PerfCountersGate(counters);
+			options.before_exec = [setup, wait]() {
+				if (setup)
+				{
+					setup();
+				}
+				wait();
+			};
+		}
+		std::string heap_prefix = build_directory + "/" HEAP_PROFILE_DIRECTORY "/" + bin + "/heap";
+		std::string heap_profiler;
+		if (config.heap_profile > 0)
+		{
+			heap_profiler = HeapProfilerLibrary();
+			if (heap_profiler.empty())
+			{
+				logger->Error("The heap profiler ", HEAP_PROFILER_LIBRARY, " is not next to cake, build cake again");
+				return false;
+			}
+			std::filesystem::path directory = std::filesystem::path(heap_prefix).parent_path();
+			std::filesystem::remove_all(directory);
+			std::filesystem::create_directories(directory);
+			options.environment.push_back(HEAP_PROFILE_ENV "=" + heap_prefix);
+			options.environment.push_back(HEAP_PROFILE_INTERVAL_ENV "=" + std::to_string(config.heap_profile));
+		}
+		if (!heap_profiler.empty() || !allocator.empty())
+		{
+			// the profiler forwards to the allocator preloaded after it
+			options.environment.push_back(PreloadEnvironment({ heap_profiler, allocator }));
+		}
+		auto begin = std::chrono::steady_clock::now();
+		pid_t pid = SpawnCmd(binpath, args, options);
+		if (config.counters)
+		{
+			OpenPerfCounters(counters, pid);
+		}
+		std::vector<ResourceSample> samples;
+		std::string samples_file = build_directory + "/" RESOURCE_SAMPLE_DIRECTORY "/" + bin + ".csv";
+		if (config.sample_resources > 0)
+		{
+			samples = SampleResources(pid, config.sample_resources, samples_file);
+		}
+		struct rusage usage;
+		int exit_code = WaitCmd(pid, usage);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		if (config.counters)
+		{
+			std::map<std::string, double> values = ReadPerfCounters(counters);
+			std::vector<std::string> missing;
+			for (const PerfEvent &event : counters.events)
+			{
+				// the kernel reports these of every process
+				if (values.count(event.name) == 0 && event.name != "context-switches" && event.name != "page-faults")
+				{
+					missing.push_back(event.name);
+				}
+			}
+			if (!missing.empty())
+			{
+				std::string paranoid;
+				ReadFileContent("/proc/sys/kernel/perf_event_paranoid", paranoid);
+				logger->Warning("Could not count [", missing, "], this machine has no such counters or perf_event_paranoid (",
+					paranoid.substr(0, paranoid.find('\n')), ") restricts them");
+			}
+			PrintRunCounters(bin, exit_code, counters.enabled > 0 ? counters.enabled : seconds, usage, values);
+		}
+		if (config.sample_resources > 0)
+		{
+			logger->Info("Resources of ", bin, ", ", samples.size(), " samples every ", config.sample_resources, " ms in ", samples_file);
+			PrintResourceSummary(samples);
+		}
+		if (config.heap_profile > 0)
+		{
+			std::vector<HeapProfile> heaps = ReadHeapProfiles(heap_prefix);
+			if (heaps.empty())
+			{
+				logger->Warning("No heap profile, ", bin, " is statically linked, exited without running the exit handlers, or has an allocator of its own");
+			}
+			std::unordered_map<std::string, Target> targets = meta.libs;
+			targets.insert(meta.bins.begin(), meta.bins.end());
+			for (const HeapProfile &heap : heaps)
+			{
+				std::vector<SourceLocation> sources = SymbolizeProfile(heap.stacks, source_directory, build_directory, targets);
+				PrintHeapProfile(heap, sources, source_directory, 20);
+			}
+		}
+		// like the binary, so soak tests and instrumented runs fail CI
+		if (exit_code != 0)
+		{
+			logger->Warning(bin, " exited with ", exit_code);
+			exit(exit_code);
+		}
+		return true;
+	};
+
+	task = Task(fn);
+	return true;
+}
+
+/// Where an artifact goes in the package.
+static
+std::string PackagePathOf(const Target &target, const std::string &artifact)
+{
+	std::string filename = std::filesystem::path(artifact).filename().string();
+	if (target["type"] == "EXECUTABLE")
+	{
+		return "bin/" + filename;
+	}
+	return "lib/" + filename;
+}
+
+static
+bool PackageTask(const std::string &build_directory, const PackageConfig &config, Task &task)
+{
+	// the archive alone goes to the standard output, the logs and objcopy write
+	// to the standard error, from the tasks before this one too
+	int archive_output = config.archive == "-" ? DivertStandardOutput() : STDOUT_FILENO;
+	std::function<bool()> fn = [build_directory, config, archive_output]() {
+		// select targets, all installable ones by default
+		std::vector<std::string> names;
+		for (const std::string &lib : config.libs)
+		{
+			if (meta.libs.count(lib) == 0)
+			{
+				logger->Error(lib, " is not avaliable, the avaliable libs are: [", meta.Libs(), "]");
+				return false;
+			}
+			names.push_back(lib);
+		}
+		for (const std::string &bin : config.bins)
+		{
+			if (meta.bins.count(bin) == 0)
+			{
+				logger->Error(bin, " is not avaliable, the avaliable binaries are: [", meta.Bins(), "]");
+				return false;
+			}
+			names.push_back(bin);
+		}
+		if (names.empty())
+		{
+			for (auto &item : meta.libs)
+			{
+				std::string type = item.second["type"];
+				if (type == "EXECUTABLE" || type == "SHARED_LIBRARY" || type == "STATIC_LIBRARY" || type == "MODULE_LIBRARY")
+				{
+					names.push_back(item.first);
+				}
+			}
+		}
+
+		std::string output_directory = config.output_directory.empty() ? build_directory + "/package" : config.output_directory;
+		bool staging = config.archive.empty() || config.strip;
+
+		std::vector<ArchiveEntry> entries;
+		std::vector<std::vector<std::string>> split_cmds;
+		std::vector<std::vector<std::string>> strip_cmds;
+		size_t counts[3] = { 0, 0, 0 };
+		for (const std::string &name : names)
+		{
+			const Target &target = meta.libs[name];
+			if (!target.contains("artifacts"))
+			{
+				continue;
+			}
+			for (const auto &artifact : target["artifacts"])
+			{
+				std::filesystem::path artifact_path = artifact["path"].template get<std::string>();
+				std::string path = artifact_path.is_absolute() ? artifact_path.string() : build_directory + "/" + artifact_path.string();
+				std::string package_path = PackagePathOf(target, path);
+				if (!staging)
+				{
+					entries.push_back({ path, package_path });
+					continue;
+				}
+
+				std::string staged = output_directory + "/" + package_path;
+				MakeDirectory(std::filesystem::path(staged).parent_path().string());
+				entries.push_back({ staged, package_path });
+
+				// objcopy reads the artifact and writes the stripped one, no copy needed
+				if (config.strip && target["type"] != "STATIC_LIBRARY")
+				{
+					std::string debug_directory = std::filesystem::path(staged).parent_path().string() + "/.debug";
+					std::string debug_file = debug_directory + "/" + std::filesystem::path(staged).filename().string() + ".debug";
+					MakeDirectory(debug_directory);
+					std::filesystem::remove(staged); // may be a hardlink to the artifact
+					split_cmds.push_back({ "objcopy", "--only-keep-debug", path, debug_file });
+					strip_cmds.push_back({ "objcopy", "--strip-debug", "--add-gnu-debuglink=" + debug_file, path, staged });
+					continue;
+				}
+
+				StageMethod method;
+				if (!StageFile(path, staged, method))
+				{
+					logger->Error("Could not stage ", path);
+					return false;
+				}
+				counts[(int)method]++;
+			}
+		}
+
+		size_t jobs = config.jobs > 0 ? config.jobs : std::max(1u, std::thread::hardware_concurrency());
+		if (!RunCmdsParallel(split_cmds, jobs) || !RunCmdsParallel(strip_cmds, jobs))
+		{
+			logger->Error("Could not split debug info");
+			return false;
+		}
+
+		if (staging)
+		{
+			logger->Info("Staged ", entries.size(), " artifacts into ", output_directory,
+				" (", counts[(int)StageMethod::kReflink], " reflinked, ",
+				counts[(int)StageMethod::kHardlink], " hardlinked, ",
+				counts[(int)StageMethod::kCopyFileRange], " copied in kernel, ",
+				strip_cmds.size(), " stripped)");
+		}
+		if (!config.archive.empty())
+		{
+			if (!WriteTarArchive(config.archive, entries, archive_output))
+			{
+				logger->Error("Could not write archive ", config.archive);
+				return false;
+			}
+			logger->Info("Archived ", entries.size(), " artifacts into ", config.archive);
+		}
+
+		return true;
+	};
+
+	task = Task(fn);
+	return true;
+}
+
+/// Executables of the package by their canonical path, path -> target name.
+static
+std::map<std::string, std::string> ArtifactTargets(const std::string &build_directory)
+{
+	std::map<std::string, std::string> targets;
+	for (auto &item : meta.bins)
+	{
+		if (!item.second.contains("artifacts"))
+		{
+			continue;
+		}
+		for (const auto &artifact : item.second["artifacts"])
+		{
+			std::filesystem::path path = std::filesystem::path(build_directory) / artifact["path"].get<std::string>();
+			targets[std::filesystem::weakly_canonical(path).string()] = item.first;
+		}
+	}
+	return targets;
+}
+
+/// The tests affected by the changes since `revision`: the ones running an
+/// executable of an affected target, naming a changed file, or running no
+/// executable of the package. All tests if a change can't be attributed.
+static
+std::vector<TestCase> AffectedTests(
+	const std::string &source_directory,
+	const std::string &build_directory,
+	const std::vector<TestCase> &tests,
+	const std::string &revision
+)
+{
+	std::vector<std::string> changed_files;
+	if (!ChangedFilesSince(revision, changed_files))
+	{
+		logger->Warning("Could not list the files changed since ", revision, ", running all tests");
+		return tests;
+	}
+	TargetGraph graph = ResolveTargetGraph(source_directory, build_directory, meta.libs);
+	AffectedTargets affected = ResolveAffectedTargets(graph, changed_files);
+	if (affected.all)
+	{
+		logger->Info("Build files changed since ", revision, ", running all tests");
+		return tests;
+	}
+
+	auto canonical = [](const std::filesystem::path &path) {
+		std::error_code ec;
+		std::filesystem::path resolved = std::filesystem::weakly_canonical(path, ec);
+		return ec ? path.lexically_normal().string() : resolved.string();
+	};
+	std::set<std::string> changed;
+	for (const std::string &file : changed_files)
+	{
+		changed.insert(canonical(std::filesystem::path(source_directory) / file));
+	}
+
+	// the files each test names, its executable, arguments and required files
+	std::map<std::string, std::string> artifacts = ArtifactTargets(build_directory);
+	std::set<std::string> named;
+	std::vector<TestCase> selected;
+	for (const TestCase &test : tests)
+	{
+		bool backed = false, hit = false;
+		std::vector<std::string> files = test.command;
+		files.insert(files.end(), test.required_files.begin(), test.required_files.end());
+		for (const std::string &file : files)
+		{
+			std::filesystem::path path = file;
+			std::string resolved = canonical(path.is_absolute() ? path : std::filesystem::path(test.working_directory) / path);
+			auto artifact = artifacts.find(resolved);
+			if (artifact != artifacts.end())
+			{
+				backed = true;
+				hit = hit || affected.targets.count(artifact->second) > 0;
+			}
+			if (changed.count(resolved) > 0)
+			{
+				named.insert(resolved);
+				hit = true;
+			}
+		}
+		if (hit || !backed)
+		{
+			selected.push_back(test);
+		}
+	}
+
+	// unknown headers, data files read by no test we know of
+	for (const std::string &file : affected.unattributed)
+	{
+		if (!IsDocumentationFile(file) && named.count(canonical(std::filesystem::path(source_directory) / file)) == 0)
+		{
+			logger->Info(file, " changed since ", revision, " but belongs to no target, running all tests");
+			return tests;
+		}
+	}
+
+	logger->Info("Running ", selected.size(), " of ", tests.size(), " tests affected since ", revision);
+	return selected;
+}
+
+/// Replace the tests running a GoogleTest or Catch2 executable of the
+/// package by shards of it.
+static
+std::vector<TestCase> ShardTests(
+	const std::string &build_directory,
+	const std::vector<TestCase> &tests,
+	size_t count,
+	const std::unordered_map<std::string, CaseDurations> &case_durations,
+	std::vector<ShardedTest> &sharded_tests
+)
+{
+	std::map<std::string, TestFramework> frameworks;
+	for (const auto &item : ArtifactTargets(build_directory))
+	{
+		TestFramework framework = DetectTestFramework(build_directory, meta.bins[item.second]);
+		if (framework != TestFramework::kNone)
+		{
+			frameworks[item.first] = framework;
+		}
+	}
+
+	std::vector<TestCase> expanded;
+	for (const TestCase &test : tests)
+	{
+		auto it = test.command.empty() ? frameworks.end() : frameworks.find(std::filesystem::weakly_canonical(test.command[0]).string());
+		auto durations = case_durations.find(test.name);
+		ShardedTest sharded;
+		if (it != frameworks.end() && ShardTest(test, it->second, count,
+			durations == case_durations.end() ? CaseDurations() : durations->second,
+			build_directory + "/.cake/test-results", sharded))
+		{
+			logger->Info("Sharding ", test.name, " into ", sharded.shards.size(), " processes");
+			expanded.insert(expanded.end(), sharded.shards.begin(), sharded.shards.end());
+			sharded_tests.push_back(sharded);
+		} else
+		{
+			expanded.push_back(test);
+		}
+	}
+	return expanded;
+}
+
+/// Fold the results of the shards back into one result per test.
+static
+std::vector<TestResult> MergeShardResults(
+	const std::vector<TestResult> &results,
+	const std::vector<ShardedTest> &sharded_tests,
+	std::unordered_map<std::string, CaseDurations> &case_durations
+)
+{
+	std::map<std::string, size_t> shard_of;
+	for (size_t i = 0; i < sharded_tests.size(); ++i)
+	{
+		for (const TestCase &shard : sharded_tests[i].shards)
+		{
+			shard_of[shard.name] = i;
+		}
+	}
+
+	std::vector<TestResult> merged;
+	std::vector<TestResult> folded(sharded_tests.size());
+	for (size_t i = 0; i < sharded_tests.size(); ++i)
+	{
+		folded[i].name = sharded_tests[i].name;
+		folded[i].status = TestStatus::kPassed;
+		folded[i].output_file = sharded_tests[i].merged_report;
+	}
+	for (const TestResult &result : results)
+	{
+		auto it = shard_of.find(result.name);
+		if (it == shard_of.end())
+		{
+			merged.push_back(result);
+			continue;
+		}
+		TestResult &test = folded[it->second];
+		// shards run side by side, the test took as long as its slowest shard
+		test.duration = std::max(test.duration, result.duration);
+		if (result.status != TestStatus::kPassed && test.status == TestStatus::kPassed)
+		{
+			test.status = result.status;
+			test.exit_code = result.exit_code;
+		}
+	}
+	for (size_t i = 0; i < sharded_tests.size(); ++i)
+	{
+		if (!MergeShardReports(sharded_tests[i], case_durations[sharded_tests[i].name]))
+		{
+			logger->Warning("Some shards of ", sharded_tests[i].name, " wrote no report");
+		}
+		logger->Info("Merged ", sharded_tests[i].shards.size(), " shards of ", sharded_tests[i].name, " into ", sharded_tests[i].merged_report);
+		merged.push_back(folded[i]);
+	}
+	return merged;
+}
+
+static
+bool TestTask(const std::string &source_directory, const std::string &build_directory, const TestConfig &config, Task &task)
+{
+	std::function<bool()> fn = [source_directory, build_directory, config]() {
+		std::vector<TestCase> tests = ResolveTests(build_directory);
+		if (!config.regex.empty())
+		{
+			std::regex regex(config.regex);
+			tests.erase(std::remove_if(tests.begin(), tests.end(), [&regex](const TestCase &test) {
+				return !std::regex_search(test.name, regex);
+			}), tests.end());
+		}
+		if (!config.affected_since.empty())
+		{
+			tests = AffectedTests(source_directory, build_directory, tests, config.affected_since);
+		}
+		if (tests.empty())
+		{
+			logger->Info("No tests to run in ", build_directory);
+			return true;
+		}
+
+		TestRunOptions options;
+		options.jobs = config.jobs > 0 ? config.jobs : std::max(1u, std::thread::hardware_concurrency());
+		options.timeout = config.timeout;
+		options.fork_server = config.fork_server;
+		options.output_directory = build_directory + "/.cake/test-output";
+		options.durations_file = build_directory + "/.cake/test-durations.json";
+
+		// tests whose inputs are unchanged since they passed don't run again
+		std::string cache_file = build_directory + "/.cake/test-cache.json";
+		TestCache cache = ReadTestCache(cache_file);
+		std::map<std::string, std::string> artifacts = ArtifactTargets(build_directory);
+		std::map<std::string, std::string> keys;
+		FileHashes hashes;
+		std::vector<TestCase> uncached;
+		for (const TestCase &test : tests)
+		{
+			std::vector<std::string> libraries;
+			auto artifact = test.command.empty() ? artifacts.end() : artifacts.find(std::filesystem::weakly_canonical(test.command[0]).string());
+			if (artifact != artifacts.end())
+			{
+				libraries = RuntimeLibraries(build_directory, meta.libs, meta.libs[artifact->second]);
+			}
+			keys[test.name] = TestCacheKey(test, libraries, config.cache_environment, hashes);
+			auto cached = cache.find(test.name);
+			if (!config.no_cache && cached != cache.end() && cached->second.key == keys[test.name])
+			{
+				options.cached[test.name] = cached->second.duration;
+			} else
+			{
+				uncached.push_back(test);
+			}
+		}
+
+		std::string case_durations_file = build_directory + "/.cake/test-case-durations.json";
+		std::unordered_map<std::string, CaseDurations> case_durations = ReadCaseDurations(case_durations_file);
+		std::vector<ShardedTest> sharded_tests;
+		if (config.shard_within)
+		{
+			uncached = ShardTests(build_directory, uncached, config.shards > 0 ? config.shards : options.jobs, case_durations, sharded_tests);
+			tests.erase(std::remove_if(tests.begin(), tests.end(), [&options](const TestCase &test) {
+				return options.cached.count(test.name) == 0;
+			}), tests.end());
+			tests.insert(tests.end(), uncached.begin(), uncached.end());
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		std::vector<TestResult> results = RunTests(tests, options);
+		if (!sharded_tests.empty())
+		{
+			results = MergeShardResults(results, sharded_tests, case_durations);
+			WriteCaseDurations(case_durations_file, case_durations);
+		}
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		size_t passed = 0, failed = 0, not_run = 0, cached = 0;
+		double longest = 0;
+		for (const TestResult &result : results)
+		{
+			if (result.status == TestStatus::kCached) {
+				cached++;
+				continue;
+			}
+			if (result.status == TestStatus::kPassed) {
+				passed++;
+				cache[result.name] = { keys[result.name], result.duration };
+			} else {
+				result.status == TestStatus::kNotRun ? not_run++ : failed++;
+				cache.erase(result.name);
+			}
+			longest = std::max(longest, result.duration);
+		}
+		WriteTestCache(cache_file, cache);
+
+		char timing[64];
+		snprintf(timing, sizeof(timing), "%.2fs (longest test %.2fs)", elapsed, longest);
+		logger->Info(passed, " passed, ", cached, " cached, ", failed, " failed, ", not_run, " not run in ", timing, " with ", options.jobs, " jobs");
+		if (failed > 0)
+		{
+			logger->Error(failed, " of ", results.size(), " tests failed, their output is in ", options.output_directory);
+		}
+
+		return true;
+	};
+
+	task = Task(fn);
+
+	return true;
+}
+
+/// Executables of `data` linking Google Benchmark, and the ones tagged in the manifest.
+static
+std::vector<std::string> BenchmarkTargets(const BenchConfig &config, MetaData &data)
+{
+	std::set<std::string> targets;
+	for (auto &item : data.bins)
+	{
+		if (IsBenchmarkTarget(item.second))
+		{
+			targets.insert(item.first);
+		}
+	}
+	for (const std::string &name : config.targets)
+	{
+		if (data.bins.count(name) == 0)
+		{
+			logger->Error(name, " of [bench] targets is not avaliable, the avaliable binaries are: [", data.Bins(), "]");
+		}
+		targets.insert(name);
+	}
+	if (!config.bins.empty())
+	{
+		for (const std::string &name : config.bins)
+		{
+			if (targets.count(name) == 0)
+			{
+				logger->Error(name, " is not a benchmark target, the benchmark targets are: [", std::vector<std::string>(targets.begin(), targets.end()), "]");
+			}
+		}
+		return config.bins;
+	}
+	return std::vector<std::string>(targets.begin(), targets.end());
+}
+
+static
+size_t Regressions(const std::vector<BenchmarkComparison> &comparisons)
+{
+	return std::count_if(comparisons.begin(), comparisons.end(), [](const BenchmarkComparison &comparison) {
+		return comparison.regression;
+	});
+}
+
+/// The instruction counter of `--instructions`, empty without it.
+static
+std::string BenchInstructionCounter(const BenchConfig &config)
+{
+	if (config.instructions.empty())
+	{
+		return "";
+	}
+	std::string counter = InstructionCounter(config.instructions);
+	if (counter.empty())
+	{
+		logger->Error("Could not count instructions, install valgrind for cachegrind, or run where perf_event_open counts instructions (hardware counters, kernel.perf_event_paranoid <= 2)");
+	}
+	logger->Info("Counting instructions with ", counter);
+	return counter;
+}
+
 static
-bool CMakeResolveMetaDataTask(const std::string &build_directory, Task &task)
+bool BenchTask(const std::string &build_directory, const BenchConfig &config, Task &task)
 {
-	std::function<bool()> fn = [build_directory]() ->bool {
-		ReplyIndexV1 reply_index = ResolveReplyIndexFile(build_directory);
-		CodemodelV2 codemodel_v2 = ResolveCodemodelFile(build_directory, reply_index);
-		json targets = codemodel_v2["configurations"][0]["targets"];
-		for (json::iterator it = targets.begin(); it != targets.end(); ++it) {
-			std::string target_json_file = (*it)["jsonFile"].template get<std::string>();
-			Target target = ResolveTargetFile(build_directory, target_json_file);
-			meta.libs[target["name"]] = target;
+	std::function<bool()> fn = [build_directory, config]() {
+		std::string store = build_directory + "/" + BENCH_STORE_FILE;
+		if (config.report)
+		{
+			PrintBenchmarkReport(ReadBenchmarkRuns(store));
+			return true;
+		}
+
+		std::vector<std::string> targets = BenchmarkTargets(config, meta);
+		if (targets.empty())
+		{
+			logger->Info("No benchmark targets, link Google Benchmark or list them in [bench] targets of ", MANIFEST_FILE);
+			return true;
+		}
+		std::vector<std::string> build_args{ CMAKE_COMMAND, "--build", build_directory, "--target" };
+		build_args.insert(build_args.end(), targets.begin(), targets.end());
+		if (!RunCmdSync(CMAKE_COMMAND, build_args))
+		{
+			logger->Error("Could not build the benchmark targets");
+			return false;
+		}
+
+		// compare with the baseline before spending the time to run
+		std::string baseline_directory = build_directory + "/" + BENCH_BASELINE_DIRECTORY;
+		BenchmarkBaseline baseline;
+		if (!config.baseline.empty() && !ReadBaseline(baseline_directory + "/" + config.baseline + ".json", baseline))
+		{
+			logger->Error("No baseline named ", config.baseline, ", record it with cake bench --save-baseline ", config.baseline);
+			return false;
+		}
+
+		std::string counter = BenchInstructionCounter(config);
+		std::vector<int> cpus;
+		BenchmarkRun environment;
+		DescribeBenchmarkEnvironment(build_directory, environment);
+		environment.conditions = PrepareBenchEnvironment(config.environment, cpus);
+		logger->Info("Benchmarking on ", DescribeBenchEnvironment(environment.conditions));
+		ProcessOptions options;
+		options.before_exec = BenchEnvironmentSetup(config.environment, cpus);
+		std::vector<std::string> args = config.args;
+		if (!config.filter.empty())
+		{
+			args.push_back("--benchmark_filter=" + config.filter);
+		}
+		// the heap is the same in every repetition, measured once
+		std::vector<std::string> memory_args = args;
+		// a single measurement says nothing about the noise
+		size_t repetitions = config.repetitions;
+		if (repetitions == 0 && (!config.baseline.empty() || !config.save_baseline.empty()))
+		{
+			repetitions = 10;
+		}
+		if (repetitions > 1)
+		{
+			args.push_back("--benchmark_repetitions=" + std::to_string(repetitions));
+		}
+		if (!config.allocators.empty())
+		{
+			// comparisons of allocators are not recorded, the history is of the code
+			std::string heap_profiler = HeapProfilerLibrary();
+			if (heap_profiler.empty())
+			{
+				logger->Warning("The heap profiler ", HEAP_PROFILER_LIBRARY, " is not next to cake, the fragmentation is not measured");
+			}
+			std::vector<AllocatorRun> allocator_runs;
+			for (const std::string &target : targets)
+			{
+				std::string executable = build_directory + "/" + meta.bins[target]["artifacts"][0]["path"].template get<std::string>();
+				for (const std::string &name : config.allocators)
+				{
+					AllocatorRun allocator_run;
+					allocator_run.allocator = name;
+					allocator_run.run = environment;
+					allocator_run.run.target = target;
+					allocator_run.run.conditions["allocator"] = name;
+					std::string library = AllocatorLibrary(*FindAllocator(name));
+					std::string json_file = build_directory + "/.cake/bench/" + target + "." + name + ".json";
+					ProcessOptions allocator_options = options;
+					allocator_options.environment.push_back(PreloadEnvironment({ library }));
+					logger->Info("Running ", target, " with ", name);
+					if (!RunBenchmark(executable, args, json_file, allocator_options, allocator_run.run))
+					{
+						logger->Error("Benchmark ", target, " failed with ", name);
+						return false;
+					}
+					if (!heap_profiler.empty())
+					{
+						// again with the bytes in use counted, without stacks, the profiler forwards to the allocator
+						std::string heap_prefix = build_directory + "/" HEAP_PROFILE_DIRECTORY "/" + target + "." + name + "/heap";
+						std::filesystem::remove_all(std::filesystem::path(heap_prefix).parent_path());
+						std::filesystem::create_directories(std::filesystem::path(heap_prefix).parent_path());
+						ProcessOptions memory_options = options;
+						memory_options.environment.push_back(PreloadEnvironment({ heap_profiler, library }));
+						memory_options.environment.push_back(HEAP_PROFILE_ENV "=" + heap_prefix);
+						memory_options.environment.push_back(HEAP_PROFILE_INTERVAL_ENV "=0");
+						BenchmarkRun memory_run;
+						if (!RunBenchmark(executable, memory_args, json_file, memory_options, memory_run))
+						{
+							logger->Error("Benchmark ", target, " failed with ", name, " and the heap profiler");
+							return false;
+						}
+						allocator_run.heap_rss = memory_run.peak_rss;
+						for (const HeapProfile &heap : ReadHeapProfiles(heap_prefix))
+						{
+							allocator_run.heap_peak = std::max<uint64_t>(allocator_run.heap_peak, heap.peak);
+						}
+					}
+					allocator_runs.push_back(std::move(allocator_run));
+				}
+			}
+			PrintAllocatorComparison(config.allocators, allocator_runs);
+			return true;
+		}
+
+		std::vector<BenchmarkRun> runs;
+		for (const std::string &target : targets)
+		{
+			BenchmarkRun run = environment;
+			run.target = target;
+			run.flags = CompileFlagsOf(meta.bins[target]);
+			std::string executable = build_directory + "/" + meta.bins[target]["artifacts"][0]["path"].template get<std::string>();
+			std::string json_file = build_directory + "/.cake/bench/" + target + ".json";
+			if (!RunBenchmark(executable, args, json_file, options, run))
+			{
+				logger->Error("Benchmark ", target, " failed");
+				return false;
+			}
+			if (!counter.empty() && !CountInstructions(counter, executable, config.args, json_file, options, run))
+			{
+				logger->Error("Could not count the instructions of ", target);
+				return false;
+			}
+			AppendBenchmarkRun(store, run);
+			logger->Info("Recorded ", run.benchmarks.size(), " results of ", target, " in ", store);
+			runs.push_back(std::move(run));
+		}
 
-			if (target["type"] == "EXECUTABLE")
+		if (!config.save_baseline.empty())
+		{
+			std::string file = baseline_directory + "/" + config.save_baseline + ".json";
+			WriteBaseline(file, runs);
+			logger->Info("Saved baseline ", config.save_baseline, " in ", file);
+		}
+		if (!config.baseline.empty())
+		{
+			std::string at = baseline.commit.empty() ? "" : " at " + baseline.commit.substr(0, 8);
+			std::vector<BenchmarkComparison> comparisons = CompareBenchmarks(baseline.samples, SamplesOf(runs), config.thresholds, config.threshold, config.alpha);
+			logger->Info("Against baseline ", config.baseline, at, ":");
+			PrintBenchmarkComparison(comparisons);
+			if (!counter.empty())
+			{
+				// instruction counts don't suffer from the noise of the machine, they gate instead of the times
+				if (baseline.instructions.empty())
+				{
+					logger->Error("Baseline ", config.baseline, " has no instruction counts, save it with cake bench --instructions --save-baseline ", config.baseline);
+				}
+				comparisons = CompareInstructions(baseline.instructions, InstructionsOf(runs), config.instruction_threshold);
+				logger->Info("Instructions per iteration against baseline ", config.baseline, at, ":");
+				PrintInstructionComparison(comparisons);
+			}
+			size_t regressions = Regressions(comparisons);
+			if (config.check && regressions > 0)
 			{
-				meta.bins[target["name"]] = target;
+				logger->Error(regressions, " benchmarks ", counter.empty() ? "significantly slower" : "running more instructions", " than baseline ", config.baseline);
+				return false;
 			}
 		}
 
@@ -90,74 +1239,238 @@ bool CMakeResolveMetaDataTask(const std::string &build_directory, Task &task)
 	};
 
 	task = Task(fn);
+
 	return true;
 }
 
+/// A revision of `cake bench --compare`, built in its own worktree.
+struct BenchRevision {
+	std::string revision;
+	std::string commit;
+	std::string source_directory;
+	std::string build_directory;
+	std::string manifest_directory; ///< the vcpkg manifest of the revision
+	MetaData data;
+	std::vector<BenchmarkRun> runs;
+};
+
+/// Whether the vcpkg manifests in `a` and `b` resolve the same dependencies.
 static
-bool CMakeBuildTask(
-	const std::string &build_directory,
-	const std::string &lib,
-	const std::string &bin,
-	Task &task
-)
+bool SameVcpkgManifest(const std::string &a, const std::string &b)
 {
-	std::function<bool()> fn = [build_directory, lib, bin]() {
-		std::vector<std::string> args{ CMAKE_COMMAND, "--build", build_directory };
+	for (const char *file : { "/vcpkg.json", "/vcpkg-configuration.json" })
+	{
+		std::string content_a, content_b;
+		ReadFileContent(a + file, content_a);
+		ReadFileContent(b + file, content_b);
+		if (content_a != content_b)
+		{
+			return false;
+		}
+	}
+	return true;
+}
 
-		if (!lib.empty())
+static
+bool BenchCompareTask(const BuildConfig &build_config, const BenchConfig &config, Task &task)
+{
+	std::function<bool()> fn = [build_config, config]() {
+		std::string prefix;
+		if (!WorkingTreePrefix(prefix))
 		{
-			if (meta.libs.count(lib) == 0)
+			logger->Error("cake bench --compare needs a git repository");
+			return false;
+		}
+		std::string compare_directory = build_config.build_directory + "/" + BENCH_COMPARE_DIRECTORY;
+		std::vector<BenchRevision> revisions(2);
+		for (size_t i = 0; i < revisions.size(); ++i)
+		{
+			BenchRevision &revision = revisions[i];
+			revision.revision = config.compare[i];
+			if (!ResolveCommit(revision.revision, revision.commit))
 			{
-				logger->Error(lib, " is not avaliable, the avaliable libs are: [", meta.Libs(), "]");
+				logger->Error(revision.revision, " is not a git revision");
 				return false;
 			}
-			args.push_back("--target");
-			args.push_back(lib);
-		} else if (!bin.empty())
-		{
-			if (meta.bins.count(bin) == 0)
+			// a commit keeps its worktree and build directory, later comparisons build incrementally
+			std::string directory = compare_directory + "/" + revision.commit.substr(0, 12);
+			if (!CheckoutWorktree(directory + "/worktree", revision.commit))
 			{
-				logger->Error(bin, " is not avaliable, the avaliable binaries are: [", meta.Bins(), "]");
+				logger->Error("Could not check out ", revision.revision, " in ", directory, "/worktree");
 				return false;
 			}
-			args.push_back("--target");
-			args.push_back(bin);
-		} else
+			revision.source_directory = (std::filesystem::path(directory + "/worktree/" + prefix) / build_config.source_directory).lexically_normal().string();
+			revision.build_directory = directory + "/build";
+			revision.manifest_directory = (std::filesystem::path(directory + "/worktree/" + prefix) / build_config.vcpkg_manifest_directory).lexically_normal().string();
+			// the dependencies installed are the ones of the working tree
+			if (build_config.vcpkg_support && !SameVcpkgManifest(revision.manifest_directory, build_config.vcpkg_manifest_directory))
+			{
+				logger->Warning("The vcpkg manifest of ", revision.revision, " differs from the one of the working tree, it builds with the dependencies installed for the working tree");
+			}
+		}
+
+		// both revisions configure and build at the same time, sharing the jobs
+		size_t jobs = config.jobs > 0 ? config.jobs : std::max(1u, std::thread::hardware_concurrency());
+		std::set<std::string> build_directories;
+		std::vector<std::vector<std::string>> configure_cmds;
+		// vcpkg and the dependencies are of the working tree, not in the worktrees
+		std::string vcpkg_toolchain_file = std::filesystem::absolute(build_config.vcpkg_toochain_file).lexically_normal().string();
+		std::string vcpkg_packages_directory = std::filesystem::absolute(build_config.vcpkg_packages_directory).lexically_normal().string();
+		TripletConfig triplet = build_config.triplet;
+		triplet.directory = std::filesystem::absolute(triplet.directory).lexically_normal().string();
+		triplet.vcpkg_root = std::filesystem::absolute(triplet.vcpkg_root).lexically_normal().string();
+		for (const BenchRevision &revision : revisions)
 		{
-			args.push_back("--target");
-			args.push_back("all");
+			if (!build_directories.insert(revision.build_directory).second)
+			{
+				continue;
+			}
+			MakeQueryCodeModelFile(revision.build_directory);
+			WriteRuntimeHeaders(revision.build_directory);
+			configure_cmds.push_back(CMakeGenerateArgs(
+				revision.source_directory,
+				revision.build_directory,
+				build_config.vcpkg_support,
+				vcpkg_toolchain_file,
+				revision.manifest_directory,
+				vcpkg_packages_directory,
+				build_config.options,
+				build_config.generator,
+				triplet));
+		}
+		if (!RunCmdsParallel(configure_cmds, std::min(jobs, configure_cmds.size())))
+		{
+			logger->Error("Could not configure the revisions to compare");
+			return false;
 		}
 
-		RunCmdSync(CMAKE_COMMAND, args);
+		std::set<std::string> targets[2];
+		for (size_t i = 0; i < revisions.size(); ++i)
+		{
+			ResolveMetaData(revisions[i].build_directory, revisions[i].data);
+			std::vector<std::string> names = BenchmarkTargets(config, revisions[i].data);
+			targets[i].insert(names.begin(), names.end());
+		}
+		std::vector<std::string> common;
+		for (const std::string &target : targets[0])
+		{
+			if (targets[1].count(target))
+			{
+				common.push_back(target);
+			}
+			else
+			{
+				logger->Warning(target, " is a benchmark target of ", revisions[0].revision, " only, skipped");
+			}
+		}
+		for (const std::string &target : targets[1])
+		{
+			if (targets[0].count(target) == 0)
+			{
+				logger->Warning(target, " is a benchmark target of ", revisions[1].revision, " only, skipped");
+			}
+		}
+		if (common.empty())
+		{
+			logger->Info("No benchmark targets in both revisions");
+			return true;
+		}
 
-		return true;
-	};
+		std::vector<std::vector<std::string>> build_cmds;
+		size_t build_jobs = std::max<size_t>(1, jobs / build_directories.size());
+		for (const std::string &build_directory : build_directories)
+		{
+			std::vector<std::string> build_args{ CMAKE_COMMAND, "--build", build_directory, "--parallel", std::to_string(build_jobs), "--target" };
+			build_args.insert(build_args.end(), common.begin(), common.end());
+			build_cmds.push_back(build_args);
+		}
+		if (!RunCmdsParallel(build_cmds, build_cmds.size()))
+		{
+			logger->Error("Could not build the benchmark targets of the revisions to compare");
+			return false;
+		}
 
-	task = Task(fn);
+		std::string counter = BenchInstructionCounter(config);
+		std::vector<int> cpus;
+		BenchmarkRun environment;
+		DescribeBenchmarkEnvironment(revisions[0].build_directory, environment);
+		environment.conditions = PrepareBenchEnvironment(config.environment, cpus);
+		logger->Info("Benchmarking on ", DescribeBenchEnvironment(environment.conditions));
+		ProcessOptions options;
+		options.before_exec = BenchEnvironmentSetup(config.environment, cpus);
+		std::vector<std::string> args = config.args;
+		if (!config.filter.empty())
+		{
+			args.push_back("--benchmark_filter=" + config.filter);
+		}
+		// A B B A A B..., so drift of the clock and temperature hits both alike,
+		// and neither always runs on the caches the other left
+		size_t rounds = config.repetitions > 0 ? config.repetitions : 10;
+		for (size_t round = 0; round < rounds; ++round)
+		{
+			logger->Info("Round ", round + 1, " of ", rounds);
+			for (const std::string &target : common)
+			{
+				for (size_t i = 0; i < revisions.size(); ++i)
+				{
+					BenchRevision &revision = revisions[round % 2 == 0 ? i : revisions.size() - 1 - i];
+					BenchmarkRun run = environment;
+					run.target = target;
+					run.commit = revision.commit;
+					run.dirty = false;
+					run.flags = CompileFlagsOf(revision.data.bins[target]);
+					std::string executable = revision.build_directory + "/" + revision.data.bins[target]["artifacts"][0]["path"].template get<std::string>();
+					std::string json_file = revision.build_directory + "/.cake/bench/" + target + ".json";
+					options.output_file = revision.build_directory + "/.cake/bench/" + target + ".log";
+					if (!RunBenchmark(executable, args, json_file, options, run))
+					{
+						logger->Error("Benchmark ", target, " of ", revision.revision, " failed, its output is in ", options.output_file);
+						return false;
+					}
+					revision.runs.push_back(std::move(run));
+				}
+			}
+		}
 
-	return true;
-}
+		// deterministic, counted once per revision
+		for (BenchRevision &revision : revisions)
+		{
+			for (size_t i = 0; !counter.empty() && i < common.size(); ++i)
+			{
+				BenchmarkRun &run = revision.runs[i];
+				std::string executable = revision.build_directory + "/" + revision.data.bins[run.target]["artifacts"][0]["path"].template get<std::string>();
+				std::string json_file = revision.build_directory + "/.cake/bench/" + run.target + ".json";
+				options.output_file = revision.build_directory + "/.cake/bench/" + run.target + ".log";
+				if (!CountInstructions(counter, executable, config.args, json_file, options, run))
+				{
+					logger->Error("Could not count the instructions of ", run.target, " of ", revision.revision, ", its output is in ", options.output_file);
+					return false;
+				}
+			}
+		}
 
-static
-bool RunTargetTask(const std::string &build_directory, const std::string &bin, const std::vector<std::string> &bin_args, Task &task)
-{
-	std::function<bool()> fn = [build_directory, bin, bin_args]() {
-		if (meta.bins.count(bin) == 0)
+		std::string versus = revisions[1].revision + " (" + revisions[1].commit.substr(0, 8) + ") against " + revisions[0].revision + " (" + revisions[0].commit.substr(0, 8) + ")";
+		std::vector<BenchmarkComparison> comparisons = CompareBenchmarks(SamplesOf(revisions[0].runs), SamplesOf(revisions[1].runs), config.thresholds, config.threshold, config.alpha);
+		logger->Info(versus, ":");
+		PrintBenchmarkComparison(comparisons);
+		if (!counter.empty())
 		{
-			logger->Error(bin, " is not avaliable, the avaliable binaries are: [", meta.Bins(), "]");
+			comparisons = CompareInstructions(InstructionsOf(revisions[0].runs), InstructionsOf(revisions[1].runs), config.instruction_threshold);
+			logger->Info("Instructions per iteration of ", versus, ":");
+			PrintInstructionComparison(comparisons);
+		}
+		size_t regressions = Regressions(comparisons);
+		if (config.check && regressions > 0)
+		{
+			logger->Error(regressions, " benchmarks of ", revisions[1].revision, counter.empty() ? " significantly slower" : " running more instructions", " than ", revisions[0].revision);
 			return false;
 		}
-		std::string binpath = build_directory + "/" + meta.bins[bin]["artifacts"][0]["path"].template get<std::string>();
 
-		std::vector<std::string> args{ binpath };
-		for (auto &arg: bin_args) {
-			args.push_back(arg);
-		}
-		RunCmdSync(binpath, args);
 		return true;
 	};
 
 	task = Task(fn);
+
 	return true;
 }
 
@@ -208,38 +1521,180 @@ bool DebugTargetTask(const std::string &source_directory, const std::string &bui
 }
 
 static
-bool VcpkgInstallLibraryTask(const std::string &port,
-							 bool sync,
-							 const std::vector<std::string> &options,
-							 const std::string &vcpkg_manifest_directory,
-							 const std::string &vcpkg_packages_directory,
-							 Task &task)
+bool ProfileTask(const std::string &source_directory, const std::string &build_directory, const ProfileConfig &config, Task &task)
+{
+	std::function<bool()> fn = [source_directory, build_directory, config]() {
+		const std::string &bin = config.bin;
+		if (meta.bins.count(bin) == 0)
+		{
+			logger->Error(bin, " is not avaliable, the avaliable binaries are: [", meta.Bins(), "]");
+			return false;
+		}
+		std::string binpath = build_directory + "/" + meta.bins[bin]["artifacts"][0]["path"].template get<std::string>();
+
+		std::vector<std::string> args{ binpath };
+		for (auto &arg: config.args) {
+			args.push_back(arg);
+		}
+		std::string directory = build_directory + "/" PROFILE_DIRECTORY "/" + bin;
+		std::filesystem::create_directories(directory);
+
+		std::string engine = config.engine;
+		if (engine == "auto")
+		{
+			engine = FindProgram(PERF_COMMAND).empty() ? "perf_event_open" : "perf";
+		}
+		Profile profile;
+		ProcessOptions options;
+		if (engine == "perf")
+		{
+			if (!SampleWithPerf(binpath, args, options, config.frequency, directory, profile))
+			{
+				logger->Error("perf record of ", bin, " failed");
+				return false;
+			}
+		} else if (engine == "perf_event_open")
+		{
+			if (!SampleWithPerfEventOpen(binpath, args, options, config.frequency, profile))
+			{
+				logger->Error("Could not sample ", bin, ", see /proc/sys/kernel/perf_event_paranoid, or install perf");
+				return false;
+			}
+		} else
+		{
+			logger->Error("Unknown profiler ", engine, ", expected perf or perf_event_open");
+			return false;
+		}
+		if (profile.exit_code != 0)
+		{
+			logger->Warning(bin, " exited with ", profile.exit_code);
+		}
+		logger->Info("Collected ", profile.samples, " samples with ", profile.engine, profile.lost > 0 ? ", " + std::to_string(profile.lost) + " lost" : "");
+
+		std::unordered_map<std::string, Target> targets = meta.libs;
+		targets.insert(meta.bins.begin(), meta.bins.end());
+		std::vector<SourceLocation> sources = SymbolizeProfile(profile, source_directory, build_directory, targets);
+		WriteFoldedStacks(directory + "/stacks.folded", profile, sources);
+		WriteFlameGraph(directory + "/flamegraph.html", bin + " " + profile.engine + " profile", profile, sources);
+		PrintHotspots(profile, sources, source_directory, config.top);
+		logger->Info("Flame graph: ", directory, "/flamegraph.html");
+		logger->Info("Folded stacks: ", directory, "/stacks.folded");
+		return true;
+	};
+
+	task = Task(fn);
+	return true;
+}
+
+static
+bool VcpkgInstallLibraryTask(const InstallConfig &config, Task &task)
 {
-	std::function<bool()> fn = [port, sync, options, vcpkg_manifest_directory, vcpkg_packages_directory]() {
+	std::function<bool()> fn = [config]() {
 		std::string vcpkg_path = "./packages/vcpkg/vcpkg";
+		std::string vcpkg_root = std::filesystem::path(vcpkg_path).parent_path().string();
 
-		if (sync)
+		if (config.sync)
 		{
 			std::vector<std::string> args = {
 				vcpkg_path,
 				"install",
-				"--x-manifest-root=" + vcpkg_manifest_directory,
-				"--x-install-root=" + vcpkg_packages_directory
+				"--x-manifest-root=" + config.vcpkg_manifest_directory,
+				"--x-install-root=" + config.vcpkg_packages_directory
 			};
-			for (auto &option: options)
+
+			// the triplet of the profile, generated if it carries optimization settings
+			std::vector<std::string> options;
+			if (config.triplet.Custom())
 			{
-				args.push_back(option);
+				options.push_back("--overlay-triplets=" + config.triplet.directory);
 			}
-			RunCmdSync(vcpkg_path, args);
+			if (config.triplet.Custom() || !config.triplet.base.empty())
+			{
+				options.push_back("--triplet=" + WriteOverlayTriplet(config.triplet));
+			}
+			for (auto &option: config.options)
+			{
+				options.push_back(option);
+			}
+			args.insert(args.end(), options.begin(), options.end());
+
+			// nothing changed since the last successful install
+			std::string fingerprint = VcpkgInstallFingerprint(config.vcpkg_manifest_directory, vcpkg_root, config.vcpkg_packages_directory, options);
+			if (!config.force && fingerprint == ReadVcpkgInstallFingerprint(config.vcpkg_packages_directory))
+			{
+				logger->Info("Manifest, baseline, triplet and installed tree are unchanged, skipping vcpkg install (--force to refresh)");
+				return true;
+			}
+
+			// an install of the same manifest is in the shared store
+			std::string store_key = VcpkgManifestFingerprint(config.vcpkg_manifest_directory, vcpkg_root, options);
+			if (config.shared_store && !config.force)
+			{
+				PackageStoreStats stats;
+				if (MaterializeFromPackageStore(config.store_directory, store_key, config.vcpkg_packages_directory, stats))
+				{
+					logger->Info("Linked ", stats.packages, " packages (", stats.files, " files) from the package store ", config.store_directory);
+					WriteVcpkgInstallFingerprint(config.vcpkg_packages_directory, VcpkgInstallFingerprint(config.vcpkg_manifest_directory, vcpkg_root, config.vcpkg_packages_directory, options));
+					return true;
+				}
+			}
+
+			if (!config.binary_cache)
+			{
+				RunCmdSync(vcpkg_path, args);
+			} else
+			{
+				// the child inherits the binary sources
+				MakeDirectory(config.binary_cache_directory);
+				setenv("VCPKG_BINARY_SOURCES", BinaryCacheSources(config.binary_cache_directory).c_str(), 1);
+
+				std::string output;
+				if (!RunCmdTee(vcpkg_path, args, output))
+				{
+					logger->Error("vcpkg install failed");
+					return false;
+				}
+
+				BinaryCacheStats stats;
+				ParseVcpkgInstallOutput(output, stats);
+				if (stats.restored > 0)
+				{
+					TouchInstalledArchives(config.binary_cache_directory, config.vcpkg_packages_directory);
+				}
+				EvictBinaryCache(config.binary_cache_directory, config.binary_cache_max_size * 1024 * 1024, stats);
+				if (config.cache_stats)
+				{
+					logger->Info("Binary cache ", config.binary_cache_directory, ": ",
+						stats.restored, " ports restored, ",
+						stats.built, " ports built, ",
+						stats.archives, " archives (", stats.bytes / (1024 * 1024), " MiB), ",
+						stats.evicted, " evicted");
+				}
+			}
+
+			if (config.shared_store)
+			{
+				PackageStoreStats stats;
+				if (IngestIntoPackageStore(config.store_directory, store_key, config.vcpkg_packages_directory, stats))
+				{
+					logger->Info("Stored ", stats.stored, " new of ", stats.packages, " packages in the package store ", config.store_directory);
+				} else
+				{
+					logger->Warning("Could not store the installed packages in ", config.store_directory);
+				}
+			}
+
+			// the installed tree changed, fingerprint it again
+			WriteVcpkgInstallFingerprint(config.vcpkg_packages_directory, VcpkgInstallFingerprint(config.vcpkg_manifest_directory, vcpkg_root, config.vcpkg_packages_directory, options));
 		} else {
 			std::vector<std::string> args = {
 				vcpkg_path,
 				"add",
 				"port",
-				port,
-				"--x-manifest-root=" + vcpkg_manifest_directory
+				config.port,
+				"--x-manifest-root=" + config.vcpkg_manifest_directory
 			};
-			for (auto &option: options)
+			for (auto &option: config.options)
 			{
 				args.push_back(option);
 			}
@@ -254,21 +1709,35 @@ bool VcpkgInstallLibraryTask(const std::string &port,
 }
 
 static
-bool TemplateCreateTask(const std::string &type, const std::string &name, const std::string &template_basic_directory, const std::string &template_vcpkg_directory, Task &task)
+bool TemplateCreateTask(const std::string &type, const std::string &name, const std::string &template_basic_directory, const std::string &template_vcpkg_directory, bool from_remote, Task &task)
 {
-	std::function<bool()> fn = [type, name, template_basic_directory, template_vcpkg_directory]() {
+	std::function<bool()> fn = [type, name, template_basic_directory, template_vcpkg_directory, from_remote]() {
 		std::string project_name = name.empty() ? type : name;
+		if (std::filesystem::exists(project_name))
+		{
+			logger->Error(project_name, " already exists");
+			return false;
+		}
 
-		std::string temp_project_name = "temp_cake";
-		RunCmdSync("mkdir", { "mkdir", temp_project_name });
-		RunCmdSync("git", { "git", "init", temp_project_name });
-		RunCmdSync("git", { "git", "-C", temp_project_name, "remote", "add", "origin", "https://github.com/Civitasv/cake"});
-		RunCmdSync("git", { "git", "-C", temp_project_name, "config", "core.sparseCheckout", "true" });
-		WriteContentToFile("template/" + type, "./" + temp_project_name + "/.git/info/sparse-checkout");
-		RunCmdSync("git", { "git", "-C", temp_project_name, "pull", "origin", "main" });
-
-		RunCmdSync("mv", { "mv", temp_project_name + "/template/" + type, "./" + project_name });
-		RunCmdSync("rm", { "rm", "-rf", temp_project_name });
+		if (from_remote)
+		{
+			std::string temp_project_name = "temp_cake";
+			RunCmdSync("mkdir", { "mkdir", temp_project_name });
+			RunCmdSync("git", { "git", "init", temp_project_name });
+			RunCmdSync("git", { "git", "-C", temp_project_name, "remote", "add", "origin", "https://github.com/Civitasv/cake"});
+			RunCmdSync("git", { "git", "-C", temp_project_name, "config", "core.sparseCheckout", "true" });
+			WriteContentToFile("template/" + type, "./" + temp_project_name + "/.git/info/sparse-checkout");
+			RunCmdSync("git", { "git", "-C", temp_project_name, "pull", "origin", "main" });
+
+			RunCmdSync("mv", { "mv", temp_project_name + "/template/" + type, "./" + project_name });
+			RunCmdSync("rm", { "rm", "-rf", temp_project_name });
+
+			SubstituteTemplateDirectory(project_name, project_name);
+		} else if (!WriteEmbeddedTemplate(type, project_name, project_name))
+		{
+			logger->Error(type, " is not avaliable, the avaliable templates are: [", EmbeddedTemplateTypes(), "]");
+			return false;
+		}
 
 		RunCmdSync("git", { "git", "init", project_name });
 		if (type == "vcpkg")
@@ -297,6 +1766,147 @@ bool DocsCreateTask(Task &task)
 	return true;
 }
 
+/// Add `flags` to the C and C++ flags of `options`, after the ones of the
+/// triplet, or the ones set with `--config`.
+static
+void AddCompileFlags(const TripletConfig &triplet, std::vector<std::string> &options, const std::vector<std::string> &flags)
+{
+	std::string triplet_flags;
+	for (const std::string &flag : TripletCompileFlags(triplet))
+	{
+		triplet_flags += triplet_flags.empty() ? flag : " " + flag;
+	}
+	for (const std::string variable : { "CMAKE_C_FLAGS", "CMAKE_CXX_FLAGS" })
+	{
+		std::string value = triplet_flags;
+		for (auto it = options.begin(); it != options.end();)
+		{
+			// `CMAKE_CXX_FLAGS=...` or `CMAKE_CXX_FLAGS:STRING=...`
+			size_t end = it->find_first_of(":=");
+			if (it->compare(0, end, variable) == 0 && end == variable.size())
+			{
+				value = it->substr(it->find('=') + 1);
+				it = options.erase(it);
+			} else
+			{
+				++it;
+			}
+		}
+		for (const std::string &flag : flags)
+		{
+			value += value.empty() ? flag : " " + flag;
+		}
+		options.push_back(variable + "=" + value);
+	}
+}
+
+/// Build with the profiles `cake pgo` stored in the build directory, while
+/// few of the sources profiled changed since.
+static
+void ApplyPgoProfile(const BuildConfig &config, std::vector<std::string> &options)
+{
+	PgoProfile profile;
+	if (!ReadPgoProfile(config.build_directory, profile))
+	{
+		return;
+	}
+	// the profiles are of the code of the training's build type, the profile
+	// may default to another outside of cake pgo
+	for (std::string &option : options)
+	{
+		if (option.rfind("CMAKE_BUILD_TYPE=", 0) == 0 && !profile.build_type.empty() && option != "CMAKE_BUILD_TYPE=" + profile.build_type)
+		{
+			logger->Info("Building in ", profile.build_type, ", the build type the profiles of ", profile.bin, " were trained in");
+			option = "CMAKE_BUILD_TYPE=" + profile.build_type;
+		}
+	}
+	std::string compiler = PgoCompiler(options);
+	double drift = PgoSourceDrift(profile, config.source_directory);
+	if (profile.compiler != compiler)
+	{
+		logger->Warning("The profiles of ", profile.bin, " are of ", profile.compiler, ", building with ", compiler, " without them, train again with cake pgo");
+		AddCompileFlags(config.triplet, options, {});
+	} else if (drift > profile.drift_threshold)
+	{
+		logger->Warning((int)(drift * 100 + 0.5), "% of the sources changed since the training of ", profile.bin, ", building without its profiles, train again with cake pgo");
+		// the flags of the profiles are in the cache, replace them
+		AddCompileFlags(config.triplet, options, {});
+	} else
+	{
+		logger->Info("Optimizing with the profiles of ", profile.bin, " trained at ", profile.commit.empty() ? "-" : profile.commit.substr(0, 8),
+			", ", (int)(drift * 100 + 0.5), "% of the sources changed since");
+		AddCompileFlags(config.triplet, options, PgoUseFlags(compiler, config.build_directory));
+	}
+}
+
+/// Clear the profiles of the last training, and have clang write the new
+/// ones next to the profiles of gcc.
+static
+bool PgoTrainTask(const std::string &build_directory, const std::string &compiler, Task &task)
+{
+	std::function<bool()> fn = [build_directory, compiler]() {
+		std::string raw_directory = PgoRawDirectory(build_directory);
+		std::filesystem::remove_all(std::filesystem::path(raw_directory).parent_path());
+		std::filesystem::create_directories(raw_directory);
+		if (compiler == "clang")
+		{
+			// the training runs inherit it
+			setenv("LLVM_PROFILE_FILE", PgoProfileFilePattern(build_directory).c_str(), 1);
+		}
+		return true;
+	};
+
+	task = Task(fn);
+	return true;
+}
+
+/// Merge the profiles of the training, and record the sources they are of.
+static
+bool PgoProfileTask(const BuildConfig &build_config, const PgoConfig &config, const std::string &compiler, Task &task)
+{
+	std::function<bool()> fn = [build_config, config, compiler]() {
+		std::string cxx_compiler, build_type;
+		for (const std::string &option : build_config.options)
+		{
+			if (option.rfind("CMAKE_CXX_COMPILER", 0) == 0)
+			{
+				cxx_compiler = option.substr(option.find('=') + 1);
+			} else if (option.rfind("CMAKE_BUILD_TYPE=", 0) == 0)
+			{
+				build_type = option.substr(option.find('=') + 1);
+			}
+		}
+		if (!MergePgoProfiles(compiler, cxx_compiler, build_config.build_directory))
+		{
+			logger->Error("The training of ", config.bin, " wrote no profiles, it has to exit normally, not killed or with _exit");
+			return false;
+		}
+
+		PgoProfile profile;
+		profile.compiler = compiler;
+		profile.build_type = build_type;
+		profile.bin = config.bin;
+		profile.train = SplitArgs(config.train);
+		profile.runs = config.runs;
+		profile.timestamp = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		bool dirty = false;
+		if (!CurrentCommit(profile.commit, dirty))
+		{
+			profile.commit.clear();
+		}
+		profile.drift_threshold = config.drift_threshold;
+		// the targets of the instrumented build, the same as the optimized one
+		profile.sources = HashPgoSources(build_config.source_directory, meta.libs);
+		WritePgoProfile(build_config.build_directory, profile);
+		logger->Info("Stored the profiles of ", config.runs, " training runs of ", config.bin, " and ", profile.sources.size(), " sources in ",
+			build_config.build_directory, "/" PGO_DIRECTORY);
+		return true;
+	};
+
+	task = Task(fn);
+	return true;
+}
+
 void CakeBuild(const BuildConfig &config)
 {
 	Tasks tasks;
@@ -307,6 +1917,23 @@ void CakeBuild(const BuildConfig &config)
 	{
 		tasks.AddTask(task);
 	}
+	// cake launches the compiler to cache module work
+	std::vector<std::string> options = config.options;
+	ApplyPgoProfile(config, options);
+	bool launch = config.module_cache;
+	if (config.module_cache)
+	{
+		options.push_back("CMAKE_CXX_COMPILER_LAUNCHER=" + SelfExecutable() + ";launch");
+	} else if (ImportsStdModule(config.source_directory, config.build_directory))
+	{
+		// the std module is built once per compiler and flags, for all projects
+		options.push_back("CMAKE_CXX_COMPILER_LAUNCHER=" + SelfExecutable() + ";launch;--std-only");
+		launch = true;
+	} else if (CMakeCacheValue(config.build_directory, "CMAKE_CXX_COMPILER_LAUNCHER").rfind(SelfExecutable() + ";launch", 0) == 0)
+	{
+		// the launcher of an earlier build stays in the cache otherwise
+		options.push_back("CMAKE_CXX_COMPILER_LAUNCHER=");
+	}
 	// generate task
 	if (CMakeGenerateTask(
 		config.source_directory,
@@ -315,8 +1942,9 @@ void CakeBuild(const BuildConfig &config)
 		config.vcpkg_toochain_file,
 		config.vcpkg_manifest_directory,
 		config.vcpkg_packages_directory,
-		config.options,
+		options,
 		config.generator,
+		config.triplet,
 		task))
 	{
 		tasks.AddTask(task);
@@ -326,8 +1954,16 @@ void CakeBuild(const BuildConfig &config)
 	{
 		tasks.AddTask(task);
 	}
+	if (launch && ModuleCacheLogTask(config.build_directory, task))
+	{
+		tasks.AddTask(task);
+	}
 	// build task
-	if (CMakeBuildTask(config.build_directory, config.lib, config.bin, task))
+	if (CMakeBuildTask(config.source_directory, config.build_directory, config.lib, config.bin, config.affected_since, task))
+	{
+		tasks.AddTask(task);
+	}
+	if (launch && ModuleCacheReportTask(config.build_directory, task))
 	{
 		tasks.AddTask(task);
 	}
@@ -335,18 +1971,23 @@ void CakeBuild(const BuildConfig &config)
 	tasks.Execute();
 }
 
-void CakeRun(const BuildConfig &build_config, const RunConfig &run_config)
+void CakeRun(const BuildConfig &build_config, const RunConfig &run_config, const InstallConfig &install_config)
 {
 	Tasks tasks;
 
 	Task task;
+	// allocator task
+	if (!run_config.allocator.empty() && AllocatorInstallTask(install_config, { run_config.allocator }, task))
+	{
+		tasks.AddTask(task);
+	}
 	// metadata
 	if (CMakeResolveMetaDataTask(build_config.build_directory, task))
 	{
 		tasks.AddTask(task);
 	}
 	// run task
-	if (RunTargetTask(build_config.build_directory, run_config.bin, run_config.args, task))
+	if (RunTargetTask(build_config.source_directory, build_config.build_directory, run_config, task))
 	{
 		tasks.AddTask(task);
 	}
@@ -373,6 +2014,189 @@ void CakeDebug(const BuildConfig &build_config, const DebugConfig &debug_config)
 	tasks.Execute();
 }
 
+void CakePackage(const BuildConfig &build_config, const PackageConfig &package_config)
+{
+	Tasks tasks;
+
+	Task task;
+	// metadata
+	if (CMakeResolveMetaDataTask(build_config.build_directory, task))
+	{
+		tasks.AddTask(task);
+	}
+	// package task
+	if (PackageTask(build_config.build_directory, package_config, task))
+	{
+		tasks.AddTask(task);
+	}
+
+	tasks.Execute();
+}
+
+void CakeTest(const BuildConfig &build_config, const TestConfig &test_config)
+{
+	Tasks tasks;
+
+	Task task;
+	// metadata
+	if (CMakeResolveMetaDataTask(build_config.build_directory, task))
+	{
+		tasks.AddTask(task);
+	}
+	// test task
+	if (TestTask(build_config.source_directory, build_config.build_directory, test_config, task))
+	{
+		tasks.AddTask(task);
+	}
+
+	tasks.Execute();
+}
+
+void CakeBench(const BuildConfig &build_config, const BenchConfig &bench_config, const InstallConfig &install_config)
+{
+	Tasks tasks;
+
+	Task task;
+	if (!bench_config.compare.empty())
+	{
+		// the revisions are configured in their own worktrees
+		if (BenchCompareTask(build_config, bench_config, task))
+		{
+			tasks.AddTask(task);
+		}
+		tasks.Execute();
+		return;
+	}
+	if (!bench_config.report)
+	{
+		// generate query files
+		if (QueryCodeModelTask(build_config.build_directory, task))
+		{
+			tasks.AddTask(task);
+		}
+		// generate task
+		if (CMakeGenerateTask(
+			build_config.source_directory,
+			build_config.build_directory,
+			build_config.vcpkg_support,
+			build_config.vcpkg_toochain_file,
+			build_config.vcpkg_manifest_directory,
+			build_config.vcpkg_packages_directory,
+			build_config.options,
+			build_config.generator,
+			build_config.triplet,
+			task))
+		{
+			tasks.AddTask(task);
+		}
+		// metadata
+		if (CMakeResolveMetaDataTask(build_config.build_directory, task))
+		{
+			tasks.AddTask(task);
+		}
+	}
+	// allocator task
+	if (!bench_config.report && !bench_config.allocators.empty() && AllocatorInstallTask(install_config, bench_config.allocators, task))
+	{
+		tasks.AddTask(task);
+	}
+	// bench task
+	if (BenchTask(build_config.build_directory, bench_config, task))
+	{
+		tasks.AddTask(task);
+	}
+
+	tasks.Execute();
+}
+
+void CakeProfile(const BuildConfig &build_config, const ProfileConfig &profile_config)
+{
+	Tasks tasks;
+
+	Task task;
+	// metadata
+	if (CMakeResolveMetaDataTask(build_config.build_directory, task))
+	{
+		tasks.AddTask(task);
+	}
+	// profile task
+	if (ProfileTask(build_config.source_directory, build_config.build_directory, profile_config, task))
+	{
+		tasks.AddTask(task);
+	}
+
+	tasks.Execute();
+}
+
+void CakePgo(const BuildConfig &build_config, const PgoConfig &pgo_config)
+{
+	Tasks tasks;
+
+	Task task;
+	// the instrumented build is next to the one it optimizes
+	BuildConfig instrumented = build_config;
+	instrumented.build_directory = build_config.build_directory + "-instrumented";
+	std::string compiler = PgoCompiler(build_config.options);
+	AddCompileFlags(instrumented.triplet, instrumented.options, PgoGenerateFlags(compiler, instrumented.build_directory, build_config.build_directory));
+	// generate query files
+	if (QueryCodeModelTask(instrumented.build_directory, task))
+	{
+		tasks.AddTask(task);
+	}
+	// generate task
+	if (CMakeGenerateTask(
+		instrumented.source_directory,
+		instrumented.build_directory,
+		instrumented.vcpkg_support,
+		instrumented.vcpkg_toochain_file,
+		instrumented.vcpkg_manifest_directory,
+		instrumented.vcpkg_packages_directory,
+		instrumented.options,
+		instrumented.generator,
+		instrumented.triplet,
+		task))
+	{
+		tasks.AddTask(task);
+	}
+	// metadata
+	if (CMakeResolveMetaDataTask(instrumented.build_directory, task))
+	{
+		tasks.AddTask(task);
+	}
+	// build task
+	if (CMakeBuildTask(instrumented.source_directory, instrumented.build_directory, "", pgo_config.bin, "", task))
+	{
+		tasks.AddTask(task);
+	}
+	// train tasks
+	if (PgoTrainTask(build_config.build_directory, compiler, task))
+	{
+		tasks.AddTask(task);
+	}
+	RunConfig run_config;
+	run_config.bin = pgo_config.bin;
+	run_config.args = SplitArgs(pgo_config.train);
+	for (size_t i = 0; i < pgo_config.runs; i++)
+	{
+		if (RunTargetTask(instrumented.source_directory, instrumented.build_directory, run_config, task))
+		{
+			tasks.AddTask(task);
+		}
+	}
+	if (PgoProfileTask(build_config, pgo_config, compiler, task))
+	{
+		tasks.AddTask(task);
+	}
+
+	tasks.Execute();
+	if (tasks.status != Status::kSuccess)
+	{
+		return;
+	}
+	// the build picks up the profiles
+	CakeBuild(build_config);
+}
+
 void CakeInstall(const InstallConfig &install_config)
 {
 	if (!install_config.vcpkg_support)
@@ -384,7 +2208,7 @@ void CakeInstall(const InstallConfig &install_config)
 
 	Task task;
 	// install task
-	if (VcpkgInstallLibraryTask(install_config.port, install_config.sync, install_config.options, install_config.vcpkg_manifest_directory, install_config.vcpkg_packages_directory, task))
+	if (VcpkgInstallLibraryTask(install_config, task))
 	{
 		tasks.AddTask(task);
 	}
@@ -399,7 +2223,7 @@ void CakeCreate(const CreateConfig &create_config)
 
 	Task task;
 	// install task
-	if (TemplateCreateTask(create_config.type, create_config.name, create_config.template_basic_directory, create_config.template_vcpkg_directory, task))
+	if (TemplateCreateTask(create_config.type, create_config.name, create_config.template_basic_directory, create_config.template_vcpkg_directory, create_config.from_remote, task))
 	{
 		tasks.AddTask(task);
 	}
@@ -426,13 +2250,18 @@ int main(int argc, char **argv)
 	if (argc == 1) { // then it is `cake` itself
 		printf("A wrapper for cmake\n");
 		printf("Usage:\n");
-		printf("  cake [build|run|debug|install|create|docs] [OPTION...]");
+		printf("  cake [build|run|debug|test|bench|profile|pgo|package|install|create|docs] [OPTION...]");
 		return 0;
 	}
 
 	// firstly, check the mode
 	char *mode = argv[1];
-	if (strcmp(mode, "build") == 0) {
+	if (strcmp(mode, "launch") == 0) {
+		// not for users: cake as the compiler launcher, `cake launch <compiler> <args>...`
+		// `cake launch --std-only <compiler> <args>...` only caches the std module
+		bool std_only = argc > 2 && strcmp(argv[2], "--std-only") == 0;
+		return LaunchCompiler(std::vector<std::string>(argv + (std_only ? 3 : 2), argv + argc), std_only);
+	} else if (strcmp(mode, "build") == 0) {
 		cxxopts::Options options(
 			"cake build",
 			"Compile local packages and all of their dependencies");
@@ -441,15 +2270,17 @@ int main(int argc, char **argv)
 		// target selection options
 		("lib", "Build the package's library", cxxopts::value<std::string>())
 		("bin", "Build the specified binary", cxxopts::value<std::vector<std::string>>())
+		("affected-since", "Build only targets affected by changes since the revision", cxxopts::value<std::string>())
 		// common options
 		("vcpkg", "Whether support vcpkg", cxxopts::value<bool>())
 		("config", "Set configuration value", cxxopts::value<std::vector<std::string>>())
+		("profile", "Use [profile.<name>] of the manifest", cxxopts::value<std::string>())
 		("help", "Print help information");
 		// clang-format on
 
 		auto parse_result = options.parse(argc - 1, argv + 1);
 
-		BuildConfig config = ParseBuildConfigFromManifest();
+		BuildConfig config = ParseBuildConfigFromManifest(parse_result.count("profile") ? parse_result["profile"].as<std::string>() : "");
 		if (parse_result.count("help")) {
 			std::cout << options.help() << std::endl;
 			return 0;
@@ -463,6 +2294,9 @@ int main(int argc, char **argv)
 		if (parse_result.count("bin")) {
 			config.bin = std::move(parse_result["bin"].as<std::string>());
 		}
+		if (parse_result.count("affected-since")) {
+			config.affected_since = std::move(parse_result["affected-since"].as<std::string>());
+		}
 		if (parse_result.count("vcpkg")) {
 			config.vcpkg_support = parse_result["vcpkg"].as<bool>();
 		}
@@ -477,12 +2311,19 @@ int main(int argc, char **argv)
 		// target selection options
 		("bin", "Run the specified binary", cxxopts::value<std::string>())
 		("args", "Args passed to binary", cxxopts::value<std::vector<std::string>>())
+		("bench-env", "Run pinned to a cpu, without ASLR and after a warm-up, like cake bench")
+		("cpus", "Pin to these cpus with --bench-env, like 2-3,6", cxxopts::value<std::string>())
+		("counters", "Summarize cycles, instructions, cache misses and more, with wall time and peak RSS")
+		("heap-profile", "Profile the allocations, sampling a stack every this many bytes", cxxopts::value<size_t>()->implicit_value("65536"))
+		("sample-resources", "Sample RSS, cpu, threads, io and context switches every this many milliseconds", cxxopts::value<size_t>()->implicit_value("100"))
+		("allocator", "Run with jemalloc, tcmalloc, mimalloc or the system malloc, built with vcpkg if not installed", cxxopts::value<std::string>())
+		("profile", "Use [profile.<name>] of the manifest", cxxopts::value<std::string>())
 		("help", "Print help information");
 		// clang-format on
 
 		auto parse_result = options.parse(argc - 1, argv + 1);
 
-		BuildConfig build_config = ParseBuildConfigFromManifest();
+		BuildConfig build_config = ParseBuildConfigFromManifest(parse_result.count("profile") ? parse_result["profile"].as<std::string>() : "");
 		RunConfig run_config = ParseRunConfigFromManifest();
 		if (parse_result.count("help")) {
 			std::cout << options.help() << std::endl;
@@ -494,8 +2335,110 @@ int main(int argc, char **argv)
 		if (parse_result.count("args")) {
 			run_config.args = std::move(parse_result["args"].as<std::vector<std::string>>());
 		}
+		if (parse_result.count("bench-env")) {
+			run_config.bench_env = true;
+		}
+		if (parse_result.count("cpus")) {
+			run_config.environment.cpus = parse_result["cpus"].as<std::string>();
+		}
+		if (parse_result.count("counters")) {
+			run_config.counters = true;
+		}
+		if (parse_result.count("heap-profile")) {
+			run_config.heap_profile = parse_result["heap-profile"].as<size_t>();
+		}
+		if (parse_result.count("sample-resources")) {
+			run_config.sample_resources = parse_result["sample-resources"].as<size_t>();
+		}
+		if (parse_result.count("allocator")) {
+			run_config.allocator = parse_result["allocator"].as<std::string>();
+		}
+
+		CakeRun(build_config, run_config, ParseInstallConfigFromManifest(parse_result.count("profile") ? parse_result["profile"].as<std::string>() : ""));
+	} else if (strcmp(mode, "pgo") == 0) {
+		cxxopts::Options options(
+			"cake pgo",
+			"Optimize the package with profiles of a binary running a training workload.");
+		// clang-format off
+		options.add_options()
+		("bin", "Train with the specified binary", cxxopts::value<std::string>())
+		("train", "Args of the training runs, like \"--input data.txt\"", cxxopts::value<std::string>())
+		("runs", "How many times to run the training", cxxopts::value<size_t>())
+		("drift-threshold", "Share of the sources profiled that may change before the profiles are dropped", cxxopts::value<double>())
+		("profile", "Use [profile.<name>] of the manifest, release by default", cxxopts::value<std::string>())
+		("help", "Print help information");
+		// clang-format on
+
+		auto parse_result = options.parse(argc - 1, argv + 1);
+
+		BuildConfig build_config = ParsePgoBuildConfigFromManifest(parse_result.count("profile") ? parse_result["profile"].as<std::string>() : "");
+		PgoConfig pgo_config = ParsePgoConfigFromManifest();
+		if (parse_result.count("help")) {
+			std::cout << options.help() << std::endl;
+			return 0;
+		}
+		if (parse_result.count("bin")) {
+			pgo_config.bin = parse_result["bin"].as<std::string>();
+		}
+		if (parse_result.count("train")) {
+			pgo_config.train = parse_result["train"].as<std::string>();
+		}
+		if (parse_result.count("runs")) {
+			pgo_config.runs = parse_result["runs"].as<size_t>();
+		}
+		if (parse_result.count("drift-threshold")) {
+			pgo_config.drift_threshold = parse_result["drift-threshold"].as<double>();
+		}
+		if (pgo_config.bin.empty()) {
+			logger->Error("No binary to train, pass --bin or set default-run in ", MANIFEST_FILE);
+		}
+		if (pgo_config.runs == 0) {
+			logger->Error("--runs needs at least one training run");
+		}
+
+		CakePgo(build_config, pgo_config);
+	} else if (strcmp(mode, "profile") == 0) {
+		cxxopts::Options options(
+			"cake profile",
+			"Sample a binary of the local package, and show where its time goes.");
+		// clang-format off
+		options.add_options()
+		// target selection options
+		("bin", "Profile the specified binary", cxxopts::value<std::string>())
+		("args", "Args passed to binary, after --", cxxopts::value<std::vector<std::string>>())
+		("frequency", "Samples per second of cpu time", cxxopts::value<int>())
+		("top", "Number of hotspots to print", cxxopts::value<size_t>())
+		("engine", "Sample with perf or perf_event_open, perf when installed by default", cxxopts::value<std::string>())
+		("profile", "Use [profile.<name>] of the manifest", cxxopts::value<std::string>())
+		("help", "Print help information");
+		// clang-format on
+		options.parse_positional({ "args" });
+
+		auto parse_result = options.parse(argc - 1, argv + 1);
+
+		BuildConfig build_config = ParseBuildConfigFromManifest(parse_result.count("profile") ? parse_result["profile"].as<std::string>() : "");
+		ProfileConfig profile_config = ParseProfileConfigFromManifest();
+		if (parse_result.count("help")) {
+			std::cout << options.help() << std::endl;
+			return 0;
+		}
+		if (parse_result.count("bin")) {
+			profile_config.bin = std::move(parse_result["bin"].as<std::string>());
+		}
+		if (parse_result.count("args")) {
+			profile_config.args = std::move(parse_result["args"].as<std::vector<std::string>>());
+		}
+		if (parse_result.count("frequency")) {
+			profile_config.frequency = parse_result["frequency"].as<int>();
+		}
+		if (parse_result.count("top")) {
+			profile_config.top = parse_result["top"].as<size_t>();
+		}
+		if (parse_result.count("engine")) {
+			profile_config.engine = parse_result["engine"].as<std::string>();
+		}
 
-		CakeRun(build_config, run_config);
+		CakeProfile(build_config, profile_config);
 	} else if (strcmp(mode, "debug") == 0) {
 		cxxopts::Options options(
 			"cake debug",
@@ -506,12 +2449,13 @@ int main(int argc, char **argv)
 		("debugger", "Specify the debugger", cxxopts::value<std::string>())
 		("bin", "Debug the specified binary", cxxopts::value<std::string>())
 		("args", "Args passed to binary", cxxopts::value<std::vector<std::string>>())
+		("profile", "Use [profile.<name>] of the manifest", cxxopts::value<std::string>())
 		("help", "Print help information");
 		// clang-format on
 
 		auto parse_result = options.parse(argc - 1, argv + 1);
 
-		BuildConfig build_config = ParseBuildConfigFromManifest();
+		BuildConfig build_config = ParseBuildConfigFromManifest(parse_result.count("profile") ? parse_result["profile"].as<std::string>() : "");
 		DebugConfig debug_config = ParseDebugConfigFromManifest();
 		if (parse_result.count("help")) {
 			std::cout << options.help() << std::endl;
@@ -528,7 +2472,191 @@ int main(int argc, char **argv)
 		}
 
 		CakeDebug(build_config, debug_config);
-	}else if (strcmp(mode, "install") == 0) {
+	} else if (strcmp(mode, "package") == 0) {
+		cxxopts::Options options(
+			"cake package",
+			"Collect the artifacts of the local package into a staging tree or tarball.");
+		// clang-format off
+		options.add_options()
+		// target selection options
+		("lib", "Package the specified library", cxxopts::value<std::vector<std::string>>())
+		("bin", "Package the specified binary", cxxopts::value<std::vector<std::string>>())
+		("output", "Staging directory", cxxopts::value<std::string>())
+		("archive", "Stream the artifacts into a tarball, \"-\" for stdout", cxxopts::value<std::string>())
+		("strip", "Split debug info and strip the artifacts")
+		("jobs", "How many artifacts to strip in parallel", cxxopts::value<size_t>())
+		("profile", "Use [profile.<name>] of the manifest", cxxopts::value<std::string>())
+		("help", "Print help information");
+		// clang-format on
+
+		auto parse_result = options.parse(argc - 1, argv + 1);
+
+		BuildConfig build_config = ParseBuildConfigFromManifest(parse_result.count("profile") ? parse_result["profile"].as<std::string>() : "");
+		PackageConfig package_config;
+		if (parse_result.count("help")) {
+			std::cout << options.help() << std::endl;
+			return 0;
+		}
+		if (parse_result.count("lib")) {
+			package_config.libs = std::move(parse_result["lib"].as<std::vector<std::string>>());
+		}
+		if (parse_result.count("bin")) {
+			package_config.bins = std::move(parse_result["bin"].as<std::vector<std::string>>());
+		}
+		if (parse_result.count("output")) {
+			package_config.output_directory = std::move(parse_result["output"].as<std::string>());
+		}
+		if (parse_result.count("archive")) {
+			package_config.archive = std::move(parse_result["archive"].as<std::string>());
+		}
+		if (parse_result.count("strip")) {
+			package_config.strip = true;
+		}
+		if (parse_result.count("jobs")) {
+			package_config.jobs = parse_result["jobs"].as<size_t>();
+		}
+
+		CakePackage(build_config, package_config);
+	} else if (strcmp(mode, "test") == 0) {
+		cxxopts::Options options(
+			"cake test",
+			"Run the tests of the local package in parallel.");
+		// clang-format off
+		options.add_options()
+		("filter", "Only run the tests whose name matches the regex", cxxopts::value<std::string>())
+		("jobs", "How many tests run at the same time", cxxopts::value<size_t>())
+		("timeout", "Timeout of the tests without a TIMEOUT property, in seconds", cxxopts::value<double>())
+		("shard-within", "Split GoogleTest and Catch2 executables into --shard-within=N processes", cxxopts::value<size_t>()->implicit_value("0"))
+		("no-cache", "Run the tests that passed with the same inputs before")
+		("affected-since", "Only run the tests affected by changes since the revision", cxxopts::value<std::string>())
+		("fork-server", "Fork the tests of executables using the fork server shim from one initialized process")
+		("profile", "Use [profile.<name>] of the manifest", cxxopts::value<std::string>())
+		("help", "Print help information");
+		// clang-format on
+
+		auto parse_result = options.parse(argc - 1, argv + 1);
+
+		BuildConfig build_config = ParseBuildConfigFromManifest(parse_result.count("profile") ? parse_result["profile"].as<std::string>() : "");
+		TestConfig test_config = ParseTestConfigFromManifest();
+		if (parse_result.count("help")) {
+			std::cout << options.help() << std::endl;
+			return 0;
+		}
+		if (parse_result.count("filter")) {
+			test_config.regex = std::move(parse_result["filter"].as<std::string>());
+		}
+		if (parse_result.count("jobs")) {
+			test_config.jobs = parse_result["jobs"].as<size_t>();
+		}
+		if (parse_result.count("timeout")) {
+			test_config.timeout = parse_result["timeout"].as<double>();
+		}
+		if (parse_result.count("shard-within")) {
+			test_config.shard_within = true;
+			test_config.shards = parse_result["shard-within"].as<size_t>();
+		}
+		if (parse_result.count("no-cache")) {
+			test_config.no_cache = true;
+		}
+		if (parse_result.count("affected-since")) {
+			test_config.affected_since = std::move(parse_result["affected-since"].as<std::string>());
+		}
+		if (parse_result.count("fork-server")) {
+			test_config.fork_server = true;
+		}
+
+		CakeTest(build_config, test_config);
+	} else if (strcmp(mode, "bench") == 0) {
+		cxxopts::Options options(
+			"cake bench",
+			"Build the benchmarks of the local package in Release, run them and record the results.");
+		// clang-format off
+		options.add_options()
+		("bin", "Only run the specified benchmark targets", cxxopts::value<std::vector<std::string>>())
+		("filter", "Only run the benchmarks matching the regex", cxxopts::value<std::string>())
+		("args", "Args passed to the benchmarks", cxxopts::value<std::vector<std::string>>())
+		("report", "Summarize the recorded results over time")
+		("repetitions", "Run each benchmark this many times, 10 with a baseline", cxxopts::value<size_t>())
+		("save-baseline", "Record the results as the named baseline", cxxopts::value<std::string>())
+		("baseline", "Compare the results with the named baseline", cxxopts::value<std::string>())
+		("check", "Fail if a benchmark is significantly slower than the baseline, or the first revision compared")
+		("compare", "Build two git revisions and compare their benchmarks, run interleaved", cxxopts::value<std::vector<std::string>>())
+		("jobs", "How many build jobs the revisions compared share", cxxopts::value<size_t>())
+		("cpus", "Pin the benchmarks to these cpus, like 2-3,6", cxxopts::value<std::string>())
+		("instructions", "Also count the instructions per iteration with cachegrind or perf, they gate --check", cxxopts::value<std::string>()->implicit_value("auto"))
+		("allocators", "Run the benchmarks with each allocator, like system,jemalloc,mimalloc, and compare time and memory", cxxopts::value<std::vector<std::string>>())
+		("profile", "Use [profile.<name>] of the manifest, bench by default", cxxopts::value<std::string>())
+		("help", "Print help information");
+		// clang-format on
+
+		// `--compare <revA> <revB>`
+		options.parse_positional({ "compare" });
+		auto parse_result = options.parse(argc - 1, argv + 1);
+
+		BuildConfig build_config = ParseBenchBuildConfigFromManifest(parse_result.count("profile") ? parse_result["profile"].as<std::string>() : "");
+		BenchConfig bench_config = ParseBenchConfigFromManifest();
+		if (parse_result.count("help")) {
+			std::cout << options.help() << std::endl;
+			return 0;
+		}
+		if (parse_result.count("bin")) {
+			bench_config.bins = std::move(parse_result["bin"].as<std::vector<std::string>>());
+		}
+		if (parse_result.count("filter")) {
+			bench_config.filter = std::move(parse_result["filter"].as<std::string>());
+		}
+		if (parse_result.count("args")) {
+			bench_config.args = std::move(parse_result["args"].as<std::vector<std::string>>());
+		}
+		if (parse_result.count("report")) {
+			bench_config.report = true;
+		}
+		if (parse_result.count("repetitions")) {
+			bench_config.repetitions = parse_result["repetitions"].as<size_t>();
+		}
+		if (parse_result.count("save-baseline")) {
+			bench_config.save_baseline = parse_result["save-baseline"].as<std::string>();
+		}
+		if (parse_result.count("compare")) {
+			bench_config.compare = parse_result["compare"].as<std::vector<std::string>>();
+			if (bench_config.compare.size() != 2) {
+				logger->Error("--compare needs two git revisions, like cake bench --compare main HEAD");
+			}
+		}
+		if (parse_result.count("jobs")) {
+			bench_config.jobs = parse_result["jobs"].as<size_t>();
+		}
+		if (parse_result.count("cpus")) {
+			bench_config.environment.cpus = parse_result["cpus"].as<std::string>();
+		}
+		if (parse_result.count("instructions")) {
+			bench_config.instructions = parse_result["instructions"].as<std::string>();
+			if (bench_config.instructions != "auto" && bench_config.instructions != "cachegrind" && bench_config.instructions != "perf") {
+				logger->Error("Unknown instruction counter ", bench_config.instructions, ", expected cachegrind or perf");
+			}
+		}
+		if (parse_result.count("baseline")) {
+			bench_config.baseline = parse_result["baseline"].as<std::string>();
+		} else if (!parse_result.count("check")) {
+			// [bench] baseline is the one --check compares with
+			bench_config.baseline.clear();
+		}
+		if (parse_result.count("check")) {
+			bench_config.check = true;
+			if (bench_config.baseline.empty() && bench_config.compare.empty()) {
+				logger->Error("--check needs a baseline, pass --baseline or set [bench] baseline in ", MANIFEST_FILE);
+			}
+		}
+
+		if (parse_result.count("allocators")) {
+			bench_config.allocators = parse_result["allocators"].as<std::vector<std::string>>();
+			if (!bench_config.compare.empty() || !bench_config.baseline.empty() || !bench_config.save_baseline.empty()) {
+				logger->Error("--allocators compares allocators, not revisions or baselines");
+			}
+		}
+
+		CakeBench(build_config, bench_config, ParseInstallConfigFromManifest(parse_result.count("profile") ? parse_result["profile"].as<std::string>() : ""));
+	} else if (strcmp(mode, "install") == 0) {
 		cxxopts::Options options(
 			"cake install",
 			"Install a library using vcpkg.");
@@ -536,14 +2664,17 @@ int main(int argc, char **argv)
 		options.add_options()
 		("port", "Add port to vcpkg.json", cxxopts::value<std::string>())
 		("sync", "Install all libraries in vcpkg.json")
+		("cache-stats", "Report ports restored from and built into the binary cache")
+		("force", "Run vcpkg install even if nothing changed since the last install")
 		// common options
 		("config", "Set configuration value", cxxopts::value<std::vector<std::string>>())
+		("profile", "Use [profile.<name>] of the manifest", cxxopts::value<std::string>())
 		("help", "Print help information");
 		// clang-format on
 
 		auto parse_result = options.parse(argc - 1, argv + 1);
 
-		InstallConfig install_config = ParseInstallConfigFromManifest();
+		InstallConfig install_config = ParseInstallConfigFromManifest(parse_result.count("profile") ? parse_result["profile"].as<std::string>() : "");
 		if (parse_result.count("help")) {
 			std::cout << options.help() << std::endl;
 			return 0;
@@ -554,6 +2685,12 @@ int main(int argc, char **argv)
 		if (parse_result.count("sync")) {
 			install_config.sync = true;
 		}
+		if (parse_result.count("cache-stats")) {
+			install_config.cache_stats = true;
+		}
+		if (parse_result.count("force")) {
+			install_config.force = true;
+		}
 		if (parse_result.count("config")) {
 			install_config.options = std::move(parse_result["config"].as<std::vector<std::string>>());
 		}
@@ -567,6 +2704,7 @@ int main(int argc, char **argv)
 		options.add_options()
 		("template", "Specify template type", cxxopts::value<std::string>())
 		("name", "Specify project name", cxxopts::value<std::string>())
+		("from-remote", "Fetch the template from the cake repository instead of the embedded one")
 		// common options
 		("config", "Set configuration value", cxxopts::value<std::vector<std::string>>())
 		("help", "Print help information");
@@ -585,6 +2723,9 @@ int main(int argc, char **argv)
 		if (parse_result.count("name")) {
 			create_config.name = std::move(parse_result["name"].as<std::string>());
 		}
+		if (parse_result.count("from-remote")) {
+			create_config.from_remote = true;
+		}
 
 		CakeCreate(create_config);
 	} else if (strcmp(mode, "docs") == 0) {
@@ -0,0 +1,71 @@
+#include "cmake/ctest.h"
+
+#include "utility/common.h"
+
+std::vector<std::string> ListAllTests(const std::string &build_directory)
+{
+	std::vector<std::string> names;
+	for (const TestCase &test : ResolveTests(build_directory)) {
+		names.push_back(test.name);
+	}
+	return names;
+}
+
+static
+void ResolveTestProperty(const nlohmann::json &property, TestCase &test)
+{
+	const std::string &name = property["name"];
+	const nlohmann::json &value = property["value"];
+	if (name == "WORKING_DIRECTORY") {
+		test.working_directory = value;
+	} else if (name == "ENVIRONMENT") {
+		test.environment = value.get<std::vector<std::string>>();
+	} else if (name == "REQUIRED_FILES") {
+		test.required_files = value.get<std::vector<std::string>>();
+	} else if (name == "TIMEOUT") {
+		test.timeout = value.get<double>();
+	} else if (name == "PROCESSORS") {
+		test.processors = std::max(1, value.get<int>());
+	} else if (name == "WILL_FAIL") {
+		test.will_fail = value.get<bool>();
+	} else if (name == "DISABLED") {
+		test.disabled = value.get<bool>();
+	} else if (name == "RUN_SERIAL") {
+		test.run_serial = value.get<bool>();
+	}
+}
+
+std::vector<TestCase> ResolveTests(const std::string &build_directory)
+{
+	using nlohmann::json;
+
+	std::vector<TestCase> tests;
+	std::string output;
+	if (!RunCmdCapture(CTEST_COMMAND, { CTEST_COMMAND, "--test-dir", build_directory, "--show-only=json-v1" }, output)) {
+		logger->Warning("Could not list the tests of ", build_directory);
+		return tests;
+	}
+
+	json info = json::parse(output, nullptr, false);
+	if (info.is_discarded() || !info.contains("tests")) {
+		logger->Warning("Could not parse the test list of ", build_directory);
+		return tests;
+	}
+
+	for (const json &item : info["tests"]) {
+		TestCase test;
+		test.name = item["name"];
+		// tests of other configurations have no command
+		if (item.contains("command")) {
+			test.command = item["command"].get<std::vector<std::string>>();
+		}
+		if (item.contains("properties")) {
+			for (const json &property : item["properties"]) {
+				ResolveTestProperty(property, test);
+			}
+		}
+		tests.push_back(test);
+	}
+
+	return tests;
+}
@@ -67,3 +67,15 @@ Target ResolveTargetFile(const std::string &build_directory, const std::string &
 		build_directory + "/" + CMAKE_FILE_API + "/" + REPLY + "/" + target_json_file;
 	return json::parse(std::ifstream(filepath));
 }
+
+std::string CMakeCacheValue(const std::string &build_directory, const std::string &key)
+{
+	std::ifstream cache(build_directory + "/CMakeCache.txt");
+	std::string line;
+	while (std::getline(cache, line)) {
+		if (line.compare(0, key.size() + 1, key + ":") == 0) {
+			return line.substr(line.find('=') + 1);
+		}
+	}
+	return "";
+}
@@ -0,0 +1,277 @@
+#include "cmake/target_graph.h"
+
+#include <filesystem>
+#include <fstream>
+#include <queue>
+#include <sstream>
+
+#include "utility/common.h"
+
+namespace fs = std::filesystem;
+
+/// Normalize `path` (relative to `base` if not absolute) to a path relative
+/// to `root`. Paths outside of `root` stay absolute.
+static
+std::string NormalizePath(const std::string &path, const fs::path &base, const fs::path &root)
+{
+	fs::path p(path);
+	if (p.is_relative()) {
+		p = base / p;
+	}
+	std::error_code ec;
+	fs::path canonical = fs::weakly_canonical(p, ec);
+	if (ec) {
+		canonical = p.lexically_normal();
+	}
+
+	fs::path relative = canonical.lexically_relative(root);
+	if (relative.empty() || *relative.begin() == "..") {
+		return canonical.string();
+	}
+	return relative.string();
+}
+
+/// `CMakeFiles/<name>.dir/...` -> `<name>`
+static
+std::string TargetNameOfObject(const std::string &path, std::string *object_base = nullptr)
+{
+	static const std::string marker = "CMakeFiles/";
+	size_t begin = path.find(marker);
+	if (begin == std::string::npos) {
+		return "";
+	}
+	size_t name_begin = begin + marker.size();
+	size_t end = path.find(".dir/", name_begin);
+	if (end == std::string::npos) {
+		return "";
+	}
+	if (object_base) {
+		*object_base = path.substr(0, begin);
+	}
+	return path.substr(name_begin, end - name_begin);
+}
+
+std::vector<std::string> ParseDependencyFile(const std::string &content)
+{
+	std::vector<std::string> deps;
+	std::string token;
+	auto flush = [&deps, &token]() {
+		if (!token.empty()) {
+			if (token.back() != ':') {
+				deps.push_back(token);
+			}
+			token.clear();
+		}
+	};
+
+	for (size_t i = 0; i < content.size(); ++i) {
+		char c = content[i];
+		if (c == '\\' && i + 1 < content.size()) {
+			char next = content[i + 1];
+			if (next == '\n' || next == '\r') { // line continuation
+				flush();
+				++i;
+				continue;
+			}
+			if (next == ' ' || next == '#' || next == '\\') {
+				token += next;
+				++i;
+				continue;
+			}
+		}
+		if (c == '#' && token.empty()) { // comment
+			flush();
+			while (i < content.size() && content[i] != '\n') {
+				++i;
+			}
+			continue;
+		}
+		if (c == '$' && i + 1 < content.size() && content[i + 1] == '$') {
+			token += '$';
+			++i;
+			continue;
+		}
+		if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+			flush();
+			continue;
+		}
+		token += c;
+	}
+	flush();
+
+	return deps;
+}
+
+/// Compiler dependency files left by the Makefile generator, either as is or
+/// consolidated into `compiler_depend.make`.
+static
+void ResolveMakefileDependencies(const fs::path &build_root, const fs::path &root, TargetGraph &graph)
+{
+	std::error_code ec;
+	for (fs::recursive_directory_iterator it(build_root, fs::directory_options::skip_permission_denied, ec), end; it != end; it.increment(ec)) {
+		if (ec) {
+			break;
+		}
+		if (!it->is_regular_file()) {
+			continue;
+		}
+		if (it->path().extension() != ".d" && it->path().filename() != "compiler_depend.make") {
+			continue;
+		}
+
+		std::string object_base;
+		std::string target = TargetNameOfObject(it->path().string(), &object_base);
+		if (target.empty()) {
+			continue;
+		}
+
+		std::ifstream input(it->path());
+		std::stringstream content;
+		content << input.rdbuf();
+		for (const std::string &dep : ParseDependencyFile(content.str())) {
+			graph.includers[NormalizePath(dep, object_base, root)].insert(target);
+		}
+	}
+}
+
+/// Dependencies recorded by ninja in `.ninja_deps`.
+static
+void ResolveNinjaDependencies(const fs::path &build_root, const fs::path &root, TargetGraph &graph)
+{
+	std::string output;
+	if (!RunCmdCapture("ninja", { "ninja", "-C", build_root.string(), "-t", "deps" }, output)) {
+		logger->Warning("Could not read ninja dependencies of ", build_root.string());
+		return;
+	}
+
+	std::stringstream ss(output);
+	std::string line;
+	std::string target;
+	while (std::getline(ss, line)) {
+		if (line.empty()) {
+			continue;
+		}
+		if (line[0] != ' ' && line[0] != '\t') {
+			target = TargetNameOfObject(line.substr(0, line.find(':')));
+			continue;
+		}
+		if (target.empty()) {
+			continue;
+		}
+		size_t begin = line.find_first_not_of(" \t");
+		graph.includers[NormalizePath(line.substr(begin), build_root, root)].insert(target);
+	}
+}
+
+TargetGraph ResolveTargetGraph(const std::string &source_directory, const std::string &build_directory, const std::unordered_map<std::string, Target> &targets)
+{
+	TargetGraph graph;
+
+	fs::path root = fs::weakly_canonical(fs::absolute(source_directory));
+	fs::path build_root = fs::weakly_canonical(fs::absolute(build_directory));
+
+	std::unordered_map<std::string, std::string> names; // id -> name
+	for (const auto &item : targets) {
+		names[item.second["id"].get<std::string>()] = item.first;
+	}
+
+	for (const auto &item : targets) {
+		const Target &target = item.second;
+		if (target.contains("sources")) {
+			for (const auto &source : target["sources"]) {
+				std::string path = source["path"].get<std::string>();
+				graph.owners[NormalizePath(path, root, root)].insert(item.first);
+			}
+		}
+		if (target.contains("dependencies")) {
+			for (const auto &dependency : target["dependencies"]) {
+				auto it = names.find(dependency["id"].get<std::string>());
+				if (it != names.end()) {
+					graph.dependents[it->second].insert(item.first);
+				}
+			}
+		}
+	}
+
+	if (fs::exists(build_root / ".ninja_deps")) {
+		ResolveNinjaDependencies(build_root, root, graph);
+	}
+	ResolveMakefileDependencies(build_root, root, graph);
+
+	return graph;
+}
+
+static
+bool IsBuildSystemFile(const std::string &file)
+{
+	fs::path path(file);
+	std::string filename = path.filename().string();
+	return filename == "CMakeLists.txt" ||
+		filename == "CMakePresets.json" ||
+		filename == "Cake.toml" ||
+		filename == "vcpkg.json" ||
+		path.extension() == ".cmake";
+}
+
+bool IsDocumentationFile(const std::string &file)
+{
+	fs::path path(file);
+	std::string filename = path.filename().string();
+	std::string extension = path.extension().string();
+	return extension == ".md" ||
+		extension == ".rst" ||
+		extension == ".adoc" ||
+		filename.rfind("LICENSE", 0) == 0 ||
+		filename.rfind("COPYING", 0) == 0 ||
+		filename == ".gitignore" ||
+		filename == ".gitattributes" ||
+		filename == ".clang-format" ||
+		filename == ".clang-tidy" ||
+		filename == ".editorconfig";
+}
+
+AffectedTargets ResolveAffectedTargets(const TargetGraph &graph, const std::vector<std::string> &changed_files)
+{
+	AffectedTargets affected;
+
+	std::queue<std::string> pending;
+	auto mark = [&affected, &pending](const std::set<std::string> &targets) {
+		for (const std::string &target : targets) {
+			if (affected.targets.insert(target).second) {
+				pending.push(target);
+			}
+		}
+	};
+
+	for (const std::string &file : changed_files) {
+		std::string path = fs::path(file).lexically_normal().string();
+		if (IsBuildSystemFile(path)) {
+			affected.all = true;
+		}
+
+		auto owner = graph.owners.find(path);
+		auto includer = graph.includers.find(path);
+		if (owner != graph.owners.end()) {
+			mark(owner->second);
+		}
+		if (includer != graph.includers.end()) {
+			mark(includer->second);
+		}
+		if (owner == graph.owners.end() && includer == graph.includers.end()) {
+			affected.unattributed.push_back(path);
+		}
+	}
+
+	// expand to reverse dependencies
+	while (!pending.empty()) {
+		std::string target = pending.front();
+		pending.pop();
+
+		auto it = graph.dependents.find(target);
+		if (it != graph.dependents.end()) {
+			mark(it->second);
+		}
+	}
+
+	return affected;
+}
@@ -0,0 +1,40 @@
+# Generate a C++ source embedding the project templates into cake.
+#
+# cmake -DTEMPLATE_DIRECTORY=<template> -DOUTPUT=<file.cc> [-DFUNCTION=<name>] -P embed_templates.cmake
+#
+# FUNCTION names the generated accessor, EmbeddedTemplateFiles by default.
+
+if(NOT FUNCTION)
+	set(FUNCTION EmbeddedTemplateFiles)
+endif()
+
+file(GLOB_RECURSE template_files LIST_DIRECTORIES false RELATIVE ${TEMPLATE_DIRECTORY} ${TEMPLATE_DIRECTORY}/*)
+list(SORT template_files)
+# ignored by the templates themselves
+list(FILTER template_files EXCLUDE REGEX "/packages/(other_packages|vcpkg_packages)/")
+
+set(content "// Generated by embed_templates.cmake, do not edit.\n\n#include \"create/template.h\"\n\n")
+set(entries "")
+set(index 0)
+foreach(template_file ${template_files})
+	file(READ ${TEMPLATE_DIRECTORY}/${template_file} hex HEX)
+	string(LENGTH "${hex}" hex_length)
+	math(EXPR size "${hex_length} / 2")
+	string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+	string(REGEX REPLACE "(0x[0-9a-f][0-9a-f],0x[0-9a-f][0-9a-f],0x[0-9a-f][0-9a-f],0x[0-9a-f][0-9a-f],0x[0-9a-f][0-9a-f],0x[0-9a-f][0-9a-f],0x[0-9a-f][0-9a-f],0x[0-9a-f][0-9a-f],0x[0-9a-f][0-9a-f],0x[0-9a-f][0-9a-f],0x[0-9a-f][0-9a-f],0x[0-9a-f][0-9a-f],0x[0-9a-f][0-9a-f],0x[0-9a-f][0-9a-f],0x[0-9a-f][0-9a-f],0x[0-9a-f][0-9a-f])" "\\1\n\t" bytes "${bytes}")
+	# a trailing 0 keeps empty files valid
+	string(APPEND content "static const unsigned char file_${index}[] = {\n\t${bytes}0x00\n};\n\n")
+	string(APPEND entries "\t\t{ \"${template_file}\", file_${index}, ${size} },\n")
+	math(EXPR index "${index} + 1")
+endforeach()
+
+string(APPEND content "const std::vector<EmbeddedFile> &${FUNCTION}()\n{\n\tstatic const std::vector<EmbeddedFile> files = {\n${entries}\t};\n\treturn files;\n}\n")
+
+# keep the timestamp when nothing changed
+if(EXISTS ${OUTPUT})
+	file(READ ${OUTPUT} previous)
+	if(previous STREQUAL content)
+		return()
+	endif()
+endif()
+file(WRITE ${OUTPUT} "${content}")
@@ -0,0 +1,117 @@
+#include "create/template.h"
+
+#include <filesystem>
+#include <fstream>
+#include <regex>
+#include <set>
+
+#include "utility/common.h"
+
+namespace fs = std::filesystem;
+
+/// Where the project name goes in a template.
+struct TemplateVariable {
+	const char *file; ///< file name the rule applies to
+	const char *pattern; ///< the first group is replaced by the project name
+};
+
+static const TemplateVariable template_variables[] = {
+	{ "CMakeLists.txt", "^project\\(([^) ]+)" },
+	{ "Cake.toml", "^name = \"([^\"]*)\"" },
+	{ "Doxyfile", "^PROJECT_NAME +=[ ]+\"([^\"]*)\"" },
+};
+
+void SubstituteTemplateVariables(const std::string &path, const std::string &project_name, std::string &content)
+{
+	std::string filename = fs::path(path).filename().string();
+	// only the top-level CMakeLists.txt declares the project
+	if (filename == "CMakeLists.txt" && fs::path(path).has_parent_path()) {
+		return;
+	}
+
+	for (const TemplateVariable &variable : template_variables) {
+		if (filename != variable.file) {
+			continue;
+		}
+		// patterns are anchored at the beginning of a line
+		std::regex pattern(variable.pattern);
+		for (size_t begin = 0; begin < content.size();) {
+			size_t end = content.find('\n', begin);
+			if (end == std::string::npos) {
+				end = content.size();
+			}
+			std::smatch match;
+			std::string line = content.substr(begin, end - begin);
+			if (std::regex_search(line, match, pattern)) {
+				content.replace(begin + match.position(1), match.length(1), project_name);
+				break;
+			}
+			begin = end + 1;
+		}
+	}
+}
+
+std::vector<std::string> EmbeddedTemplateTypes()
+{
+	std::set<std::string> types;
+	for (const EmbeddedFile &file : EmbeddedTemplateFiles()) {
+		std::string path = file.path;
+		types.insert(path.substr(0, path.find('/')));
+	}
+	return std::vector<std::string>(types.begin(), types.end());
+}
+
+bool WriteEmbeddedTemplate(const std::string &type, const std::string &directory, const std::string &project_name)
+{
+	std::string prefix = type + "/";
+	size_t count = 0;
+	for (const EmbeddedFile &file : EmbeddedTemplateFiles()) {
+		std::string path = file.path;
+		if (path.compare(0, prefix.size(), prefix) != 0) {
+			continue;
+		}
+
+		std::string relative = path.substr(prefix.size());
+		std::string content((const char *)file.data, file.size);
+		SubstituteTemplateVariables(relative, project_name, content);
+
+		fs::path output = fs::path(directory) / relative;
+		MakeDirectory(output.parent_path().string());
+		std::ofstream stream(output, std::ios::binary);
+		stream << content;
+		if (!stream) {
+			logger->Warning("Could not write ", output.string());
+			return false;
+		}
+		count++;
+	}
+
+	return count > 0;
+}
+
+bool SubstituteTemplateDirectory(const std::string &directory, const std::string &project_name)
+{
+	std::error_code ec;
+	for (fs::recursive_directory_iterator it(directory, ec), end; it != end; it.increment(ec)) {
+		if (ec) {
+			return false;
+		}
+		if (it->is_directory() && it->path().filename() == ".git") {
+			it.disable_recursion_pending();
+			continue;
+		}
+		if (!it->is_regular_file()) {
+			continue;
+		}
+
+		std::string relative = it->path().lexically_relative(directory).string();
+		std::string content;
+		ReadFileContent(it->path().string(), content);
+		std::string substituted = content;
+		SubstituteTemplateVariables(relative, project_name, substituted);
+		if (substituted != content) {
+			std::ofstream(it->path(), std::ios::binary) << substituted;
+		}
+	}
+	return true;
+}
@@ -11,35 +11,123 @@ Manifest ParseManifest()
 }
 
 
-BuildConfig ParseBuildConfigFromManifest()
+/// `[profile.<name>]` overrides `[profile]`.
+static
+toml::node_view<toml::node> ProfileValue(Manifest &manifest, const std::string &profile, const std::string &key)
+{
+	if (!profile.empty() && manifest["profile"][profile][key]) {
+		return manifest["profile"][profile][key];
+	}
+	return manifest["profile"][key];
+}
+
+static
+TripletConfig ParseTripletConfig(Manifest &manifest, const std::string &profile)
+{
+	TripletConfig config;
+
+	config.profile = profile;
+	config.base = ProfileValue(manifest, profile, "vcpkg-triplet").value_or("");
+	config.release_only = ProfileValue(manifest, profile, "dependencies-release-only").value_or(false);
+	config.lto = ProfileValue(manifest, profile, "lto").value_or(false);
+	config.march = ProfileValue(manifest, profile, "march").value_or("");
+
+	return config;
+}
+
+static
+BuildConfig ParseBuildConfig(Manifest &manifest, const std::string &profile)
 {
-	Manifest manifest = ParseManifest();
 	BuildConfig config;
 
-	bool vcpkg_support = manifest["profile"]["vcpkg"].value_or(false);
+	config.profile = profile;
+
+	bool vcpkg_support = ProfileValue(manifest, profile, "vcpkg").value_or(false);
 	config.vcpkg_support = vcpkg_support;
 
-	bool generate_compile_commands = manifest["profile"]["compile_commands"].value_or(false);
+	bool generate_compile_commands = ProfileValue(manifest, profile, "compile_commands").value_or(false);
 	config.options.push_back("CMAKE_EXPORT_COMPILE_COMMANDS=1");
 
-	std::string c_compiler = manifest["profile"]["c_compiler"].value_or("gcc");
+	std::string c_compiler = ProfileValue(manifest, profile, "c_compiler").value_or("gcc");
 	config.options.push_back("CMAKE_C_COMPILER:FILEPATH=" + c_compiler);
 
-	std::string cxx_compiler = manifest["profile"]["cxx_compiler"].value_or("g++");
+	std::string cxx_compiler = ProfileValue(manifest, profile, "cxx_compiler").value_or("g++");
 	config.options.push_back("CMAKE_CXX_COMPILER:FILEPATH=" + cxx_compiler);
 
-	std::string linker = manifest["profile"]["linker"].value_or("ld");
+	std::string linker = ProfileValue(manifest, profile, "linker").value_or("ld");
 	config.options.push_back("CMAKE_LINKER=" + linker);
 
-	std::string build_type = manifest["profile"]["build-type"].value_or("Debug");
+	std::string build_type = ProfileValue(manifest, profile, "build-type").value_or("Debug");
 	config.options.push_back("CMAKE_BUILD_TYPE=" + build_type);
 
-	std::string build_directory = manifest["profile"]["build-directory"].value_or("out/debug");
+	// profiles never share a build directory
+	std::string build_directory = profile.empty() ?
+		manifest["profile"]["build-directory"].value_or("out/debug") :
+		manifest["profile"][profile]["build-directory"].value_or("out/" + profile);
 	config.build_directory = build_directory;
 
-	std::string generator = manifest["profile"]["generator"].value_or("Ninja");
+	std::string generator = ProfileValue(manifest, profile, "generator").value_or("Ninja");
 	config.generator = generator;
 
+	config.triplet = ParseTripletConfig(manifest, profile);
+
+	config.module_cache = ProfileValue(manifest, profile, "module-cache").value_or(false);
+
+	return config;
+}
+
+BuildConfig ParseBuildConfigFromManifest(const std::string &profile)
+{
+	Manifest manifest = ParseManifest();
+
+	if (!profile.empty() && !manifest["profile"][profile].is_table()) {
+		logger->Warning("Profile ", profile, " is not defined in ", MANIFEST_FILE, ", using [profile]");
+	}
+	return ParseBuildConfig(manifest, profile);
+}
+
+/// `[profile.<name>]`, built in Release unless it sets its own `build-type`.
+static
+BuildConfig ParseReleaseBuildConfig(Manifest &manifest, const std::string &profile, const std::string &name)
+{
+	if (!profile.empty() && !manifest["profile"][profile].is_table()) {
+		logger->Warning("Profile ", profile, " is not defined in ", MANIFEST_FILE, ", using [profile]");
+	}
+	BuildConfig config = ParseBuildConfig(manifest, name);
+
+	// [profile] builds for debugging, benchmarks and PGO want optimized code
+	std::string build_type = manifest["profile"][name]["build-type"].value_or("Release");
+	for (std::string &option : config.options) {
+		if (option.rfind("CMAKE_BUILD_TYPE=", 0) == 0) {
+			option = "CMAKE_BUILD_TYPE=" + build_type;
+		}
+	}
+
+	return config;
+}
+
+BuildConfig ParseBenchBuildConfigFromManifest(const std::string &profile)
+{
+	Manifest manifest = ParseManifest();
+	return ParseReleaseBuildConfig(manifest, profile, profile.empty() ? "bench" : profile);
+}
+
+BuildConfig ParsePgoBuildConfigFromManifest(const std::string &profile)
+{
+	Manifest manifest = ParseManifest();
+	return ParseReleaseBuildConfig(manifest, profile, profile.empty() ? "release" : profile);
+}
+
+/// `[bench]` settings of the processes measured.
+static
+BenchEnvironmentConfig ParseBenchEnvironment(Manifest &manifest)
+{
+	BenchEnvironmentConfig config;
+
+	config.cpus = manifest["bench"]["cpus"].value_or("");
+	config.disable_aslr = !manifest["bench"]["aslr"].value_or(false);
+	config.warmup = manifest["bench"]["warmup"].value_or(config.warmup);
+
 	return config;
 }
 
@@ -49,6 +137,7 @@ RunConfig ParseRunConfigFromManifest()
 	RunConfig config;
 
 	config.bin = manifest["package"]["default-run"].value_or("");
+	config.environment = ParseBenchEnvironment(manifest);
 
 	return config;
 }
@@ -64,13 +153,95 @@ DebugConfig ParseDebugConfigFromManifest()
 	return config;
 }
 
-InstallConfig ParseInstallConfigFromManifest()
+InstallConfig ParseInstallConfigFromManifest(const std::string &profile)
 {
 	Manifest manifest = ParseManifest();
 	InstallConfig config;
 
-	bool vcpkg_support = manifest["profile"]["vcpkg"].value_or(false);
+	bool vcpkg_support = ProfileValue(manifest, profile, "vcpkg").value_or(false);
 	config.vcpkg_support = vcpkg_support;
 
+	config.triplet = ParseTripletConfig(manifest, profile);
+
+	config.binary_cache = manifest["vcpkg"]["binary-cache"].value_or(true);
+	config.binary_cache_directory = manifest["vcpkg"]["binary-cache-directory"].value_or(UserCacheDirectory() + "/vcpkg-archives");
+	config.binary_cache_max_size = manifest["vcpkg"]["binary-cache-max-size"].value_or(config.binary_cache_max_size);
+	config.shared_store = manifest["vcpkg"]["shared-store"].value_or(false);
+	config.store_directory = manifest["vcpkg"]["store-directory"].value_or(UserCacheDirectory() + "/vcpkg-store");
+
+	return config;
+}
+
+TestConfig ParseTestConfigFromManifest()
+{
+	Manifest manifest = ParseManifest();
+	TestConfig config;
+
+	config.jobs = manifest["test"]["jobs"].value_or(0);
+	config.timeout = manifest["test"]["timeout"].value_or(0.0);
+	if (toml::array *variables = manifest["test"]["cache-environment"].as_array()) {
+		for (toml::node &variable : *variables) {
+			if (std::optional<std::string> name = variable.value<std::string>()) {
+				config.cache_environment.push_back(*name);
+			}
+		}
+	}
+
+	return config;
+}
+
+BenchConfig ParseBenchConfigFromManifest()
+{
+	Manifest manifest = ParseManifest();
+	BenchConfig config;
+
+	if (toml::array *targets = manifest["bench"]["targets"].as_array()) {
+		for (toml::node &target : *targets) {
+			if (std::optional<std::string> name = target.value<std::string>()) {
+				config.targets.push_back(*name);
+			}
+		}
+	}
+	config.repetitions = manifest["bench"]["repetitions"].value_or(0);
+	config.baseline = manifest["bench"]["baseline"].value_or("");
+	config.threshold = manifest["bench"]["threshold"].value_or(config.threshold);
+	config.alpha = manifest["bench"]["alpha"].value_or(config.alpha);
+	config.environment = ParseBenchEnvironment(manifest);
+	config.instruction_threshold = manifest["bench"]["instruction-threshold"].value_or(config.instruction_threshold);
+	if (toml::table *thresholds = manifest["bench"]["thresholds"].as_table()) {
+		for (auto &item : *thresholds) {
+			if (std::optional<double> threshold = item.second.value<double>()) {
+				config.thresholds.push_back({ std::string(item.first.str()), *threshold });
+			}
+		}
+	}
+
+	return config;
+}
+
+ProfileConfig ParseProfileConfigFromManifest()
+{
+	Manifest manifest = ParseManifest();
+	ProfileConfig config;
+
+	// `[profile]` is the build
+	config.bin = manifest["package"]["default-run"].value_or("");
+	config.frequency = manifest["profiler"]["frequency"].value_or(config.frequency);
+	config.top = manifest["profiler"]["top"].value_or(config.top);
+	config.engine = manifest["profiler"]["engine"].value_or(config.engine);
+
+	return config;
+}
+
+PgoConfig ParsePgoConfigFromManifest()
+{
+	Manifest manifest = ParseManifest();
+	PgoConfig config;
+
+	config.bin = manifest["package"]["default-run"].value_or("");
+	config.train = manifest["pgo"]["train"].value_or("");
+	config.runs = manifest["pgo"]["runs"].value_or(config.runs);
+	config.drift_threshold = manifest["pgo"]["drift-threshold"].value_or(config.drift_threshold);
+
 	return config;
 }
@@ -0,0 +1,805 @@
+#include "module/module_cache.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <poll.h>
+#include <regex>
+#include <sstream>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "cmake/target_graph.h"
+#include "package/package.h"
+#include "utility/common.h"
+
+namespace fs = std::filesystem;
+
+#define BUILD_DIRECTORY_PLACEHOLDER "@CAKE_BUILD_DIRECTORY@"
+#define MODULE_CACHE_MANIFEST "manifest"
+#define MODULE_CACHE_RESULTS 8 ///< results kept per key, newest first
+#define MISSING_FILE_HASH "-"
+
+// The launcher's standard output may be the scan result itself, so nothing
+// here logs through `logger`, errors go to the standard error.
+
+enum class CompileKind { kPlain = 0, kScan, kInterface, kImporter };
+
+/// What cake understands of a compiler command line.
+struct CompileCommand {
+	CompileKind kind = CompileKind::kPlain;
+	std::vector<std::string> args; ///< response files expanded
+	std::string source;
+	std::string output; ///< `-o`
+	std::string depfile; ///< `-MF`
+	std::string ddi; ///< `-fdeps-file=`, gcc scan results
+	std::string bmi; ///< the BMI produced
+	std::vector<std::string> bmis; ///< the BMIs imported
+	std::string mapper; ///< `-fmodule-mapper=`, gcc
+	bool preprocess = false; ///< `-E`, the output is text
+	bool scan_deps = false; ///< clang-scan-deps, results on the standard output
+	bool std_module = false; ///< the source is the standard library module
+};
+
+/// A file the compiler writes, stored in a cache entry under `name`.
+struct CachedOutput {
+	std::string name;
+	std::string path;
+	bool text; ///< paths inside are rewritten between build directories
+};
+
+static
+bool StartsWith(const std::string &s, const std::string &prefix)
+{
+	return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+static
+std::string ReplaceAll(std::string s, const std::string &from, const std::string &to)
+{
+	if (from.empty()) {
+		return s;
+	}
+	for (size_t pos = 0; (pos = s.find(from, pos)) != std::string::npos; pos += to.size()) {
+		s.replace(pos, from.size(), to);
+	}
+	return s;
+}
+
+/// Paths below the build directory, made independent of where it lives.
+static
+std::string Relocatable(const std::string &s, const std::string &build_directory)
+{
+	return ReplaceAll(s, build_directory + "/", BUILD_DIRECTORY_PLACEHOLDER "/");
+}
+
+static
+std::string Relocate(const std::string &s, const std::string &build_directory)
+{
+	return ReplaceAll(s, BUILD_DIRECTORY_PLACEHOLDER "/", build_directory + "/");
+}
+
+/// gcc and clang response file syntax: whitespace separated, quotes and backslashes.
+static
+std::vector<std::string> SplitResponseFile(const std::string &content)
+{
+	std::vector<std::string> args;
+	std::string arg;
+	bool in_arg = false;
+	char quote = 0;
+	for (size_t i = 0; i < content.size(); ++i) {
+		char c = content[i];
+		if (c == '\\' && i + 1 < content.size()) {
+			arg += content[++i];
+			in_arg = true;
+		} else if (quote) {
+			if (c == quote) {
+				quote = 0;
+			} else {
+				arg += c;
+			}
+		} else if (c == '"' || c == '\'') {
+			quote = c;
+			in_arg = true;
+		} else if (isspace((unsigned char)c)) {
+			if (in_arg) {
+				args.push_back(arg);
+				arg.clear();
+				in_arg = false;
+			}
+		} else {
+			arg += c;
+			in_arg = true;
+		}
+	}
+	if (in_arg) {
+		args.push_back(arg);
+	}
+	return args;
+}
+
+static
+void ExpandResponseFiles(const std::vector<std::string> &args, std::vector<std::string> &expanded, int depth = 0)
+{
+	std::string content;
+	for (const std::string &arg : args) {
+		if (depth < 8 && arg.size() > 1 && arg[0] == '@' && ReadFileContent(arg.substr(1), content)) {
+			ExpandResponseFiles(SplitResponseFile(content), expanded, depth + 1);
+		} else {
+			expanded.push_back(arg);
+		}
+	}
+}
+
+static
+bool IsSourceFile(const std::string &arg)
+{
+	static const std::regex source(R"(.*\.(cpp|cc|cxx|c\+\+|C|cppm|ccm|cxxm|c\+\+m|ixx|mpp|mxx)$)");
+	return std::regex_match(arg, source);
+}
+
+/// `std.cppm` and `std.compat.cppm` of libc++, `bits/std.cc` and
+/// `bits/std.compat.cc` of libstdc++, `std.ixx` of the MSVC STL.
+static
+bool IsStdModuleSource(const std::string &source)
+{
+	static const std::regex std_module(R"(std(\.compat)?\.(cppm|cc|ixx))");
+	return std::regex_match(fs::path(source).filename().string(), std_module);
+}
+
+/// The module a gcc translation unit exports, if any.
+static
+std::string ExportedModuleOf(const std::string &source)
+{
+	static const std::regex export_module(R"(^\s*export\s+module\s+([\w.:]+)\s*;)");
+	std::ifstream input(source);
+	std::string line;
+	std::smatch match;
+	while (std::getline(input, line)) {
+		if (std::regex_search(line, match, export_module)) {
+			return match[1];
+		}
+	}
+	return "";
+}
+
+/// gcc module mapper file: `$root <dir>` and `<module> <bmi>` lines.
+static
+void ResolveModuleMapper(CompileCommand &cc)
+{
+	std::string content;
+	if (!ReadFileContent(cc.mapper, content)) {
+		return;
+	}
+	std::string exported = ExportedModuleOf(cc.source);
+	fs::path root;
+	std::stringstream ss(content);
+	std::string line;
+	while (std::getline(ss, line)) {
+		std::stringstream fields(line);
+		std::string name, path;
+		if (!(fields >> name >> path)) {
+			continue;
+		}
+		if (name == "$root") {
+			root = path;
+			continue;
+		}
+		std::string bmi = (root / path).string();
+		if (name == exported) {
+			cc.bmi = bmi;
+		} else {
+			cc.bmis.push_back(bmi);
+		}
+	}
+}
+
+static
+CompileCommand ParseCompileCommand(const std::vector<std::string> &command)
+{
+	CompileCommand cc;
+	cc.args.push_back(command[0]);
+	ExpandResponseFiles(std::vector<std::string>(command.begin() + 1, command.end()), cc.args);
+	cc.scan_deps = fs::path(command[0]).filename().string().find("clang-scan-deps") != std::string::npos;
+
+	bool deps_format = false;
+	bool precompile = false;
+	bool bmi_next_to_object = false;
+	const std::vector<std::string> &args = cc.args;
+	for (size_t i = 1; i < args.size(); ++i) {
+		const std::string &arg = args[i];
+		bool has_value = i + 1 < args.size();
+		if (arg == "-o" && has_value) {
+			cc.output = args[++i];
+		} else if (arg == "-MF" && has_value) {
+			cc.depfile = args[++i];
+		} else if (arg == "-E") {
+			cc.preprocess = true;
+		} else if (arg == "--precompile") {
+			precompile = true;
+		} else if (StartsWith(arg, "-fdeps-file=")) {
+			cc.ddi = arg.substr(strlen("-fdeps-file="));
+		} else if (StartsWith(arg, "-fdeps-format=")) {
+			deps_format = true;
+		} else if (arg == "-fmodule-output") {
+			bmi_next_to_object = true;
+		} else if (StartsWith(arg, "-fmodule-output=")) {
+			cc.bmi = arg.substr(strlen("-fmodule-output="));
+		} else if (StartsWith(arg, "-fmodule-file=")) {
+			// -fmodule-file=<name>=<bmi> or -fmodule-file=<bmi>
+			std::string value = arg.substr(strlen("-fmodule-file="));
+			size_t equal = value.find('=');
+			cc.bmis.push_back(equal == std::string::npos ? value : value.substr(equal + 1));
+		} else if (StartsWith(arg, "-fmodule-mapper=")) {
+			cc.mapper = arg.substr(strlen("-fmodule-mapper="));
+		} else if (arg[0] != '-' && cc.source.empty() && IsSourceFile(arg)) {
+			cc.source = arg;
+		}
+	}
+
+	cc.std_module = IsStdModuleSource(cc.source);
+	if (!cc.mapper.empty() && !cc.scan_deps && !deps_format) {
+		ResolveModuleMapper(cc);
+	}
+	if (bmi_next_to_object && !cc.output.empty()) {
+		cc.bmi = fs::path(cc.output).replace_extension(".pcm").string();
+	}
+	if (precompile) {
+		cc.bmi = cc.output;
+		cc.output.clear();
+	}
+
+	// without a dependency file the headers can't be verified, don't cache
+	if (cc.depfile.empty() || cc.source.empty()) {
+		cc.kind = CompileKind::kPlain;
+	} else if (cc.scan_deps || deps_format) {
+		cc.kind = CompileKind::kScan;
+	} else if (!cc.bmi.empty()) {
+		cc.kind = CompileKind::kInterface;
+	} else if (!cc.bmis.empty()) {
+		cc.kind = CompileKind::kImporter;
+	}
+
+	// clang checks the sources behind a BMI by timestamp, the cache moves BMIs
+	// between checkouts, so let it check them by content like the cache does
+	bool clang_modules = cc.mapper.empty() && (cc.kind == CompileKind::kInterface || cc.kind == CompileKind::kImporter);
+	if (clang_modules) {
+		cc.args.push_back("-fmodules-validate-input-files-content");
+	}
+
+	return cc;
+}
+
+static
+std::vector<CachedOutput> OutputsOf(const CompileCommand &cc)
+{
+	std::vector<CachedOutput> outputs;
+	if (!cc.output.empty() && !cc.scan_deps) {
+		outputs.push_back({ "output", cc.output, cc.preprocess });
+	}
+	if (!cc.bmi.empty()) {
+		outputs.push_back({ "bmi", cc.bmi, false });
+	}
+	if (!cc.ddi.empty()) {
+		outputs.push_back({ "ddi", cc.ddi, true });
+	}
+	outputs.push_back({ "depfile", cc.depfile, true });
+	return outputs;
+}
+
+/// Identify an executable by where it is and which build of it it is.
+static
+std::string ExecutableIdentity(const std::string &executable)
+{
+	std::string path = executable;
+	if (executable.find('/') == std::string::npos) {
+		const char *env_path = getenv("PATH");
+		std::stringstream ss(env_path ? env_path : "");
+		std::string dir;
+		while (std::getline(ss, dir, ':')) {
+			if (access((dir + "/" + executable).c_str(), X_OK) == 0) {
+				path = dir + "/" + executable;
+				break;
+			}
+		}
+	}
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) {
+		return executable;
+	}
+	return path + ":" + std::to_string(st.st_size) + ":" + std::to_string(st.st_mtime);
+}
+
+static
+std::string FileHash(const std::string &path, std::unordered_map<std::string, std::string> &hashes)
+{
+	auto it = hashes.find(path);
+	if (it != hashes.end()) {
+		return it->second;
+	}
+	std::string content;
+	std::string hash = ReadFileContent(path, content) ? HashToHex(HashBytes(content)) : MISSING_FILE_HASH;
+	hashes[path] = hash;
+	return hash;
+}
+
+static
+const char *KindName(CompileKind kind, bool std_module = false)
+{
+	if (std_module && kind == CompileKind::kInterface) {
+		return "std";
+	}
+	switch (kind) {
+	case CompileKind::kScan:
+		return "scan";
+	case CompileKind::kInterface:
+		return "interface";
+	case CompileKind::kImporter:
+		return "importer";
+	default:
+		return "plain";
+	}
+}
+
+/// Everything known before compiling: compiler, arguments and imported BMIs.
+static
+std::string CommandKey(const CompileCommand &cc, const std::string &build_directory, std::unordered_map<std::string, std::string> &hashes)
+{
+	uint64_t hash = HashBytes("cake-module-cache-1");
+	hash = HashBytes(KindName(cc.kind), hash);
+	hash = HashBytes(ExecutableIdentity(cc.args[0]), hash);
+	for (size_t i = 1; i < cc.args.size(); ++i) {
+		// clang-scan-deps runs the compiler after `--`
+		if (cc.args[i - 1] == "--") {
+			hash = HashBytes(ExecutableIdentity(cc.args[i]), hash);
+		}
+		hash = HashBytes(Relocatable(cc.args[i], build_directory) + '\0', hash);
+	}
+	if (!cc.mapper.empty()) {
+		std::string mapper;
+		ReadFileContent(cc.mapper, mapper);
+		hash = HashBytes(Relocatable(mapper, build_directory), hash);
+	}
+	// the whole BMI, its bodies and source locations too, the compilers have no
+	// stable hash of the interface alone
+	for (const std::string &bmi : cc.bmis) {
+		hash = HashBytes(FileHash(bmi, hashes), hash);
+	}
+	return HashToHex(hash);
+}
+
+struct ManifestEntry {
+	std::string result;
+	std::vector<std::pair<std::string, std::string>> files; ///< (hash, relocatable path)
+};
+
+/// ```
+/// result <id>
+/// <hash> <path>
+/// ...
+/// ```
+static
+std::vector<ManifestEntry> ReadManifest(const fs::path &file)
+{
+	std::vector<ManifestEntry> entries;
+	std::string content;
+	if (!ReadFileContent(file.string(), content)) {
+		return entries;
+	}
+	std::stringstream ss(content);
+	std::string line;
+	while (std::getline(ss, line)) {
+		size_t space = line.find(' ');
+		if (space == std::string::npos) {
+			continue;
+		}
+		if (StartsWith(line, "result ")) {
+			entries.push_back({ line.substr(space + 1), {} });
+		} else if (!entries.empty()) {
+			entries.back().files.push_back({ line.substr(0, space), line.substr(space + 1) });
+		}
+	}
+	return entries;
+}
+
+static
+bool WriteFileAtomically(const fs::path &file, const std::string &content)
+{
+	fs::path temp = file.string() + ".tmp-" + std::to_string(getpid());
+	{
+		std::ofstream output(temp, std::ios::binary);
+		output << content;
+		if (!output) {
+			return false;
+		}
+	}
+	std::error_code ec;
+	fs::rename(temp, file, ec);
+	return !ec;
+}
+
+static
+void WriteManifest(const fs::path &file, const std::vector<ManifestEntry> &entries)
+{
+	std::string content;
+	for (const ManifestEntry &entry : entries) {
+		content += "result " + entry.result + "\n";
+		for (const auto &item : entry.files) {
+			content += item.first + " " + item.second + "\n";
+		}
+	}
+	WriteFileAtomically(file, content);
+}
+
+/// The result whose recorded dependencies all still have the same content.
+static
+std::string LookupManifest(const fs::path &key_directory, const std::string &build_directory, std::unordered_map<std::string, std::string> &hashes)
+{
+	for (const ManifestEntry &entry : ReadManifest(key_directory / MODULE_CACHE_MANIFEST)) {
+		bool match = true;
+		for (const auto &item : entry.files) {
+			if (FileHash(Relocate(item.second, build_directory), hashes) != item.first) {
+				match = false;
+				break;
+			}
+		}
+		if (match) {
+			return entry.result;
+		}
+	}
+	return "";
+}
+
+static
+bool CopyFile(const std::string &from, const std::string &to)
+{
+	std::error_code ec;
+	if (fs::path(to).has_parent_path()) {
+		fs::create_directories(fs::path(to).parent_path(), ec);
+	}
+	// never hardlink, compilers may rewrite their outputs in place
+	StageMethod method;
+	return StageFile(from, to, method, false);
+}
+
+static
+bool RestoreOutputs(const CompileCommand &cc, const fs::path &entry, const std::string &build_directory, std::unordered_map<std::string, std::string> &hashes)
+{
+	for (const CachedOutput &output : OutputsOf(cc)) {
+		fs::path stored = entry / output.name;
+		if (output.text) {
+			std::string content;
+			if (!ReadFileContent(stored.string(), content) || !WriteFileAtomically(output.path, Relocate(content, build_directory))) {
+				return false;
+			}
+		} else if (FileHash(output.path, hashes) != FileHash(stored.string(), hashes)) {
+			// an identical BMI keeps its timestamp
+			if (!CopyFile(stored.string(), output.path)) {
+				return false;
+			}
+		}
+	}
+
+	std::string content;
+	if (ReadFileContent((entry / "stdout").string(), content)) {
+		content = Relocate(content, build_directory);
+		fwrite(content.data(), 1, content.size(), stdout);
+	}
+	if (ReadFileContent((entry / "stderr").string(), content)) {
+		content = Relocate(content, build_directory);
+		fwrite(content.data(), 1, content.size(), stderr);
+	}
+	return true;
+}
+
+static
+void StoreOutputs(const CompileCommand &cc, const fs::path &key_directory, const std::string &build_directory, const std::string &out, const std::string &err)
+{
+	std::string depfile;
+	if (!ReadFileContent(cc.depfile, depfile)) {
+		return;
+	}
+
+	std::vector<CachedOutput> outputs = OutputsOf(cc);
+	auto is_output = [&outputs](const std::string &path) {
+		for (const CachedOutput &output : outputs) {
+			if (output.path == path) {
+				return true;
+			}
+		}
+		return false;
+	};
+
+	// hash what the compiler actually read, gcc also lists what it wrote and
+	// phony module targets
+	ManifestEntry entry;
+	uint64_t id = HashBytes("");
+	for (const std::string &dep : ParseDependencyFile(depfile)) {
+		std::string content;
+		if (is_output(dep) || !ReadFileContent(dep, content)) {
+			continue;
+		}
+		std::string hash = HashToHex(HashBytes(content));
+		entry.files.push_back({ hash, Relocatable(dep, build_directory) });
+		id = HashBytes(hash + dep, id);
+	}
+	entry.result = HashToHex(id);
+
+	std::error_code ec;
+	fs::path result = key_directory / entry.result;
+	if (!fs::exists(result)) {
+		// build the result aside, so concurrent builds never see half of it
+		fs::path temp = result.string() + ".tmp-" + std::to_string(getpid());
+		fs::create_directories(temp, ec);
+		bool ok = !ec;
+		for (const CachedOutput &output : outputs) {
+			if (!ok) {
+				break;
+			}
+			if (output.text) {
+				std::string content;
+				ok = ReadFileContent(output.path, content) && WriteFileAtomically(temp / output.name, Relocatable(content, build_directory));
+			} else {
+				ok = CopyFile(output.path, (temp / output.name).string());
+			}
+		}
+		if (ok && !out.empty()) {
+			ok = WriteFileAtomically(temp / "stdout", Relocatable(out, build_directory));
+		}
+		if (ok && !err.empty()) {
+			ok = WriteFileAtomically(temp / "stderr", Relocatable(err, build_directory));
+		}
+		if (ok) {
+			fs::rename(temp, result, ec);
+		}
+		fs::remove_all(temp, ec);
+	}
+
+	std::vector<ManifestEntry> entries{ entry };
+	for (const ManifestEntry &old : ReadManifest(key_directory / MODULE_CACHE_MANIFEST)) {
+		if (old.result != entry.result && entries.size() < MODULE_CACHE_RESULTS) {
+			entries.push_back(old);
+		} else if (old.result != entry.result) {
+			fs::remove_all(key_directory / old.result, ec);
+		}
+	}
+	WriteManifest(key_directory / MODULE_CACHE_MANIFEST, entries);
+}
+
+/// Run the compiler, collecting what it prints to replay it on later hits.
+static
+int RunCompiler(const std::vector<std::string> &args, std::string &out, std::string &err)
+{
+	int out_fds[2], err_fds[2];
+	if (pipe2(out_fds, O_CLOEXEC) < 0 || pipe2(err_fds, O_CLOEXEC) < 0) {
+		fprintf(stderr, "cake: could not create pipe: %s\n", strerror(errno));
+		return 1;
+	}
+
+	std::vector<char *> argv;
+	for (const std::string &arg : args) {
+		argv.push_back(const_cast<char *>(arg.c_str()));
+	}
+	argv.push_back(nullptr);
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		fprintf(stderr, "cake: could not fork: %s\n", strerror(errno));
+		return 1;
+	}
+	if (pid == 0) {
+		dup2(out_fds[1], STDOUT_FILENO);
+		dup2(err_fds[1], STDERR_FILENO);
+		execvp(argv[0], argv.data());
+		fprintf(stderr, "cake: could not exec %s: %s\n", argv[0], strerror(errno));
+		_exit(127);
+	}
+	close(out_fds[1]);
+	close(err_fds[1]);
+
+	struct pollfd fds[2] = { { out_fds[0], POLLIN, 0 }, { err_fds[0], POLLIN, 0 } };
+	std::string *sinks[2] = { &out, &err };
+	int open_fds = 2;
+	char buffer[65536];
+	while (open_fds > 0) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		for (int i = 0; i < 2; ++i) {
+			if (fds[i].fd < 0 || fds[i].revents == 0) {
+				continue;
+			}
+			ssize_t n = read(fds[i].fd, buffer, sizeof(buffer));
+			if (n > 0) {
+				sinks[i]->append(buffer, n);
+			} else if (n == 0 || errno != EINTR) {
+				close(fds[i].fd);
+				fds[i].fd = -1;
+				--open_fds;
+			}
+		}
+	}
+
+	return WaitCmd(pid);
+}
+
+/// The standard library module only depends on the compiler and the flags,
+/// so the key leaves out where the outputs go, and the compiler is
+/// identified by its version as well.
+static
+std::string StdModuleKey(const CompileCommand &cc, std::unordered_map<std::string, std::string> &hashes)
+{
+	static const std::vector<std::string> output_options{ "-o", "-MF", "-MT", "-MQ" };
+	static const std::vector<std::string> output_prefixes{ "-fmodule-output=", "-fdeps-file=", "-fdeps-target=" };
+
+	std::string compiler = cc.args[0];
+	for (size_t i = 1; cc.scan_deps && i < cc.args.size(); ++i) {
+		if (cc.args[i - 1] == "--") {
+			compiler = cc.args[i];
+		}
+	}
+	std::string version, err;
+	RunCompiler({ compiler, "--version" }, version, err);
+
+	uint64_t hash = HashBytes("cake-std-module-1");
+	hash = HashBytes(KindName(cc.kind, true), hash);
+	hash = HashBytes(ExecutableIdentity(compiler), hash);
+	hash = HashBytes(version, hash);
+	for (size_t i = 1; i < cc.args.size(); ++i) {
+		const std::string &arg = cc.args[i];
+		if (std::find(output_options.begin(), output_options.end(), arg) != output_options.end()) {
+			++i;
+			continue;
+		}
+		bool output = false;
+		for (const std::string &prefix : output_prefixes) {
+			output = output || StartsWith(arg, prefix);
+		}
+		if (!output) {
+			hash = HashBytes(arg + '\0', hash);
+		}
+	}
+	// std.compat imports std
+	for (const std::string &bmi : cc.bmis) {
+		hash = HashBytes(FileHash(bmi, hashes), hash);
+	}
+	return HashToHex(hash);
+}
+
+static
+void LogResult(CompileKind kind, bool std_module, bool hit)
+{
+	const char *log = getenv(MODULE_CACHE_LOG_ENV);
+	if (!log || !*log) {
+		return;
+	}
+	int fd = open(log, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		return;
+	}
+	// a single short append is atomic among the parallel compiles
+	std::string line = std::string(KindName(kind, std_module)) + (hit ? " hit\n" : " miss\n");
+	if (write(fd, line.data(), line.size()) < 0) {
+		fprintf(stderr, "cake: could not write %s: %s\n", log, strerror(errno));
+	}
+	close(fd);
+}
+
+std::string ModuleCacheDirectory()
+{
+	return UserCacheDirectory() + "/modules";
+}
+
+std::string StdModuleCacheDirectory()
+{
+	return UserCacheDirectory() + "/std-modules";
+}
+
+bool ImportsStdModule(const std::string &source_directory, const std::string &build_directory)
+{
+	static const std::regex import_std(R"(^\s*(export\s+)?import\s+std(\.compat)?\s*;)");
+	static const std::regex source(R"(.*\.(cpp|cc|cxx|c\+\+|cppm|ccm|cxxm|c\+\+m|ixx|mpp|mxx|h|hh|hpp|hxx))");
+
+	std::error_code ec;
+	fs::path build = fs::weakly_canonical(build_directory, ec);
+	fs::recursive_directory_iterator it(source_directory, ec), end;
+	for (; it != end; it.increment(ec)) {
+		if (ec) {
+			break;
+		}
+		std::string name = it->path().filename().string();
+		if (it->is_directory(ec)) {
+			// build trees, dependencies and hidden directories
+			if (name[0] == '.' || name == "packages" || name == "out" || name == "build" || fs::weakly_canonical(it->path(), ec) == build) {
+				it.disable_recursion_pending();
+			}
+			continue;
+		}
+		if (!std::regex_match(name, source)) {
+			continue;
+		}
+		std::ifstream input(it->path());
+		std::string line;
+		while (std::getline(input, line)) {
+			if (line.find("import") != std::string::npos && std::regex_search(line, import_std)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+int LaunchCompiler(const std::vector<std::string> &command, bool std_only)
+{
+	if (command.empty()) {
+		fprintf(stderr, "cake launch: missing compiler command\n");
+		return 2;
+	}
+
+	CompileCommand cc = ParseCompileCommand(command);
+	if (cc.kind == CompileKind::kPlain || (std_only && !cc.std_module)) {
+		std::vector<char *> argv;
+		for (const std::string &arg : command) {
+			argv.push_back(const_cast<char *>(arg.c_str()));
+		}
+		argv.push_back(nullptr);
+		execvp(argv[0], argv.data());
+		fprintf(stderr, "cake: could not exec %s: %s\n", argv[0], strerror(errno));
+		return 127;
+	}
+
+	std::error_code ec;
+	std::string build_directory = fs::current_path(ec).string();
+	std::unordered_map<std::string, std::string> hashes;
+	fs::path key_directory = cc.std_module ?
+		fs::path(StdModuleCacheDirectory()) / StdModuleKey(cc, hashes) :
+		fs::path(ModuleCacheDirectory()) / CommandKey(cc, build_directory, hashes);
+
+	std::string result = LookupManifest(key_directory, build_directory, hashes);
+	if (!result.empty() && RestoreOutputs(cc, key_directory / result, build_directory, hashes)) {
+		LogResult(cc.kind, cc.std_module, true);
+		return 0;
+	}
+
+	std::string out, err;
+	int code = RunCompiler(cc.args, out, err);
+	fwrite(out.data(), 1, out.size(), stdout);
+	fwrite(err.data(), 1, err.size(), stderr);
+	if (code == 0) {
+		fs::create_directories(key_directory, ec);
+		StoreOutputs(cc, key_directory, build_directory, out, err);
+	}
+	LogResult(cc.kind, cc.std_module, false);
+
+	return code;
+}
+
+ModuleCacheStats ReadModuleCacheLog(const std::string &file)
+{
+	ModuleCacheStats stats;
+	std::ifstream input(file);
+	std::string kind, result;
+	while (input >> kind >> result) {
+		bool hit = result == "hit";
+		if (kind == "interface") {
+			stats.interfaces++;
+			stats.interfaces_reused += hit;
+		} else if (kind == "importer") {
+			stats.importers++;
+			stats.importers_reused += hit;
+		} else if (kind == "std") {
+			stats.std_modules++;
+			stats.std_modules_reused += hit;
+		} else if (kind == "scan") {
+			stats.scans++;
+			stats.scans_reused += hit;
+		}
+	}
+	return stats;
+}
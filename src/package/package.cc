@@ -0,0 +1,325 @@
+#include "package/package.h"
+
+#include <cstdio>
+#include <iostream>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "utility/common.h"
+
+#define TAR_BLOCK_SIZE 512
+
+static
+bool CopyFileRange(int in, int out, size_t size)
+{
+	loff_t in_offset = 0;
+	loff_t out_offset = 0;
+	while (size > 0) {
+		ssize_t n = copy_file_range(in, &in_offset, out, &out_offset, size, 0);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		if (n == 0) {
+			break;
+		}
+		size -= n;
+	}
+	return size == 0;
+}
+
+bool StageFile(const std::string &from, const std::string &to, StageMethod &method, bool hardlink)
+{
+	struct stat st;
+	if (stat(from.c_str(), &st) != 0) {
+		logger->Warning("Could not stat ", from, ": ", strerror(errno));
+		return false;
+	}
+
+	unlink(to.c_str());
+
+	int in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+	if (in < 0) {
+		logger->Warning("Could not open ", from, ": ", strerror(errno));
+		return false;
+	}
+	int out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 07777);
+	if (out < 0) {
+		logger->Warning("Could not create ", to, ": ", strerror(errno));
+		close(in);
+		return false;
+	}
+
+	// reflink, shares the extents until one side is written
+	if (ioctl(out, FICLONE, in) == 0) {
+		method = StageMethod::kReflink;
+		close(in);
+		close(out);
+		return true;
+	}
+
+	// hardlink, the linkers replace their outputs instead of rewriting them
+	close(out);
+	unlink(to.c_str());
+	if (hardlink && link(from.c_str(), to.c_str()) == 0) {
+		method = StageMethod::kHardlink;
+		close(in);
+		return true;
+	}
+
+	// in-kernel copy across file systems
+	out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 07777);
+	if (out < 0) {
+		logger->Warning("Could not create ", to, ": ", strerror(errno));
+		close(in);
+		return false;
+	}
+	bool ok = CopyFileRange(in, out, st.st_size);
+	if (!ok) {
+		logger->Warning("Could not copy ", from, " to ", to, ": ", strerror(errno));
+	}
+	method = StageMethod::kCopyFileRange;
+	close(in);
+	close(out);
+	return ok;
+}
+
+////////////////////// Archive /////////////////////////////////
+
+static
+void WriteOctal(char *field, size_t width, unsigned long long value)
+{
+	// width - 1 digits and a terminating NUL
+	snprintf(field, width, "%0*llo", (int)(width - 1), value);
+}
+
+static
+void WriteSize(char *field, size_t width, unsigned long long value)
+{
+	if (value < (1ULL << (3 * (width - 1)))) {
+		WriteOctal(field, width, value);
+		return;
+	}
+	// GNU base-256 encoding for large files
+	memset(field, 0, width);
+	field[0] = (char)0x80;
+	for (size_t i = width - 1; i > 0 && value > 0; --i) {
+		field[i] = (char)(value & 0xFF);
+		value >>= 8;
+	}
+}
+
+static
+bool WriteAll(int fd, const char *data, size_t size)
+{
+	while (size > 0) {
+		ssize_t n = write(fd, data, size);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+static
+bool WriteTarHeader(int fd, const std::string &name, const struct stat &st)
+{
+	char header[TAR_BLOCK_SIZE];
+	memset(header, 0, sizeof(header));
+
+	// ustar splits long names into prefix (155) and name (100)
+	std::string prefix;
+	std::string filename = name;
+	if (filename.size() > 100) {
+		size_t split = name.rfind('/', 155);
+		if (split == std::string::npos || name.size() - split - 1 > 100) {
+			logger->Warning("File name too long for the archive: ", name);
+			return false;
+		}
+		prefix = name.substr(0, split);
+		filename = name.substr(split + 1);
+	}
+
+	memcpy(header, filename.data(), filename.size());
+	WriteOctal(header + 100, 8, st.st_mode & 07777);
+	WriteOctal(header + 108, 8, 0);
+	WriteOctal(header + 116, 8, 0);
+	WriteSize(header + 124, 12, st.st_size);
+	WriteOctal(header + 136, 12, st.st_mtime);
+	memset(header + 148, ' ', 8);
+	header[156] = '0';
+	memcpy(header + 257, "ustar", 6);
+	memcpy(header + 263, "00", 2);
+	memcpy(header + 345, prefix.data(), prefix.size());
+
+	unsigned int checksum = 0;
+	for (size_t i = 0; i < sizeof(header); ++i) {
+		checksum += (unsigned char)header[i];
+	}
+	snprintf(header + 148, 8, "%06o", checksum);
+
+	return WriteAll(fd, header, sizeof(header));
+}
+
+/// Move a file into the archive in the kernel, `sendfile` accepts any output.
+static
+bool SendFile(int out, const std::string &path, size_t size)
+{
+	int in = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (in < 0) {
+		return false;
+	}
+	off_t offset = 0;
+	while ((size_t)offset < size) {
+		ssize_t n = sendfile(out, in, &offset, size - offset);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			close(in);
+			return false;
+		}
+		if (n == 0) {
+			break;
+		}
+	}
+	close(in);
+	return (size_t)offset == size;
+}
+
+static
+std::string CompressorOf(const std::string &archive)
+{
+	auto ends_with = [&archive](const std::string &suffix) {
+		return archive.size() >= suffix.size() &&
+			archive.compare(archive.size() - suffix.size(), suffix.size(), suffix) == 0;
+	};
+	if (ends_with(".gz") || ends_with(".tgz")) {
+		return "gzip";
+	}
+	if (ends_with(".xz")) {
+		return "xz";
+	}
+	if (ends_with(".zst")) {
+		return "zstd";
+	}
+	return "";
+}
+
+int DivertStandardOutput()
+{
+	std::cout.flush();
+	fflush(stdout);
+	int output = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+	if (output < 0) {
+		return STDOUT_FILENO;
+	}
+	if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+		close(output);
+		return STDOUT_FILENO;
+	}
+	return output;
+}
+
+bool WriteTarArchive(const std::string &archive, const std::vector<ArchiveEntry> &entries, int standard_output)
+{
+	int out = standard_output;
+	if (archive != "-") {
+		out = open(archive.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (out < 0) {
+			logger->Warning("Could not create ", archive, ": ", strerror(errno));
+			return false;
+		}
+	}
+
+	// compress on the fly, the compressor reads the archive from a pipe
+	pid_t compressor = -1;
+	int fd = out;
+	std::string compressor_cmd = CompressorOf(archive);
+	if (!compressor_cmd.empty()) {
+		int fds[2];
+		if (pipe2(fds, O_CLOEXEC) < 0) {
+			logger->Warning("Could not create pipe: ", strerror(errno));
+			if (archive != "-") {
+				close(out);
+			}
+			return false;
+		}
+		compressor = fork();
+		if (compressor < 0) {
+			logger->Warning("Could not start ", compressor_cmd, ": ", strerror(errno));
+			close(fds[0]);
+			close(fds[1]);
+			if (archive != "-") {
+				close(out);
+			}
+			return false;
+		}
+		if (compressor == 0) {
+			dup2(fds[0], STDIN_FILENO);
+			dup2(out, STDOUT_FILENO);
+			execlp(compressor_cmd.c_str(), compressor_cmd.c_str(), "-c", (char *)nullptr);
+			fprintf(stderr, "Could not exec %s: %s\n", compressor_cmd.c_str(), strerror(errno));
+			_exit(127);
+		}
+		close(fds[0]);
+		fd = fds[1];
+	}
+	// a compressor dying makes the writes fail with EPIPE instead of killing cake
+	struct sigaction ignore = {}, previous = {};
+	ignore.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &ignore, &previous);
+
+	bool ok = true;
+	static const char zeros[TAR_BLOCK_SIZE * 2] = { 0 };
+	for (const ArchiveEntry &entry : entries) {
+		struct stat st;
+		if (stat(entry.path.c_str(), &st) != 0) {
+			logger->Warning("Could not stat ", entry.path, ": ", strerror(errno));
+			ok = false;
+			break;
+		}
+		if (!WriteTarHeader(fd, entry.name, st) || !SendFile(fd, entry.path, st.st_size)) {
+			logger->Warning("Could not archive ", entry.path, ": ", strerror(errno));
+			ok = false;
+			break;
+		}
+		size_t padding = (TAR_BLOCK_SIZE - st.st_size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+		if (!WriteAll(fd, zeros, padding)) {
+			ok = false;
+			break;
+		}
+	}
+	// end of archive: two empty blocks
+	if (ok) {
+		ok = WriteAll(fd, zeros, sizeof(zeros));
+	}
+
+	if (fd != out) {
+		close(fd);
+	}
+	sigaction(SIGPIPE, &previous, nullptr);
+	if (compressor > 0 && WaitCmd(compressor) != 0) {
+		ok = false;
+	}
+	if (archive != "-") {
+		close(out);
+	}
+
+	return ok;
+}
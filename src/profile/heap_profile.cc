@@ -0,0 +1,153 @@
+#include "profile/heap_profile.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <sstream>
+#include <tuple>
+
+#include "utility/common.h"
+
+namespace fs = std::filesystem;
+
+/// Functions longer than this are cut in the table.
+#define HEAP_FUNCTION_WIDTH 50
+
+std::string HeapProfilerLibrary()
+{
+	fs::path directory = fs::path(SelfExecutable()).parent_path();
+	for (const fs::path &library : { directory / HEAP_PROFILER_LIBRARY, directory.parent_path() / "lib" / HEAP_PROFILER_LIBRARY }) {
+		if (fs::exists(library)) {
+			return library.string();
+		}
+	}
+	return "";
+}
+
+static
+bool ReadHeapProfile(const std::string &file, HeapProfile &heap)
+{
+	std::string content;
+	if (!ReadFileContent(file, content) || content.rfind("cake-heap-profile 1\n", 0) != 0) {
+		return false;
+	}
+	std::map<ProfileLocation, size_t> indexes;
+	std::stringstream ss(content);
+	std::string line;
+	while (std::getline(ss, line)) {
+		std::stringstream ls(line);
+		std::string key;
+		ls >> key;
+		if (key == "interval") {
+			ls >> heap.interval;
+		} else if (key == "allocations") {
+			ls >> heap.allocations;
+		} else if (key == "frees") {
+			ls >> heap.frees;
+		} else if (key == "bytes") {
+			ls >> heap.bytes;
+		} else if (key == "peak") {
+			ls >> heap.peak;
+		} else if (key == "lost") {
+			ls >> heap.lost;
+		} else if (key == "site") {
+			uint64_t allocations = 0, bytes = 0;
+			ls >> allocations >> bytes;
+			std::vector<size_t> stack;
+			ProfileLocation location;
+			while (ls >> location.binary >> std::hex >> location.address >> std::dec) {
+				if (location.binary == "-") {
+					location.binary.clear();
+				}
+				auto it = indexes.find(location);
+				if (it == indexes.end()) {
+					it = indexes.emplace(location, heap.stacks.locations.size()).first;
+					heap.stacks.locations.push_back(location);
+				}
+				stack.push_back(it->second);
+			}
+			if (!stack.empty()) {
+				heap.stacks.stacks[stack] += bytes;
+				heap.stacks.samples += bytes;
+				heap.counts[stack] += allocations;
+			}
+		}
+	}
+	return true;
+}
+
+std::vector<HeapProfile> ReadHeapProfiles(const std::string &prefix)
+{
+	std::vector<HeapProfile> heaps;
+	fs::path directory = fs::path(prefix).parent_path();
+	std::string name = fs::path(prefix).filename().string() + ".";
+	std::error_code ec;
+	for (const auto &entry : fs::directory_iterator(directory, ec)) {
+		std::string file = entry.path().filename().string();
+		HeapProfile heap;
+		if (file.rfind(name, 0) == 0 && ReadHeapProfile(entry.path().string(), heap)) {
+			heap.pid = atoi(file.c_str() + name.size());
+			heaps.push_back(std::move(heap));
+		}
+	}
+	std::sort(heaps.begin(), heaps.end(), [](const HeapProfile &a, const HeapProfile &b) {
+		return a.pid < b.pid;
+	});
+	return heaps;
+}
+
+void PrintHeapProfile(const HeapProfile &heap, const std::vector<SourceLocation> &sources, const std::string &source_directory, size_t top)
+{
+	logger->Info("Heap of pid ", heap.pid, ": ", FormatCount(heap.allocations), " allocations of ", FormatBytes(heap.bytes),
+		", ", FormatCount(heap.frees), " frees, peak ", FormatBytes(heap.peak), " in use");
+	if (heap.lost > 0) {
+		logger->Warning(heap.lost, " samples had no room for their stack");
+	}
+
+	struct AllocationSite {
+		uint64_t allocations = 0;
+		uint64_t bytes = 0;
+	};
+	// by the line of the site, the addresses of a line are the same site
+	std::map<std::tuple<std::string, std::string, int>, std::pair<size_t, AllocationSite>> sites;
+	for (const auto &item : heap.stacks.stacks) {
+		const std::vector<size_t> &stack = item.first;
+		auto site = std::find_if(stack.begin(), stack.end(), [&sources](size_t location) {
+			return !sources[location].target.empty();
+		});
+		if (site == stack.end()) {
+			site = std::find_if(stack.begin(), stack.end(), [&sources](size_t location) {
+				return !sources[location].file.empty();
+			});
+		}
+		size_t location = site == stack.end() ? stack.front() : *site;
+		const SourceLocation &source = sources[location];
+		auto &entry = sites[{ source.function, source.file, source.line }];
+		entry.first = location;
+		entry.second.bytes += item.second;
+		entry.second.allocations += heap.counts.at(stack);
+	}
+	if (sites.empty()) {
+		return;
+	}
+
+	std::vector<std::pair<size_t, AllocationSite>> ranked;
+	for (const auto &item : sites) {
+		ranked.push_back(item.second);
+	}
+	std::sort(ranked.begin(), ranked.end(), [](const auto &a, const auto &b) {
+		return a.second.bytes > b.second.bytes;
+	});
+	if (ranked.size() > top) {
+		ranked.resize(top);
+	}
+	printf("%10s %10s  %-*s  %s\n", "Bytes", "Allocs", HEAP_FUNCTION_WIDTH, "Function", "Location (target)");
+	for (const auto &item : ranked) {
+		const SourceLocation &source = sources[item.first];
+		std::string function = source.function;
+		if (function.size() > HEAP_FUNCTION_WIDTH) {
+			function = function.substr(0, HEAP_FUNCTION_WIDTH - 3) + "...";
+		}
+		printf("%10s %10s  %-*s  %s\n", FormatBytes(item.second.bytes).c_str(), FormatCount(item.second.allocations).c_str(),
+			HEAP_FUNCTION_WIDTH, function.c_str(), FormatSourceLocation(source.file, source.line, source.target, source_directory).c_str());
+	}
+}
@@ -0,0 +1,233 @@
+#include "profile/pgo.h"
+
+#include <filesystem>
+
+#include "utility/common.h"
+#include "utility/json.h"
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+std::string PgoCompiler(const std::vector<std::string> &options)
+{
+	for (const std::string &option : options) {
+		if (option.rfind("CMAKE_CXX_COMPILER", 0) == 0) {
+			std::string compiler = fs::path(option.substr(option.find('=') + 1)).filename().string();
+			return compiler.find("clang") != std::string::npos ? "clang" : "gcc";
+		}
+	}
+	return "gcc";
+}
+
+std::vector<std::string> SplitArgs(const std::string &line)
+{
+	std::vector<std::string> args;
+	std::string arg;
+	bool in_arg = false;
+	char quote = 0;
+	for (size_t i = 0; i < line.size(); i++) {
+		char c = line[i];
+		if (quote != 0 && c == quote) {
+			quote = 0;
+		} else if (quote == 0 && (c == '"' || c == '\'')) {
+			quote = c;
+			in_arg = true;
+		} else if (c == '\\' && quote != '\'' && i + 1 < line.size()) {
+			arg += line[++i];
+			in_arg = true;
+		} else if (quote == 0 && (c == ' ' || c == '\t' || c == '\n')) {
+			if (in_arg) {
+				args.push_back(arg);
+				arg.clear();
+				in_arg = false;
+			}
+		} else {
+			arg += c;
+			in_arg = true;
+		}
+	}
+	if (in_arg) {
+		args.push_back(arg);
+	}
+	return args;
+}
+
+/// Absolute, the compilers run in the directories of the targets.
+static
+std::string AbsolutePath(const std::string &path)
+{
+	return fs::absolute(path).lexically_normal().string();
+}
+
+std::string PgoRawDirectory(const std::string &build_directory)
+{
+	return AbsolutePath(build_directory + "/" PGO_DIRECTORY "/raw");
+}
+
+std::string PgoProfileFilePattern(const std::string &build_directory)
+{
+	// a file per process and binary, merged after
+	return PgoRawDirectory(build_directory) + "/%p-%m.profraw";
+}
+
+/// The profile clang reads, merged by llvm-profdata.
+static
+std::string PgoProfileData(const std::string &build_directory)
+{
+	return AbsolutePath(build_directory + "/" PGO_DIRECTORY "/default.profdata");
+}
+
+std::vector<std::string> PgoGenerateFlags(const std::string &compiler, const std::string &build_directory, const std::string &profile_directory)
+{
+	if (compiler == "clang") {
+		// the file is set by LLVM_PROFILE_FILE when training
+		return { "-fprofile-instr-generate" };
+	}
+	// the .gcda files are named after the objects, relative to the build
+	// directory they are the same in the optimized build
+	return {
+		"-fprofile-generate=" + PgoRawDirectory(profile_directory),
+		"-fprofile-prefix-path=" + AbsolutePath(build_directory),
+		"-fprofile-update=prefer-atomic",
+	};
+}
+
+std::vector<std::string> PgoUseFlags(const std::string &compiler, const std::string &build_directory)
+{
+	if (compiler == "clang") {
+		return {
+			"-fprofile-instr-use=" + PgoProfileData(build_directory),
+			"-Wno-profile-instr-out-of-date",
+			"-Wno-profile-instr-unprofiled",
+		};
+	}
+	return {
+		"-fprofile-use=" + PgoRawDirectory(build_directory),
+		"-fprofile-prefix-path=" + AbsolutePath(build_directory),
+		"-fprofile-correction",
+		"-Wno-missing-profile",
+		"-Wno-error=coverage-mismatch",
+	};
+}
+
+bool MergePgoProfiles(const std::string &compiler, const std::string &cxx_compiler, const std::string &build_directory)
+{
+	std::vector<std::string> raw;
+	std::error_code ec;
+	for (const auto &entry : fs::recursive_directory_iterator(PgoRawDirectory(build_directory), ec)) {
+		std::string extension = entry.path().extension().string();
+		if (extension == ".profraw" || extension == ".gcda") {
+			raw.push_back(entry.path().string());
+		}
+	}
+	if (raw.empty()) {
+		return false;
+	}
+	if (compiler != "clang") {
+		return true;
+	}
+
+	// the llvm-profdata of the clang, `clang++-17` goes with `llvm-profdata-17`
+	std::string profdata;
+	std::string name = fs::path(cxx_compiler).filename().string();
+	size_t dash = name.rfind('-');
+	if (dash != std::string::npos && isdigit((unsigned char)name[dash + 1])) {
+		profdata = FindProgram(LLVM_PROFDATA_COMMAND + name.substr(dash));
+	}
+	if (profdata.empty()) {
+		profdata = FindProgram(LLVM_PROFDATA_COMMAND);
+	}
+	if (profdata.empty()) {
+		logger->Error(LLVM_PROFDATA_COMMAND, " is not installed, it merges the profiles of clang");
+		return false;
+	}
+	std::vector<std::string> args{ profdata, "merge", "--output=" + PgoProfileData(build_directory) };
+	args.insert(args.end(), raw.begin(), raw.end());
+	return RunCmdSync(profdata, args);
+}
+
+/// Hash of the content of `file`, empty if it can't be read.
+static
+std::string HashFile(const std::string &file)
+{
+	std::string content;
+	if (!ReadFileContent(file, content)) {
+		return "";
+	}
+	return HashToHex(HashBytes(content));
+}
+
+std::map<std::string, std::string> HashPgoSources(const std::string &source_directory, const std::unordered_map<std::string, Target> &targets)
+{
+	std::map<std::string, std::string> sources;
+	for (const auto &item : targets) {
+		const Target &target = item.second;
+		if (!target.contains("sources")) {
+			continue;
+		}
+		for (const auto &source : target["sources"]) {
+			// relative to the package, or generated or outside of it
+			std::string path = source["path"].get<std::string>();
+			if (source.value("isGenerated", false) || fs::path(path).is_absolute() || path.rfind("..", 0) == 0) {
+				continue;
+			}
+			std::string hash = HashFile(source_directory + "/" + path);
+			if (!hash.empty()) {
+				sources[path] = hash;
+			}
+		}
+	}
+	return sources;
+}
+
+double PgoSourceDrift(const PgoProfile &profile, const std::string &source_directory)
+{
+	if (profile.sources.empty()) {
+		return 0;
+	}
+	size_t changed = 0;
+	for (const auto &item : profile.sources) {
+		if (HashFile(source_directory + "/" + item.first) != item.second) {
+			changed++;
+		}
+	}
+	return (double)changed / profile.sources.size();
+}
+
+bool ReadPgoProfile(const std::string &build_directory, PgoProfile &profile)
+{
+	std::string content;
+	if (!ReadFileContent(build_directory + "/" PGO_DIRECTORY "/" PGO_PROFILE_FILE, content)) {
+		return false;
+	}
+	json record = json::parse(content, nullptr, false);
+	if (!record.is_object()) {
+		return false;
+	}
+	profile.compiler = record.value("compiler", "gcc");
+	profile.build_type = record.value("build_type", "");
+	profile.bin = record.value("bin", "");
+	profile.train = record.value("train", std::vector<std::string>());
+	profile.runs = record.value("runs", (size_t)0);
+	profile.timestamp = record.value("timestamp", (int64_t)0);
+	profile.commit = record.value("commit", "");
+	profile.drift_threshold = record.value("drift_threshold", 0.0);
+	profile.sources = record.value("sources", std::map<std::string, std::string>());
+	return true;
+}
+
+void WritePgoProfile(const std::string &build_directory, const PgoProfile &profile)
+{
+	json record = {
+		{ "compiler", profile.compiler },
+		{ "build_type", profile.build_type },
+		{ "bin", profile.bin },
+		{ "train", profile.train },
+		{ "runs", profile.runs },
+		{ "timestamp", profile.timestamp },
+		{ "commit", profile.commit },
+		{ "drift_threshold", profile.drift_threshold },
+		{ "sources", profile.sources },
+	};
+	WriteContentToFile(record.dump(2), build_directory + "/" PGO_DIRECTORY "/" PGO_PROFILE_FILE);
+}
@@ -0,0 +1,692 @@
+#include "profile/profiler.h"
+
+#include <algorithm>
+#include <cxxabi.h>
+#include <elf.h>
+#include <errno.h>
+#include <filesystem>
+#include <fstream>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <regex>
+#include <set>
+#include <signal.h>
+#include <sstream>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench/perf_counters.h"
+#include "create/template.h"
+#include "utility/json.h"
+
+namespace fs = std::filesystem;
+using nlohmann::json;
+
+/// What symbolizing needs of an ELF binary, 64-bit only.
+struct ElfImage {
+	struct Segment {
+		uint64_t offset;
+		uint64_t address;
+		uint64_t size;
+	};
+	struct Function {
+		uint64_t address;
+		uint64_t size;
+		std::string name; ///< mangled
+	};
+	std::vector<Segment> segments; ///< loaded from the file
+	std::vector<Function> functions; ///< sorted by address
+	std::unordered_map<std::string, uint64_t> symbols; ///< mangled name -> address
+	bool debug_info = false; ///< has `.debug_line`, for addr2line
+};
+
+static
+bool ReadElfImage(const std::string &file, ElfImage &image)
+{
+	std::string content;
+	if (!ReadFileContent(file, content) || content.size() < sizeof(Elf64_Ehdr)) {
+		return false;
+	}
+	const char *data = content.data();
+	Elf64_Ehdr header;
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 || header.e_ident[EI_CLASS] != ELFCLASS64) {
+		return false;
+	}
+	auto inside = [&content](uint64_t offset, uint64_t size) {
+		return offset <= content.size() && size <= content.size() - offset;
+	};
+
+	for (size_t i = 0; i < header.e_phnum; ++i) {
+		Elf64_Phdr program;
+		uint64_t offset = header.e_phoff + i * header.e_phentsize;
+		if (!inside(offset, sizeof(program))) {
+			break;
+		}
+		memcpy(&program, data + offset, sizeof(program));
+		if (program.p_type == PT_LOAD) {
+			image.segments.push_back({ program.p_offset, program.p_vaddr, program.p_filesz });
+		}
+	}
+
+	std::vector<Elf64_Shdr> sections;
+	for (size_t i = 0; i < header.e_shnum; ++i) {
+		Elf64_Shdr section;
+		uint64_t offset = header.e_shoff + i * header.e_shentsize;
+		if (!inside(offset, sizeof(section))) {
+			break;
+		}
+		memcpy(&section, data + offset, sizeof(section));
+		sections.push_back(section);
+	}
+	if (header.e_shstrndx < sections.size()) {
+		const Elf64_Shdr &names = sections[header.e_shstrndx];
+		for (const Elf64_Shdr &section : sections) {
+			if (inside(names.sh_offset, names.sh_size) && section.sh_name < names.sh_size && strncmp(data + names.sh_offset + section.sh_name, ".debug_line", names.sh_size - section.sh_name) == 0) {
+				image.debug_info = true;
+			}
+		}
+	}
+	for (const Elf64_Shdr &section : sections) {
+		if ((section.sh_type != SHT_SYMTAB && section.sh_type != SHT_DYNSYM) || section.sh_link >= sections.size()) {
+			continue;
+		}
+		const Elf64_Shdr &strings = sections[section.sh_link];
+		if (!inside(section.sh_offset, section.sh_size) || !inside(strings.sh_offset, strings.sh_size)) {
+			continue;
+		}
+		for (uint64_t offset = 0; offset + sizeof(Elf64_Sym) <= section.sh_size; offset += sizeof(Elf64_Sym)) {
+			Elf64_Sym symbol;
+			memcpy(&symbol, data + section.sh_offset + offset, sizeof(symbol));
+			if (ELF64_ST_TYPE(symbol.st_info) != STT_FUNC || symbol.st_value == 0 || symbol.st_name >= strings.sh_size) {
+				continue;
+			}
+			const char *name = data + strings.sh_offset + symbol.st_name;
+			std::string function(name, strnlen(name, strings.sh_size - symbol.st_name));
+			if (image.symbols.emplace(function, symbol.st_value).second) {
+				image.functions.push_back({ symbol.st_value, symbol.st_size, function });
+			}
+		}
+	}
+	std::sort(image.functions.begin(), image.functions.end(), [](const ElfImage::Function &a, const ElfImage::Function &b) {
+		return a.address < b.address;
+	});
+	return true;
+}
+
+/// Address as linked of an offset in the file.
+static
+uint64_t ElfAddressOf(const ElfImage &image, uint64_t offset)
+{
+	for (const ElfImage::Segment &segment : image.segments) {
+		if (offset >= segment.offset && offset < segment.offset + segment.size) {
+			return offset - segment.offset + segment.address;
+		}
+	}
+	return offset;
+}
+
+/// Mangled name of the function at `address`, empty if none.
+static
+std::string ElfFunctionAt(const ElfImage &image, uint64_t address)
+{
+	auto it = std::upper_bound(image.functions.begin(), image.functions.end(), address, [](uint64_t address, const ElfImage::Function &function) {
+		return address < function.address;
+	});
+	if (it == image.functions.begin()) {
+		return "";
+	}
+	--it;
+	return address < it->address + std::max<uint64_t>(it->size, 1) ? it->name : "";
+}
+
+static
+std::string Demangle(const std::string &symbol)
+{
+	int status = 0;
+	char *demangled = abi::__cxa_demangle(symbol.c_str(), nullptr, nullptr, &status);
+	if (status != 0 || demangled == nullptr) {
+		return symbol;
+	}
+	std::string name = demangled;
+	free(demangled);
+	return name;
+}
+
+static
+size_t LocationIndex(Profile &profile, std::map<ProfileLocation, size_t> &indexes, const ProfileLocation &location)
+{
+	auto it = indexes.find(location);
+	if (it != indexes.end()) {
+		return it->second;
+	}
+	indexes[location] = profile.locations.size();
+	profile.locations.push_back(location);
+	return profile.locations.size() - 1;
+}
+
+bool SampleWithPerf(const std::string &cmd, const std::vector<std::string> &args, const ProcessOptions &options, int frequency, const std::string &directory, Profile &profile)
+{
+	std::string data = directory + "/perf.data";
+	fs::remove(data);
+	std::vector<std::string> record{ PERF_COMMAND, "record", "-g", "-F", std::to_string(frequency), "-o", data, "--", cmd };
+	record.insert(record.end(), args.begin() + std::min<size_t>(1, args.size()), args.end());
+	profile.engine = "perf";
+	profile.exit_code = WaitCmd(SpawnCmd(PERF_COMMAND, record, options));
+	if (!fs::exists(data)) {
+		return false;
+	}
+
+	// `comm` heads a sample, its frames follow, leaf first: `<ip> <symbol>+0x<offset> (<binary>)`
+	std::string output;
+	if (!RunCmdCapture(PERF_COMMAND, { PERF_COMMAND, "script", "-i", data, "-F", "comm,ip,sym,symoff,dso", "--no-demangle" }, output)) {
+		return false;
+	}
+	static const std::regex frame(R"(^\s+([0-9a-fA-F]+)\s+(.*?)(?:\+0x([0-9a-fA-F]+))?\s+\((.*)\)\s*$)");
+	std::map<ProfileLocation, size_t> indexes;
+	std::vector<size_t> stack;
+	auto flush = [&profile, &stack]() {
+		if (!stack.empty()) {
+			profile.stacks[stack]++;
+			profile.samples++;
+			stack.clear();
+		}
+	};
+	std::stringstream ss(output);
+	std::string line;
+	std::smatch match;
+	while (std::getline(ss, line)) {
+		if (std::regex_match(line, match, frame)) {
+			ProfileLocation location;
+			location.binary = match[4] == "[unknown]" ? "" : match[4].str();
+			location.symbol = match[2];
+			// a return address is after the call
+			uint64_t offset = strtoull(match[3].str().c_str(), nullptr, 16);
+			location.address = offset - (stack.empty() || offset == 0 ? 0 : 1);
+			stack.push_back(LocationIndex(profile, indexes, location));
+		} else {
+			flush();
+		}
+	}
+	flush();
+	return true;
+}
+
+/// An executable mapping of the process sampled.
+struct SampledMapping {
+	uint64_t start;
+	uint64_t end;
+	uint64_t offset; ///< in the file
+	std::string file;
+};
+
+/// A ring buffer the kernel writes the samples of a cpu to.
+struct SampleBuffer {
+	int fd;
+	void *memory;
+};
+
+bool SampleWithPerfEventOpen(const std::string &cmd, const std::vector<std::string> &args, const ProcessOptions &options, int frequency, Profile &profile)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	// the cpu time of the process, hardware counters or not
+	attr.type = PERF_TYPE_SOFTWARE;
+	attr.config = PERF_COUNT_SW_TASK_CLOCK;
+	attr.freq = 1;
+	attr.sample_freq = frequency;
+	attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN;
+	attr.disabled = 1;
+	attr.enable_on_exec = 1;
+	attr.inherit = 1;
+	attr.mmap = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.exclude_callchain_kernel = 1;
+
+	int gate[2];
+	std::function<void()> wait = MakeExecGate(gate);
+	ProcessOptions gated = options;
+	gated.before_exec = [options, wait]() {
+		if (options.before_exec) {
+			options.before_exec();
+		}
+		wait();
+	};
+	pid_t pid = SpawnCmd(cmd, args, gated);
+
+	// the kernel can't map inherited events of a process on all cpus, perf
+	// record opens one per cpu too
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t size = page * 128;
+	std::vector<SampleBuffer> buffers;
+	int error = 0;
+	for (long cpu = 0; cpu < sysconf(_SC_NPROCESSORS_CONF); ++cpu) {
+		int fd = (int)syscall(SYS_perf_event_open, &attr, pid, cpu, -1, PERF_FLAG_FD_CLOEXEC);
+		if (fd < 0) {
+			// offline
+			error = errno;
+			continue;
+		}
+		void *memory = mmap(nullptr, page + size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (memory == MAP_FAILED) {
+			error = errno;
+			close(fd);
+			continue;
+		}
+		buffers.push_back({ fd, memory });
+	}
+	if (buffers.empty()) {
+		logger->Warning("Could not sample with perf_event_open: ", strerror(error));
+		kill(pid, SIGKILL);
+		ReleaseExecGate(gate);
+		WaitCmd(pid);
+		return false;
+	}
+	ReleaseExecGate(gate);
+
+	// resolved once the process exited, the mappings of any cpu are known then
+	profile.engine = "perf_event_open";
+	std::vector<SampledMapping> mappings;
+	std::map<std::vector<uint64_t>, uint64_t> stacks;
+	std::vector<char> record;
+	auto drain = [&](SampleBuffer &buffer) {
+		struct perf_event_mmap_page *header = (struct perf_event_mmap_page *)buffer.memory;
+		const char *data = (const char *)buffer.memory + page;
+		auto copy = [data, size](uint64_t position, size_t length, char *to) {
+			for (size_t i = 0; i < length; ++i) {
+				to[i] = data[(position + i) % size];
+			}
+		};
+		uint64_t head = __atomic_load_n(&header->data_head, __ATOMIC_ACQUIRE);
+		uint64_t tail = header->data_tail;
+		while (tail + sizeof(struct perf_event_header) <= head) {
+			struct perf_event_header event;
+			copy(tail, sizeof(event), (char *)&event);
+			if (event.size < sizeof(event) || tail + event.size > head) {
+				break;
+			}
+			record.resize(event.size);
+			copy(tail, event.size, record.data());
+			tail += event.size;
+			const char *body = record.data() + sizeof(event);
+			size_t length = event.size - sizeof(event);
+			if (event.type == PERF_RECORD_MMAP && length > 32) {
+				// pid, tid, address, length, offset, file name
+				uint64_t fields[3];
+				memcpy(fields, body + 8, sizeof(fields));
+				mappings.push_back({ fields[0], fields[0] + fields[1], fields[2], std::string(body + 32, strnlen(body + 32, length - 32)) });
+			} else if (event.type == PERF_RECORD_SAMPLE && length >= 24) {
+				// ip, pid, tid, the callchain
+				uint64_t ip, count;
+				memcpy(&ip, body, sizeof(ip));
+				memcpy(&count, body + 16, sizeof(count));
+				std::vector<uint64_t> stack;
+				for (uint64_t i = 0; i < count && 24 + (i + 1) * 8 <= length; ++i) {
+					uint64_t frame;
+					memcpy(&frame, body + 24 + i * 8, sizeof(frame));
+					// context markers, like PERF_CONTEXT_USER
+					if (frame < (uint64_t)PERF_CONTEXT_MAX) {
+						stack.push_back(frame);
+					}
+				}
+				if (stack.empty()) {
+					stack.push_back(ip);
+				}
+				stacks[stack]++;
+			} else if (event.type == PERF_RECORD_LOST && length >= 16) {
+				uint64_t lost;
+				memcpy(&lost, body + 8, sizeof(lost));
+				profile.lost += lost;
+			}
+		}
+		__atomic_store_n(&header->data_tail, tail, __ATOMIC_RELEASE);
+	};
+
+	int status = 0;
+	std::vector<struct pollfd> events;
+	for (const SampleBuffer &buffer : buffers) {
+		events.push_back({ buffer.fd, POLLIN, 0 });
+	}
+	while (true) {
+		poll(events.data(), events.size(), 100);
+		for (SampleBuffer &buffer : buffers) {
+			drain(buffer);
+		}
+		pid_t done = waitpid(pid, &status, WNOHANG);
+		if (done == pid || (done < 0 && errno != EINTR)) {
+			break;
+		}
+	}
+	for (SampleBuffer &buffer : buffers) {
+		drain(buffer);
+		munmap(buffer.memory, page + size);
+		close(buffer.fd);
+	}
+	profile.exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : WIFSIGNALED(status) ? 128 + WTERMSIG(status) : 0;
+
+	std::map<std::string, ElfImage> images;
+	std::map<ProfileLocation, size_t> indexes;
+	auto locate = [&](uint64_t ip, bool leaf) {
+		ProfileLocation location;
+		location.address = ip;
+		for (auto it = mappings.rbegin(); it != mappings.rend(); ++it) {
+			if (ip >= it->start && ip < it->end) {
+				// a return address is after the call
+				uint64_t offset = ip - (leaf ? 0 : 1) - it->start + it->offset;
+				auto image = images.find(it->file);
+				if (image == images.end()) {
+					image = images.emplace(it->file, ElfImage()).first;
+					ReadElfImage(it->file, image->second);
+				}
+				location.binary = it->file;
+				location.address = ElfAddressOf(image->second, offset);
+				break;
+			}
+		}
+		return LocationIndex(profile, indexes, location);
+	};
+	for (const auto &item : stacks) {
+		std::vector<size_t> stack;
+		for (uint64_t ip : item.first) {
+			stack.push_back(locate(ip, stack.empty()));
+		}
+		profile.stacks[stack] += item.second;
+		profile.samples += item.second;
+	}
+	return true;
+}
+
+/// `file:line` of addr2line, maybe with ` (discriminator N)`.
+static
+void ParseFileLine(const std::string &text, SourceLocation &source)
+{
+	std::string file_line = text.substr(0, text.find(" ("));
+	size_t colon = file_line.rfind(':');
+	if (colon == std::string::npos || file_line.compare(0, 2, "??") == 0) {
+		return;
+	}
+	source.file = file_line.substr(0, colon);
+	source.line = atoi(file_line.c_str() + colon + 1);
+}
+
+std::vector<SourceLocation> SymbolizeProfile(const Profile &profile, const std::string &source_directory, const std::string &build_directory, const std::unordered_map<std::string, Target> &targets)
+{
+	std::vector<SourceLocation> sources(profile.locations.size());
+	std::map<std::string, std::vector<size_t>> binaries;
+	for (size_t i = 0; i < profile.locations.size(); ++i) {
+		binaries[profile.locations[i].binary].push_back(i);
+	}
+	bool addr2line = !FindProgram(ADDR2LINE_COMMAND).empty();
+	if (!addr2line) {
+		logger->Warning("No ", ADDR2LINE_COMMAND, ", functions are named from the symbol tables, without files and lines");
+	}
+
+	for (const auto &item : binaries) {
+		ElfImage image;
+		bool elf = !item.first.empty() && ReadElfImage(item.first, image);
+		std::vector<size_t> pending;
+		std::vector<std::string> addresses;
+		for (size_t i : item.second) {
+			const ProfileLocation &location = profile.locations[i];
+			uint64_t address = location.address;
+			std::string symbol = location.symbol;
+			if (!symbol.empty() && symbol != "[unknown]") {
+				// the sampled line, not the first of the function
+				auto it = image.symbols.find(symbol);
+				address = it != image.symbols.end() ? it->second + location.address : 0;
+			} else if (elf) {
+				symbol = ElfFunctionAt(image, address);
+			}
+			if (!symbol.empty() && symbol != "[unknown]") {
+				sources[i].function = Demangle(symbol);
+			} else {
+				sources[i].function = item.first.empty() ? "[unknown]" : "[" + fs::path(item.first).filename().string() + "]";
+			}
+			// addr2line names stripped code after the closest symbol before it
+			if (elf && image.debug_info && addr2line && address != 0) {
+				char hex[32];
+				snprintf(hex, sizeof(hex), "0x%llx", (unsigned long long)address);
+				pending.push_back(i);
+				addresses.push_back(hex);
+			}
+		}
+		// two lines an address, the function and `file:line`
+		const size_t batch = 512;
+		for (size_t begin = 0; begin < pending.size(); begin += batch) {
+			size_t end = std::min(pending.size(), begin + batch);
+			std::vector<std::string> args{ ADDR2LINE_COMMAND, "-f", "-C", "-e", item.first };
+			args.insert(args.end(), addresses.begin() + begin, addresses.begin() + end);
+			std::string output;
+			if (!RunCmdCapture(ADDR2LINE_COMMAND, args, output)) {
+				continue;
+			}
+			std::stringstream ss(output);
+			std::string function, file_line;
+			for (size_t k = begin; k < end && std::getline(ss, function) && std::getline(ss, file_line); ++k) {
+				SourceLocation &source = sources[pending[k]];
+				if (function != "??") {
+					source.function = function;
+				}
+				ParseFileLine(file_line, source);
+			}
+		}
+	}
+
+	// the target building each source file, the one of the binary first
+	std::map<std::string, std::vector<std::string>> owners;
+	std::map<std::string, std::string> artifacts;
+	for (const auto &item : targets) {
+		const Target &target = item.second;
+		if (target.contains("sources")) {
+			for (const auto &source : target["sources"]) {
+				fs::path path = source["path"].get<std::string>();
+				std::error_code ec;
+				path = fs::weakly_canonical(path.is_absolute() ? path : fs::path(source_directory) / path, ec);
+				owners[path.string()].push_back(item.first);
+			}
+		}
+		if (target.contains("artifacts")) {
+			for (const auto &artifact : target["artifacts"]) {
+				fs::path path = artifact["path"].get<std::string>();
+				std::error_code ec;
+				path = fs::weakly_canonical(path.is_absolute() ? path : fs::path(build_directory) / path, ec);
+				artifacts[path.string()] = item.first;
+			}
+		}
+	}
+	for (size_t i = 0; i < sources.size(); ++i) {
+		SourceLocation &source = sources[i];
+		if (source.file.empty()) {
+			continue;
+		}
+		std::error_code ec;
+		auto owner = owners.find(fs::weakly_canonical(source.file, ec).string());
+		if (owner == owners.end()) {
+			continue;
+		}
+		auto artifact = artifacts.find(fs::weakly_canonical(profile.locations[i].binary, ec).string());
+		bool in_binary = artifact != artifacts.end() && std::find(owner->second.begin(), owner->second.end(), artifact->second) != owner->second.end();
+		source.target = in_binary ? artifact->second : owner->second.front();
+	}
+	return sources;
+}
+
+std::string FormatSourceLocation(const std::string &file, int line, const std::string &target, const std::string &source_directory)
+{
+	std::string location = "-";
+	if (!file.empty()) {
+		std::error_code ec;
+		fs::path relative = fs::relative(file, source_directory, ec);
+		location = (!ec && !relative.empty() && relative.begin()->string() != ".." ? relative : fs::path(file)).string() + ":" + std::to_string(line);
+	}
+	if (!target.empty()) {
+		location += " (" + target + ")";
+	}
+	return location;
+}
+
+void WriteFoldedStacks(const std::string &file, const Profile &profile, const std::vector<SourceLocation> &sources)
+{
+	std::map<std::string, uint64_t> folded;
+	for (const auto &item : profile.stacks) {
+		std::string line;
+		for (auto it = item.first.rbegin(); it != item.first.rend(); ++it) {
+			std::string function = sources[*it].function;
+			std::replace(function.begin(), function.end(), ';', ':');
+			line += line.empty() ? function : ";" + function;
+		}
+		folded[line] += item.second;
+	}
+	std::ofstream output(file);
+	for (const auto &item : folded) {
+		output << item.first << " " << item.second << "\n";
+	}
+}
+
+/// A frame of the flame graph, and the frames it calls.
+struct FlameNode {
+	uint64_t samples = 0;
+	bool project = false; ///< in a source file of the package
+	std::map<std::string, FlameNode> children;
+};
+
+static
+json FlameNodeToJson(const std::string &name, const FlameNode &node)
+{
+	json children = json::array();
+	for (const auto &child : node.children) {
+		children.push_back(FlameNodeToJson(child.first, child.second));
+	}
+	return { { "n", name }, { "v", node.samples }, { "p", node.project ? 1 : 0 }, { "c", children } };
+}
+
+static
+std::string EscapeHtml(const std::string &text)
+{
+	std::string escaped;
+	for (char c : text) {
+		switch (c) {
+		case '<': escaped += "&lt;"; break;
+		case '>': escaped += "&gt;"; break;
+		case '&': escaped += "&amp;"; break;
+		case '"': escaped += "&quot;"; break;
+		default: escaped += c;
+		}
+	}
+	return escaped;
+}
+
+static
+void ReplaceAll(std::string &text, const std::string &from, const std::string &to)
+{
+	for (size_t at = text.find(from); at != std::string::npos; at = text.find(from, at + to.size())) {
+		text.replace(at, from.size(), to);
+	}
+}
+
+void WriteFlameGraph(const std::string &file, const std::string &title, const Profile &profile, const std::vector<SourceLocation> &sources)
+{
+	FlameNode root;
+	for (const auto &item : profile.stacks) {
+		FlameNode *node = &root;
+		node->samples += item.second;
+		for (auto it = item.first.rbegin(); it != item.first.rend(); ++it) {
+			node = &node->children[sources[*it].function];
+			node->samples += item.second;
+			node->project = !sources[*it].target.empty();
+		}
+	}
+
+	std::string html;
+	for (const EmbeddedFile &resource : EmbeddedProfileResources()) {
+		if (std::string(resource.path) == "flamegraph.html") {
+			html.assign((const char *)resource.data, resource.size);
+		}
+	}
+	// nothing in the data may end the script
+	std::string data = FlameNodeToJson("all", root).dump();
+	ReplaceAll(data, "</", "<\\/");
+	ReplaceAll(html, "CAKE_FLAME_GRAPH_TITLE", EscapeHtml(title));
+	ReplaceAll(html, "CAKE_FLAME_GRAPH_DATA", data);
+	std::ofstream(file) << html;
+}
+
+/// Functions longer than this are cut in the table.
+#define HOTSPOT_FUNCTION_WIDTH 60
+
+void PrintHotspots(const Profile &profile, const std::vector<SourceLocation> &sources, const std::string &source_directory, size_t top)
+{
+	struct Hotspot {
+		uint64_t self = 0;
+		uint64_t total = 0;
+		std::map<std::pair<std::string, int>, uint64_t> lines; ///< samples of each line, or call
+		std::string target;
+	};
+	std::map<std::string, Hotspot> hotspots;
+	std::map<std::string, uint64_t> targets;
+	for (const auto &item : profile.stacks) {
+		const SourceLocation &leaf = sources[item.first.front()];
+		Hotspot &hotspot = hotspots[leaf.function];
+		hotspot.self += item.second;
+		targets[leaf.target.empty() ? "[external]" : leaf.target] += item.second;
+		std::set<std::string> seen;
+		for (size_t location : item.first) {
+			const SourceLocation &source = sources[location];
+			if (seen.insert(source.function).second) {
+				Hotspot &caller = hotspots[source.function];
+				caller.total += item.second;
+				caller.lines[{ source.file, source.line }] += item.second;
+				if (caller.target.empty()) {
+					caller.target = source.target;
+				}
+			}
+		}
+	}
+	if (profile.samples == 0) {
+		logger->Warning("No samples, the program ran too briefly or could not be sampled");
+		return;
+	}
+
+	std::vector<std::pair<std::string, const Hotspot *>> ranked;
+	for (const auto &item : hotspots) {
+		ranked.push_back({ item.first, &item.second });
+	}
+	std::sort(ranked.begin(), ranked.end(), [](const auto &a, const auto &b) {
+		return a.second->self != b.second->self ? a.second->self > b.second->self : a.second->total > b.second->total;
+	});
+	if (ranked.size() > top) {
+		ranked.resize(top);
+	}
+
+	double total = (double)profile.samples;
+	printf("%6s %6s  %-*s  %s\n", "Self", "Total", HOTSPOT_FUNCTION_WIDTH, "Function", "Location (target)");
+	for (const auto &item : ranked) {
+		const Hotspot &hotspot = *item.second;
+		auto hottest = std::max_element(hotspot.lines.begin(), hotspot.lines.end(), [](const auto &a, const auto &b) {
+			return a.second < b.second;
+		});
+		std::string location = FormatSourceLocation(hottest->first.first, hottest->first.second, hotspot.target, source_directory);
+		std::string function = item.first;
+		if (function.size() > HOTSPOT_FUNCTION_WIDTH) {
+			function = function.substr(0, HOTSPOT_FUNCTION_WIDTH - 3) + "...";
+		}
+		printf("%5.1f%% %5.1f%%  %-*s  %s\n", 100 * hotspot.self / total, 100 * hotspot.total / total, HOTSPOT_FUNCTION_WIDTH, function.c_str(), location.c_str());
+	}
+
+	std::vector<std::pair<std::string, uint64_t>> shares(targets.begin(), targets.end());
+	std::sort(shares.begin(), shares.end(), [](const auto &a, const auto &b) {
+		return a.second > b.second;
+	});
+	std::string summary;
+	for (const auto &share : shares) {
+		char percent[16];
+		snprintf(percent, sizeof(percent), "%.1f%%", 100 * share.second / total);
+		summary += (summary.empty() ? "" : ", ") + share.first + " " + percent;
+	}
+	printf("Samples by target: %s\n", summary.c_str());
+}
@@ -0,0 +1,213 @@
+#include "profile/resource_sampler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+#include <poll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "utility/common.h"
+
+namespace fs = std::filesystem;
+
+/// Columns of the sparklines.
+#define SPARKLINE_WIDTH 40
+
+/// Totals of a process read from `/proc`, before they become rates.
+struct ProcessReading {
+	uint64_t cpu_ticks = 0; ///< user and system time of all its threads
+	ResourceSample sample;
+};
+
+/// The value of `key:` in a `/proc/<pid>/status` or `io` file, 0 if missing.
+static
+uint64_t ProcValue(const std::string &content, const std::string &key)
+{
+	size_t begin = ("\n" + content).find("\n" + key + ":");
+	if (begin == std::string::npos) {
+		return 0;
+	}
+	return strtoull(content.c_str() + begin + key.size() + 1, nullptr, 10);
+}
+
+static
+bool ReadProcess(pid_t pid, ProcessReading &reading)
+{
+	std::string directory = "/proc/" + std::to_string(pid);
+	std::string status, stat, io;
+	// a zombie has no memory left
+	if (!ReadFileContent(directory + "/status", status) || status.find("\nVmRSS:") == std::string::npos || !ReadFileContent(directory + "/stat", stat)) {
+		return false;
+	}
+	reading.sample.rss = ProcValue(status, "VmRSS");
+	reading.sample.threads = ProcValue(status, "Threads");
+
+	// `pid (comm) state ...`, comm may have spaces, utime and stime are the 14th and 15th
+	size_t paren = stat.rfind(')');
+	if (paren == std::string::npos) {
+		return false;
+	}
+	std::stringstream ss(stat.substr(paren + 1));
+	std::string field;
+	for (int i = 3; i <= 15 && ss >> field; i++) {
+		if (i == 14 || i == 15) {
+			reading.cpu_ticks += strtoull(field.c_str(), nullptr, 10);
+		}
+	}
+
+	// only readable by the same user, 0 without
+	if (ReadFileContent(directory + "/io", io)) {
+		reading.sample.read_bytes = ProcValue(io, "read_bytes");
+		reading.sample.write_bytes = ProcValue(io, "write_bytes");
+	}
+
+	// the switches of `status` are of the main thread alone
+	std::error_code ec;
+	for (const auto &entry : fs::directory_iterator(directory + "/task", ec)) {
+		std::string task;
+		if (ReadFileContent(entry.path().string() + "/status", task)) {
+			reading.sample.voluntary_switches += ProcValue(task, "voluntary_ctxt_switches");
+			reading.sample.involuntary_switches += ProcValue(task, "nonvoluntary_ctxt_switches");
+		}
+	}
+	return true;
+}
+
+/// Wait `interval` milliseconds, or less if process `pid` exits. Returns
+/// whether it exited, without reaping it.
+static
+bool WaitForExit(pid_t pid, int pidfd, size_t interval)
+{
+	if (pidfd >= 0) {
+		struct pollfd fd = { pidfd, POLLIN, 0 };
+		return poll(&fd, 1, (int)interval) > 0;
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+	siginfo_t info{};
+	return waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid == pid;
+}
+
+std::vector<ResourceSample> SampleResources(pid_t pid, size_t interval, const std::string &csv)
+{
+	std::vector<ResourceSample> samples;
+	MakeDirectory(fs::path(csv).parent_path().string());
+	std::ofstream output(csv);
+	output << "time_s,rss_kib,cpu_percent,threads,read_bytes,write_bytes,voluntary_switches,involuntary_switches\n";
+
+	interval = std::max<size_t>(interval, 1);
+	long ticks_per_second = sysconf(_SC_CLK_TCK);
+#ifdef SYS_pidfd_open
+	int pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+	int pidfd = -1;
+#endif
+	auto begin = std::chrono::steady_clock::now();
+	ProcessReading last;
+	do {
+		ProcessReading reading;
+		if (!ReadProcess(pid, reading)) {
+			continue;
+		}
+		ResourceSample &sample = reading.sample;
+		sample.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		if (!samples.empty() && sample.time > samples.back().time) {
+			sample.cpu = (reading.cpu_ticks - last.cpu_ticks) * 100.0 / ticks_per_second / (sample.time - samples.back().time);
+		}
+		char line[256];
+		snprintf(line, sizeof(line), "%.3f,%lld,%.1f,%d,%llu,%llu,%llu,%llu\n", sample.time, (long long)sample.rss, sample.cpu,
+			sample.threads, (unsigned long long)sample.read_bytes, (unsigned long long)sample.write_bytes,
+			(unsigned long long)sample.voluntary_switches, (unsigned long long)sample.involuntary_switches);
+		// flushed each time, a soak test killed keeps what it sampled
+		output << line << std::flush;
+		samples.push_back(sample);
+		last = reading;
+	} while (!WaitForExit(pid, pidfd, interval));
+
+	if (pidfd >= 0) {
+		close(pidfd);
+	}
+	return samples;
+}
+
+/// Eight levels of block characters from the least to the most of `values`,
+/// the most of each column when there are more values than columns.
+static
+std::string Sparkline(const std::vector<double> &values)
+{
+	static const char *blocks[] = { "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█" };
+	if (values.empty()) {
+		return "";
+	}
+	size_t width = std::min<size_t>(values.size(), SPARKLINE_WIDTH);
+	std::vector<double> columns(width, 0);
+	for (size_t i = 0; i < values.size(); i++) {
+		double &column = columns[i * width / values.size()];
+		column = std::max(column, values[i]);
+	}
+	auto range = std::minmax_element(columns.begin(), columns.end());
+	double low = *range.first, high = *range.second;
+	std::string line;
+	for (double column : columns) {
+		int level = high > low ? (int)((column - low) / (high - low) * 7 + 0.5) : 0;
+		line += blocks[level];
+	}
+	return line + std::string(SPARKLINE_WIDTH - width, ' ');
+}
+
+/// Per second change of a counter between two samples.
+static
+std::vector<double> Rates(const std::vector<ResourceSample> &samples, const std::function<uint64_t(const ResourceSample &)> &counter)
+{
+	std::vector<double> rates;
+	for (size_t i = 1; i < samples.size(); i++) {
+		double seconds = samples[i].time - samples[i - 1].time;
+		// the switches of the threads exited are gone
+		double change = counter(samples[i]) >= counter(samples[i - 1]) ? counter(samples[i]) - counter(samples[i - 1]) : 0.0;
+		rates.push_back(seconds > 0 ? change / seconds : 0);
+	}
+	return rates;
+}
+
+void PrintResourceSummary(const std::vector<ResourceSample> &samples)
+{
+	if (samples.empty()) {
+		return;
+	}
+	std::vector<double> rss, cpu, threads;
+	for (const ResourceSample &sample : samples) {
+		rss.push_back(sample.rss * 1024.0);
+		cpu.push_back(sample.cpu);
+		threads.push_back(sample.threads);
+	}
+	auto most = [](const std::vector<double> &values) {
+		return values.empty() ? 0.0 : *std::max_element(values.begin(), values.end());
+	};
+	auto least = [](const std::vector<double> &values) {
+		return values.empty() ? 0.0 : *std::min_element(values.begin(), values.end());
+	};
+	const ResourceSample &first = samples.front(), &end = samples.back();
+	double cpu_mean = 0;
+	for (size_t i = 1; i < cpu.size(); i++) {
+		cpu_mean += cpu[i] / (cpu.size() - 1);
+	}
+	std::vector<double> reads = Rates(samples, [](const ResourceSample &sample) { return sample.read_bytes; });
+	std::vector<double> writes = Rates(samples, [](const ResourceSample &sample) { return sample.write_bytes; });
+	std::vector<double> voluntary = Rates(samples, [](const ResourceSample &sample) { return sample.voluntary_switches; });
+	std::vector<double> involuntary = Rates(samples, [](const ResourceSample &sample) { return sample.involuntary_switches; });
+
+	printf("%-12s %s  %s .. %s, last %s\n", "RSS", Sparkline(rss).c_str(), FormatBytes(least(rss)).c_str(), FormatBytes(most(rss)).c_str(), FormatBytes(rss.back()).c_str());
+	printf("%-12s %s  mean %.1f%%, max %.1f%%\n", "CPU", Sparkline(std::vector<double>(cpu.begin() + 1, cpu.end())).c_str(), cpu_mean, most(cpu));
+	printf("%-12s %s  %.0f .. %.0f\n", "Threads", Sparkline(threads).c_str(), least(threads), most(threads));
+	printf("%-12s %s  %s, max %s/s\n", "Read", Sparkline(reads).c_str(), FormatBytes(end.read_bytes - first.read_bytes).c_str(), FormatBytes(most(reads)).c_str());
+	printf("%-12s %s  %s, max %s/s\n", "Write", Sparkline(writes).c_str(), FormatBytes(end.write_bytes - first.write_bytes).c_str(), FormatBytes(most(writes)).c_str());
+	printf("%-12s %s  %s, max %s/s\n", "Voluntary", Sparkline(voluntary).c_str(), FormatCount(end.voluntary_switches).c_str(), FormatCount(most(voluntary)).c_str());
+	printf("%-12s %s  %s, max %s/s\n", "Involuntary", Sparkline(involuntary).c_str(), FormatCount(end.involuntary_switches).c_str(), FormatCount(most(involuntary)).c_str());
+}
@@ -0,0 +1,492 @@
+/// Heap profiler of `cake run --heap-profile`, preloaded into the binary run.
+///
+/// It replaces malloc, calloc, realloc, the aligned allocations, free, and
+/// operator new and delete, which forward to the next allocator loaded: the
+/// one of glibc, or one preloaded after the profiler, like jemalloc. Every
+/// allocation is counted, with its bytes and the bytes in use, whose peak is
+/// kept. One allocation every `CAKE_HEAP_PROFILE_INTERVAL` bytes on average
+/// records its call stack, weighted by the bytes it stands for, 0 records
+/// none.
+///
+/// At exit, the process writes `<CAKE_HEAP_PROFILE>.<pid>`:
+///
+///     cake-heap-profile 1
+///     interval <bytes>
+///     allocations <count>
+///     frees <count>
+///     bytes <allocated>
+///     peak <bytes in use>
+///     lost <samples without room for their stack>
+///     site <allocations> <bytes> <binary> <address> ...
+///
+/// Sites list their frames callers last, addresses as linked in the binary,
+/// one before the return address so they point into the call.
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <limits.h>
+#include <link.h>
+#include <malloc.h>
+#include <new>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define HEAP_PROFILE_ENV "CAKE_HEAP_PROFILE"
+#define HEAP_PROFILE_INTERVAL_ENV "CAKE_HEAP_PROFILE_INTERVAL"
+
+/// Frames kept of a stack.
+#define HEAP_STACK_DEPTH 32
+
+/// Distinct stacks kept, the ones beyond are counted as lost.
+#define HEAP_SITES 8192
+
+/// What dlsym allocates while the next allocator is looked up.
+#define HEAP_BOOTSTRAP_SIZE 65536
+
+namespace {
+
+/// The allocator the profiler forwards to.
+struct Allocator {
+	void *(*malloc)(size_t);
+	void *(*calloc)(size_t, size_t);
+	void *(*realloc)(void *, size_t);
+	void *(*memalign)(size_t, size_t);
+	void (*free)(void *);
+};
+
+Allocator next;
+int resolving = 0;
+
+alignas(16) char bootstrap[HEAP_BOOTSTRAP_SIZE];
+size_t bootstrap_used = 0;
+
+void *BootstrapAllocate(size_t size)
+{
+	size = (size + 15) & ~(size_t)15;
+	if (bootstrap_used + size > sizeof(bootstrap)) {
+		return nullptr;
+	}
+	void *pointer = bootstrap + bootstrap_used;
+	bootstrap_used += size;
+	return pointer;
+}
+
+bool IsBootstrap(void *pointer)
+{
+	return pointer >= (void *)bootstrap && pointer < (void *)(bootstrap + sizeof(bootstrap));
+}
+
+/// Look the next allocator up, false while looking it up.
+bool Resolve()
+{
+	if (next.free) {
+		return true;
+	}
+	if (resolving) {
+		return false;
+	}
+	resolving = 1;
+	next.malloc = (void *(*)(size_t))dlsym(RTLD_NEXT, "malloc");
+	next.calloc = (void *(*)(size_t, size_t))dlsym(RTLD_NEXT, "calloc");
+	next.realloc = (void *(*)(void *, size_t))dlsym(RTLD_NEXT, "realloc");
+	next.memalign = (void *(*)(size_t, size_t))dlsym(RTLD_NEXT, "memalign");
+	if (next.memalign == nullptr) {
+		next.memalign = (void *(*)(size_t, size_t))dlsym(RTLD_NEXT, "aligned_alloc");
+	}
+	__atomic_store_n(&next.free, (void (*)(void *))dlsym(RTLD_NEXT, "free"), __ATOMIC_RELEASE);
+	resolving = 0;
+	return true;
+}
+
+struct Site {
+	uint64_t hash;
+	int depth;
+	void *frames[HEAP_STACK_DEPTH];
+	uint64_t allocations; ///< estimated
+	uint64_t bytes; ///< estimated
+};
+
+Site sites[HEAP_SITES];
+volatile int sites_lock = 0;
+uint64_t lost_samples = 0;
+
+uint64_t allocations = 0;
+uint64_t frees = 0;
+uint64_t allocated = 0;
+int64_t in_use = 0;
+int64_t peak = 0;
+
+/// 0 until the environment is read, or to record no stacks
+uint64_t interval = 0;
+
+/// Set while the profiler itself runs, its allocations are not profiled.
+__thread int busy __attribute__((tls_model("initial-exec")));
+
+/// Bytes left before the next sample of this thread.
+__thread int64_t until_sample __attribute__((tls_model("initial-exec")));
+
+void Lock()
+{
+	while (__atomic_exchange_n(&sites_lock, 1, __ATOMIC_ACQUIRE)) {
+		while (__atomic_load_n(&sites_lock, __ATOMIC_RELAXED)) {
+		}
+	}
+}
+
+void Unlock()
+{
+	__atomic_store_n(&sites_lock, 0, __ATOMIC_RELEASE);
+}
+
+void Record(void **frames, int depth, uint64_t count, uint64_t bytes)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (int i = 0; i < depth; ++i) {
+		hash = (hash ^ (uint64_t)(uintptr_t)frames[i]) * 1099511628211ULL;
+	}
+	Lock();
+	for (size_t probe = 0; probe < HEAP_SITES; ++probe) {
+		Site &site = sites[(hash + probe) % HEAP_SITES];
+		if (site.depth == 0) {
+			site.hash = hash;
+			site.depth = depth;
+			memcpy(site.frames, frames, depth * sizeof(void *));
+		} else if (site.hash != hash || site.depth != depth || memcmp(site.frames, frames, depth * sizeof(void *)) != 0) {
+			continue;
+		}
+		site.allocations += count;
+		site.bytes += bytes;
+		Unlock();
+		return;
+	}
+	lost_samples++;
+	Unlock();
+}
+
+void OnAllocate(void *pointer)
+{
+	if (pointer == nullptr || busy) {
+		return;
+	}
+	int64_t size = (int64_t)malloc_usable_size(pointer);
+	__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&allocated, size, __ATOMIC_RELAXED);
+	int64_t now = __atomic_add_fetch(&in_use, size, __ATOMIC_RELAXED);
+	int64_t high = __atomic_load_n(&peak, __ATOMIC_RELAXED);
+	while (now > high && !__atomic_compare_exchange_n(&peak, &high, now, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+
+	uint64_t every = __atomic_load_n(&interval, __ATOMIC_RELAXED);
+	if (every == 0) {
+		return;
+	}
+	until_sample -= size;
+	if (until_sample > 0) {
+		return;
+	}
+	// an allocation of a sample stands for `every` bytes, a larger one for itself
+	uint64_t bytes = (uint64_t)size > every ? (uint64_t)size : every;
+	until_sample += every;
+	if (until_sample <= 0) {
+		until_sample = every;
+	}
+	busy = 1;
+	// the frames of the profiler are left out when written
+	void *frames[HEAP_STACK_DEPTH];
+	int depth = backtrace(frames, HEAP_STACK_DEPTH);
+	if (depth > 0) {
+		Record(frames, depth, (bytes + size / 2) / (size > 0 ? size : 1), bytes);
+	}
+	busy = 0;
+}
+
+void OnFree(void *pointer)
+{
+	if (pointer == nullptr || busy || IsBootstrap(pointer)) {
+		return;
+	}
+	__atomic_add_fetch(&frees, 1, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&in_use, (int64_t)malloc_usable_size(pointer), __ATOMIC_RELAXED);
+}
+
+/// The loaded binary of an address, and its load bias.
+struct Object {
+	uintptr_t address;
+	const char *name;
+	uintptr_t bias;
+};
+
+int FindObject(struct dl_phdr_info *info, size_t, void *data)
+{
+	Object *object = (Object *)data;
+	for (int i = 0; i < info->dlpi_phnum; ++i) {
+		const ElfW(Phdr) &segment = info->dlpi_phdr[i];
+		uintptr_t start = info->dlpi_addr + segment.p_vaddr;
+		if (segment.p_type == PT_LOAD && object->address >= start && object->address < start + segment.p_memsz) {
+			object->name = info->dlpi_name;
+			object->bias = info->dlpi_addr;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+__attribute__((constructor))
+void Start()
+{
+	busy = 1;
+	Resolve();
+	const char *every = getenv(HEAP_PROFILE_INTERVAL_ENV);
+	// the first backtrace loads the unwinder
+	void *frames[1];
+	backtrace(frames, 1);
+	__atomic_store_n(&interval, every ? strtoull(every, nullptr, 10) : 64 * 1024, __ATOMIC_RELAXED);
+	busy = 0;
+}
+
+__attribute__((destructor))
+void Finish()
+{
+	const char *prefix = getenv(HEAP_PROFILE_ENV);
+	if (prefix == nullptr) {
+		return;
+	}
+	busy = 1;
+	char file[PATH_MAX];
+	snprintf(file, sizeof(file), "%s.%d", prefix, (int)getpid());
+	FILE *output = fopen(file, "w");
+	if (output == nullptr) {
+		fprintf(stderr, "cake heap profiler: could not write %s: %s\n", file, strerror(errno));
+		return;
+	}
+	char executable[PATH_MAX];
+	ssize_t length = readlink("/proc/self/exe", executable, sizeof(executable) - 1);
+	executable[length > 0 ? length : 0] = '\0';
+	Dl_info self;
+	dladdr((void *)&Finish, &self);
+
+	fprintf(output, "cake-heap-profile 1\n");
+	fprintf(output, "interval %llu\n", (unsigned long long)interval);
+	fprintf(output, "allocations %llu\n", (unsigned long long)__atomic_load_n(&allocations, __ATOMIC_RELAXED));
+	fprintf(output, "frees %llu\n", (unsigned long long)__atomic_load_n(&frees, __ATOMIC_RELAXED));
+	fprintf(output, "bytes %llu\n", (unsigned long long)__atomic_load_n(&allocated, __ATOMIC_RELAXED));
+	fprintf(output, "peak %lld\n", (long long)__atomic_load_n(&peak, __ATOMIC_RELAXED));
+	fprintf(output, "lost %llu\n", (unsigned long long)lost_samples);
+	Lock();
+	for (const Site &site : sites) {
+		if (site.depth == 0) {
+			continue;
+		}
+		fprintf(output, "site %llu %llu", (unsigned long long)site.allocations, (unsigned long long)site.bytes);
+		for (int i = 0; i < site.depth; ++i) {
+			Object object = { (uintptr_t)site.frames[i] - 1, nullptr, 0 };
+			if (!dl_iterate_phdr(FindObject, &object)) {
+				fprintf(output, " - %llx", (unsigned long long)object.address);
+				continue;
+			}
+			const char *name = object.name && object.name[0] ? object.name : executable;
+			// the frames of the profiler, like malloc and operator new
+			if (self.dli_fname && strcmp(name, self.dli_fname) == 0) {
+				continue;
+			}
+			fprintf(output, " %s %llx", name, (unsigned long long)(object.address - object.bias));
+		}
+		fprintf(output, "\n");
+	}
+	Unlock();
+	fclose(output);
+}
+
+} // namespace
+
+extern "C" {
+
+void *malloc(size_t size)
+{
+	if (!Resolve()) {
+		return BootstrapAllocate(size);
+	}
+	void *pointer = next.malloc(size);
+	OnAllocate(pointer);
+	return pointer;
+}
+
+void *calloc(size_t count, size_t size)
+{
+	if (!Resolve()) {
+		// never used, zeroed
+		return count == 0 || size <= SIZE_MAX / count ? BootstrapAllocate(count * size) : nullptr;
+	}
+	void *pointer = next.calloc(count, size);
+	OnAllocate(pointer);
+	return pointer;
+}
+
+void *realloc(void *pointer, size_t size)
+{
+	if (!Resolve() || IsBootstrap(pointer)) {
+		void *moved = malloc(size);
+		if (moved != nullptr && pointer != nullptr) {
+			size_t left = bootstrap + sizeof(bootstrap) - (char *)pointer;
+			memcpy(moved, pointer, size < left ? size : left);
+		}
+		return moved;
+	}
+	OnFree(pointer);
+	void *moved = next.realloc(pointer, size);
+	if (moved == nullptr && size > 0 && pointer != nullptr) {
+		// still allocated
+		__atomic_sub_fetch(&frees, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&in_use, (int64_t)malloc_usable_size(pointer), __ATOMIC_RELAXED);
+		return nullptr;
+	}
+	OnAllocate(moved);
+	return moved;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+	if (!Resolve()) {
+		return alignment <= 16 ? BootstrapAllocate(size) : nullptr;
+	}
+	void *pointer = next.memalign(alignment, size);
+	OnAllocate(pointer);
+	return pointer;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	return memalign(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+	return memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+int posix_memalign(void **result, size_t alignment, size_t size)
+{
+	if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+		return EINVAL;
+	}
+	void *pointer = memalign(alignment, size);
+	if (pointer == nullptr) {
+		return ENOMEM;
+	}
+	*result = pointer;
+	return 0;
+}
+
+void free(void *pointer)
+{
+	if (pointer == nullptr || IsBootstrap(pointer)) {
+		return;
+	}
+	OnFree(pointer);
+	Resolve();
+	next.free(pointer);
+}
+
+} // extern "C"
+
+void *operator new(size_t size)
+{
+	void *pointer = malloc(size ? size : 1);
+	if (pointer == nullptr) {
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+	return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+	return malloc(size ? size : 1);
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+	void *pointer = memalign((size_t)alignment, size ? size : 1);
+	if (pointer == nullptr) {
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+void *operator new[](size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+	return memalign((size_t)alignment, size ? size : 1);
+}
+
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+	return memalign((size_t)alignment, size ? size : 1);
+}
+
+void operator delete(void *pointer) noexcept
+{
+	free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+	free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+	free(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept
+{
+	free(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept
+{
+	free(pointer);
+}
+
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept
+{
+	free(pointer);
+}
+
+void operator delete(void *pointer, std::align_val_t) noexcept
+{
+	free(pointer);
+}
+
+void operator delete[](void *pointer, std::align_val_t) noexcept
+{
+	free(pointer);
+}
+
+void operator delete(void *pointer, size_t, std::align_val_t) noexcept
+{
+	free(pointer);
+}
+
+void operator delete[](void *pointer, size_t, std::align_val_t) noexcept
+{
+	free(pointer);
+}
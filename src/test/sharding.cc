@@ -0,0 +1,464 @@
+#include "test/sharding.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "utility/common.h"
+#include "utility/json.h"
+
+namespace fs = std::filesystem;
+
+/// Longer filters don't fit in one argument, shard through the environment instead.
+#define MAX_FILTER_SIZE (100 * 1024)
+
+TestFramework DetectTestFramework(const std::string &build_directory, const Target &target)
+{
+	std::vector<std::string> names;
+	if (target.contains("link") && target["link"].contains("commandFragments")) {
+		for (const auto &fragment : target["link"]["commandFragments"]) {
+			names.push_back(fragment["fragment"]);
+		}
+	}
+	// `gtest_main::@6890427a1f51a3e7e1df` when built in the project
+	if (target.contains("dependencies")) {
+		for (const auto &dependency : target["dependencies"]) {
+			names.push_back(dependency["id"]);
+		}
+	}
+
+	for (std::string name : names) {
+		std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+		if (name.find("gtest") != std::string::npos || name.find("gmock") != std::string::npos) {
+			return TestFramework::kGoogleTest;
+		}
+		if (name.find("catch2") != std::string::npos) {
+			return TestFramework::kCatch2;
+		}
+	}
+
+	// header only Catch2 links nothing, look for the options the framework parses,
+	// `--list-test-names-only` of v2, `--list-reporters` of v2 and v3
+	if (target.contains("artifacts") && !target["artifacts"].empty()) {
+		std::string binary = (fs::path(build_directory) / target["artifacts"][0]["path"].get<std::string>()).string();
+		switch (FindInFile(binary, { "gtest_list_tests", "list-test-names-only", "list-reporters" })) {
+		case 0:
+			return TestFramework::kGoogleTest;
+		case 1:
+		case 2:
+			return TestFramework::kCatch2;
+		default:
+			break;
+		}
+	}
+	return TestFramework::kNone;
+}
+
+static
+std::string FileNameOf(const std::string &name)
+{
+	std::string file = name;
+	for (char &c : file) {
+		if (!isalnum((unsigned char)c) && c != '-' && c != '_' && c != '.') {
+			c = '_';
+		}
+	}
+	return file;
+}
+
+/// Run the test binary with `extra_args` and collect what it prints.
+static
+bool CaptureTestOutput(const TestCase &test, const std::vector<std::string> &extra_args, const std::string &file, std::string &output)
+{
+	ProcessOptions process;
+	process.working_directory = test.working_directory;
+	process.environment = test.environment;
+	process.output_file = file;
+
+	std::vector<std::string> args = test.command;
+	args.insert(args.end(), extra_args.begin(), extra_args.end());
+	WaitCmd(SpawnCmd(args[0], args, process));
+	return ReadFileContent(file, output);
+}
+
+/// `--gtest_list_tests` prints `Suite.` lines followed by indented cases,
+/// parameterized ones with a trailing `# GetParam() = ...` comment.
+static
+std::vector<std::string> ParseGoogleTestList(const std::string &output)
+{
+	std::vector<std::string> cases;
+	std::stringstream ss(output);
+	std::string line, suite;
+	while (std::getline(ss, line)) {
+		size_t comment = line.find("  #");
+		if (comment != std::string::npos) {
+			line.erase(comment);
+		}
+		while (!line.empty() && isspace((unsigned char)line.back())) {
+			line.pop_back();
+		}
+		if (line.empty()) {
+			continue;
+		}
+		if (line[0] != ' ') {
+			suite = line.back() == '.' ? line : "";
+		} else if (!suite.empty()) {
+			cases.push_back(suite + line.substr(line.find_first_not_of(' ')));
+		}
+	}
+	return cases;
+}
+
+static
+std::vector<std::string> SplitLines(const std::string &output)
+{
+	std::vector<std::string> lines;
+	std::stringstream ss(output);
+	std::string line;
+	while (std::getline(ss, line)) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (!line.empty()) {
+			lines.push_back(line);
+		}
+	}
+	return lines;
+}
+
+static
+std::vector<std::string> ListCases(const TestCase &test, TestFramework framework, const std::string &file)
+{
+	std::string output;
+	if (framework == TestFramework::kGoogleTest) {
+		CaptureTestOutput(test, { "--gtest_list_tests" }, file, output);
+		return ParseGoogleTestList(output);
+	}
+	// Catch2 v2, then v3 which dropped the option
+	CaptureTestOutput(test, { "--list-test-names-only" }, file, output);
+	if (output.find("Unrecognised") != std::string::npos || output.find("Error") != std::string::npos) {
+		output.clear();
+		CaptureTestOutput(test, { "--list-tests", "--verbosity", "quiet" }, file, output);
+	}
+	return SplitLines(output);
+}
+
+static
+bool SelectsCases(const TestCase &test, TestFramework framework)
+{
+	for (size_t i = 1; i < test.command.size(); ++i) {
+		const std::string &arg = test.command[i];
+		if (framework == TestFramework::kGoogleTest && arg.compare(0, 14, "--gtest_filter") == 0) {
+			return true;
+		}
+		// Catch2 takes test specs as positional arguments
+		if (framework == TestFramework::kCatch2 && (arg[0] != '-' || arg == "-f" || arg == "--input-file")) {
+			return true;
+		}
+	}
+	for (const std::string &variable : test.environment) {
+		if (variable.compare(0, 13, "GTEST_FILTER=") == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/// Longest processing time first: the costliest case goes to the least
+/// loaded shard. Cases never timed cost the mean of the timed ones.
+static
+std::vector<std::vector<std::string>> PartitionCases(const std::vector<std::string> &cases, size_t count, const CaseDurations &durations)
+{
+	double total = 0;
+	size_t timed = 0;
+	for (const std::string &name : cases) {
+		auto it = durations.find(name);
+		if (it != durations.end()) {
+			total += it->second;
+			timed++;
+		}
+	}
+	double fallback = timed > 0 ? total / timed : 1;
+	auto cost = [&](const std::string &name) {
+		auto it = durations.find(name);
+		return it == durations.end() ? fallback : it->second;
+	};
+
+	std::vector<std::string> order = cases;
+	std::stable_sort(order.begin(), order.end(), [&](const std::string &a, const std::string &b) {
+		return cost(a) > cost(b);
+	});
+
+	std::vector<std::vector<std::string>> shards(count);
+	std::vector<double> load(count, 0);
+	for (const std::string &name : order) {
+		size_t lightest = std::min_element(load.begin(), load.end()) - load.begin();
+		shards[lightest].push_back(name);
+		load[lightest] += cost(name);
+	}
+	shards.erase(std::remove_if(shards.begin(), shards.end(), [](const std::vector<std::string> &shard) {
+		return shard.empty();
+	}), shards.end());
+	return shards;
+}
+
+/// Catch2 test specs treat these characters specially.
+static
+std::string EscapeCatch2Name(const std::string &name)
+{
+	std::string escaped;
+	for (char c : name) {
+		if (c == '\\' || c == ',' || c == '[' || c == ']' || c == '*' || c == '"' || c == '~') {
+			escaped += '\\';
+		}
+		escaped += c;
+	}
+	return escaped;
+}
+
+bool ShardTest(const TestCase &test, TestFramework framework, size_t count, const CaseDurations &durations, const std::string &report_directory, ShardedTest &sharded)
+{
+	if (framework == TestFramework::kNone || test.command.empty() || SelectsCases(test, framework)) {
+		return false;
+	}
+
+	MakeDirectory(report_directory);
+	std::string base = fs::absolute(report_directory + "/" + FileNameOf(test.name)).string();
+	std::vector<std::string> cases = ListCases(test, framework, base + ".list");
+	count = std::min(count, cases.size());
+	if (count < 2) {
+		return false;
+	}
+
+	sharded.name = test.name;
+	sharded.framework = framework;
+	sharded.merged_report = base + ".xml";
+
+	std::vector<std::vector<std::string>> partition = PartitionCases(cases, count, durations);
+	bool native = false;
+	if (framework == TestFramework::kGoogleTest) {
+		size_t longest = 0;
+		for (const auto &shard : partition) {
+			size_t size = 0;
+			for (const std::string &name : shard) {
+				size += name.size() + 1;
+			}
+			longest = std::max(longest, size);
+		}
+		native = durations.empty() || longest > MAX_FILTER_SIZE;
+	}
+
+	size_t shards = native ? count : partition.size();
+	for (size_t i = 0; i < shards; ++i) {
+		TestCase shard = test;
+		shard.name = test.name + "#" + std::to_string(i + 1) + "/" + std::to_string(shards);
+		std::string report = base + ".shard-" + std::to_string(i) + ".xml";
+		fs::remove(report);
+
+		if (framework == TestFramework::kGoogleTest) {
+			if (native) {
+				shard.environment.push_back("GTEST_TOTAL_SHARDS=" + std::to_string(shards));
+				shard.environment.push_back("GTEST_SHARD_INDEX=" + std::to_string(i));
+			} else {
+				std::string filter;
+				for (const std::string &name : partition[i]) {
+					filter += filter.empty() ? name : ":" + name;
+				}
+				shard.command.push_back("--gtest_filter=" + filter);
+			}
+			shard.command.push_back("--gtest_output=xml:" + report);
+		} else {
+			// names go through a file, there may be thousands of them
+			std::string names;
+			for (const std::string &name : partition[i]) {
+				names += EscapeCatch2Name(name) + "\n";
+			}
+			std::string input = base + ".shard-" + std::to_string(i) + ".txt";
+			std::ofstream(input) << names;
+			shard.command.insert(shard.command.end(), { "--input-file", input, "-r", "junit", "-o", report });
+		}
+
+		sharded.shards.push_back(shard);
+		sharded.reports.push_back(report);
+	}
+
+	return true;
+}
+
+////////////////////// Reports /////////////////////////////////
+
+static
+std::string XmlEscape(const std::string &s)
+{
+	std::string result;
+	for (char c : s) {
+		switch (c) {
+		case '&':
+			result += "&amp;";
+			break;
+		case '<':
+			result += "&lt;";
+			break;
+		case '>':
+			result += "&gt;";
+			break;
+		case '"':
+			result += "&quot;";
+			break;
+		default:
+			result += c;
+		}
+	}
+	return result;
+}
+
+static
+std::string XmlUnescape(const std::string &s)
+{
+	static const std::vector<std::pair<std::string, std::string>> entities{
+		{ "&lt;", "<" }, { "&gt;", ">" }, { "&quot;", "\"" }, { "&apos;", "'" }, { "&amp;", "&" }
+	};
+	std::string result;
+	for (size_t i = 0; i < s.size(); ++i) {
+		bool replaced = false;
+		if (s[i] == '&') {
+			for (const auto &entity : entities) {
+				if (s.compare(i, entity.first.size(), entity.first) == 0) {
+					result += entity.second;
+					i += entity.first.size() - 1;
+					replaced = true;
+					break;
+				}
+			}
+		}
+		if (!replaced) {
+			result += s[i];
+		}
+	}
+	return result;
+}
+
+static
+std::string XmlAttribute(const std::string &tag, const std::string &name)
+{
+	std::string key = " " + name + "=\"";
+	size_t begin = tag.find(key);
+	if (begin == std::string::npos) {
+		return "";
+	}
+	begin += key.size();
+	size_t end = tag.find('"', begin);
+	return XmlUnescape(tag.substr(begin, end - begin));
+}
+
+/// Elements `<name ...>...</name>` or `<name .../>`, but not `<names ...>`.
+static
+std::vector<std::string> XmlElements(const std::string &xml, const std::string &name, bool tag_only)
+{
+	std::vector<std::string> elements;
+	std::string open = "<" + name;
+	std::string close = "</" + name + ">";
+	for (size_t pos = 0; (pos = xml.find(open, pos)) != std::string::npos;) {
+		char next = pos + open.size() < xml.size() ? xml[pos + open.size()] : '\0';
+		if (next != ' ' && next != '>' && next != '/' && next != '\n' && next != '\t') {
+			pos += open.size();
+			continue;
+		}
+		size_t tag_end = xml.find('>', pos);
+		if (tag_end == std::string::npos) {
+			break;
+		}
+		size_t end = tag_end + 1;
+		if (!tag_only && xml[tag_end - 1] != '/') {
+			size_t close_pos = xml.find(close, tag_end);
+			end = close_pos == std::string::npos ? xml.size() : close_pos + close.size();
+		}
+		elements.push_back(xml.substr(pos, end - pos));
+		pos = end;
+	}
+	return elements;
+}
+
+bool MergeShardReports(const ShardedTest &sharded, CaseDurations &durations)
+{
+	std::string suites;
+	unsigned long tests = 0, failures = 0, errors = 0, skipped = 0;
+	double time = 0;
+	bool complete = true;
+
+	for (const std::string &report : sharded.reports) {
+		std::string xml;
+		if (!ReadFileContent(report, xml)) {
+			// the shard crashed before writing its report
+			complete = false;
+			continue;
+		}
+
+		double shard_time = 0;
+		for (const std::string &suite : XmlElements(xml, "testsuite", false)) {
+			std::string tag = suite.substr(0, suite.find('>') + 1);
+			tests += strtoul(XmlAttribute(tag, "tests").c_str(), nullptr, 10);
+			failures += strtoul(XmlAttribute(tag, "failures").c_str(), nullptr, 10);
+			errors += strtoul(XmlAttribute(tag, "errors").c_str(), nullptr, 10);
+			skipped += strtoul(XmlAttribute(tag, "skipped").c_str(), nullptr, 10) + strtoul(XmlAttribute(tag, "disabled").c_str(), nullptr, 10);
+			shard_time += atof(XmlAttribute(tag, "time").c_str());
+			suites += "  " + suite + "\n";
+		}
+		// shards run side by side
+		time = std::max(time, shard_time);
+
+		for (const std::string &testcase : XmlElements(xml, "testcase", true)) {
+			std::string name = XmlAttribute(testcase, "name");
+			if (sharded.framework == TestFramework::kGoogleTest) {
+				name = XmlAttribute(testcase, "classname") + "." + name;
+			}
+			durations[name] = atof(XmlAttribute(testcase, "time").c_str());
+		}
+	}
+
+	std::stringstream merged;
+	merged << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		<< "<testsuites name=\"" << XmlEscape(sharded.name) << "\" tests=\"" << tests << "\" failures=\"" << failures
+		<< "\" errors=\"" << errors << "\" skipped=\"" << skipped << "\" time=\"" << time << "\">\n"
+		<< suites
+		<< "</testsuites>\n";
+	std::ofstream output(sharded.merged_report);
+	output << merged.str();
+
+	return complete;
+}
+
+std::unordered_map<std::string, CaseDurations> ReadCaseDurations(const std::string &file)
+{
+	using nlohmann::json;
+
+	std::unordered_map<std::string, CaseDurations> durations;
+	std::string content;
+	if (!ReadFileContent(file, content)) {
+		return durations;
+	}
+	json record = json::parse(content, nullptr, false);
+	if (!record.is_object()) {
+		return durations;
+	}
+	for (auto test = record.begin(); test != record.end(); ++test) {
+		if (!test.value().is_object()) {
+			continue;
+		}
+		for (auto item = test.value().begin(); item != test.value().end(); ++item) {
+			if (item.value().is_number()) {
+				durations[test.key()][item.key()] = item.value().get<double>();
+			}
+		}
+	}
+	return durations;
+}
+
+void WriteCaseDurations(const std::string &file, const std::unordered_map<std::string, CaseDurations> &durations)
+{
+	nlohmann::json record = durations;
+	MakeDirectory(fs::path(file).parent_path().string());
+	std::ofstream output(file);
+	output << record.dump(1, '\t');
+}
@@ -0,0 +1,211 @@
+#include "test/test_cache.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <regex>
+#include <set>
+
+#include "utility/common.h"
+#include "utility/json.h"
+
+extern char **environ;
+
+namespace fs = std::filesystem;
+
+/// Bump when the key changes meaning, so old entries miss.
+#define TEST_CACHE_VERSION "cake-test-cache-1"
+
+TestCache ReadTestCache(const std::string &file)
+{
+	using nlohmann::json;
+
+	TestCache cache;
+	std::string content;
+	if (!ReadFileContent(file, content)) {
+		return cache;
+	}
+	json record = json::parse(content, nullptr, false);
+	if (!record.is_object()) {
+		return cache;
+	}
+	for (auto it = record.begin(); it != record.end(); ++it) {
+		const json &entry = it.value();
+		if (entry.contains("key") && entry["key"].is_string() && entry.contains("duration") && entry["duration"].is_number()) {
+			cache[it.key()] = { entry["key"].get<std::string>(), entry["duration"].get<double>() };
+		}
+	}
+	return cache;
+}
+
+void WriteTestCache(const std::string &file, const TestCache &cache)
+{
+	nlohmann::json record = nlohmann::json::object();
+	for (const auto &item : cache) {
+		record[item.first] = { { "key", item.second.key }, { "duration", item.second.duration } };
+	}
+	MakeDirectory(fs::path(file).parent_path().string());
+	std::ofstream output(file);
+	output << record.dump(1, '\t');
+}
+
+static
+std::string ArtifactPath(const std::string &build_directory, const std::string &path)
+{
+	return fs::path(path).is_absolute() ? path : build_directory + "/" + path;
+}
+
+/// Target name of a dependency id, `core::@6890427a1f51a3e7e1df`.
+static
+std::string DependencyName(const std::string &id)
+{
+	return id.substr(0, id.find("::@"));
+}
+
+std::vector<std::string> RuntimeLibraries(const std::string &build_directory, const std::unordered_map<std::string, Target> &targets, const Target &target)
+{
+	static const std::regex shared_library(R"(\.(so|dylib)(\.[0-9]+)*$)");
+
+	std::set<std::string> libraries;
+	if (target.contains("link") && target["link"].contains("commandFragments")) {
+		for (const auto &fragment : target["link"]["commandFragments"]) {
+			std::string path = fragment["fragment"];
+			if (fragment["role"] == "libraries" && std::regex_search(path, shared_library)) {
+				libraries.insert(ArtifactPath(build_directory, path));
+			}
+		}
+	}
+
+	// shared library targets of the project, including transitive ones
+	std::vector<std::string> pending;
+	std::set<std::string> visited;
+	if (target.contains("dependencies")) {
+		for (const auto &dependency : target["dependencies"]) {
+			pending.push_back(DependencyName(dependency["id"]));
+		}
+	}
+	while (!pending.empty()) {
+		std::string name = pending.back();
+		pending.pop_back();
+		auto it = targets.find(name);
+		if (!visited.insert(name).second || it == targets.end()) {
+			continue;
+		}
+		const Target &dependency = it->second;
+		if ((dependency["type"] == "SHARED_LIBRARY" || dependency["type"] == "MODULE_LIBRARY") && dependency.contains("artifacts")) {
+			for (const auto &artifact : dependency["artifacts"]) {
+				libraries.insert(ArtifactPath(build_directory, artifact["path"]));
+			}
+		}
+		if (dependency.contains("dependencies")) {
+			for (const auto &next : dependency["dependencies"]) {
+				pending.push_back(DependencyName(next["id"]));
+			}
+		}
+	}
+	return std::vector<std::string>(libraries.begin(), libraries.end());
+}
+
+static
+uint64_t HashFile(const std::string &path, FileHashes &hashes)
+{
+	auto it = hashes.find(path);
+	if (it != hashes.end()) {
+		return it->second;
+	}
+	std::string content;
+	uint64_t hash = ReadFileContent(path, content) ? HashBytes(content) : 0;
+	hashes[path] = hash;
+	return hash;
+}
+
+/// The file an argument names, relative to the working directory of the
+/// test, or through `PATH` for the command itself. Empty if none.
+static
+std::string FileOfArgument(const std::string &argument, const std::string &working_directory, bool command)
+{
+	std::error_code ec;
+	if (argument.empty() || argument[0] == '-') {
+		return "";
+	}
+	if (command && argument.find('/') == std::string::npos) {
+		return FindProgram(argument);
+	}
+	fs::path candidate = fs::path(argument).is_absolute() ? fs::path(argument) : fs::path(working_directory) / argument;
+	return fs::is_regular_file(candidate, ec) ? candidate.string() : "";
+}
+
+/// Inherited variables most tests depend on, `PREFIX*` matches by prefix.
+/// Others, CI job ids and the like, change every run.
+static const std::vector<std::string> default_variables = {
+	"PATH", "LD_LIBRARY_PATH", "LD_PRELOAD", "LANG", "LC_*", "TZ", "TMPDIR",
+	"ASAN_OPTIONS", "LSAN_OPTIONS", "MSAN_OPTIONS", "TSAN_OPTIONS", "UBSAN_OPTIONS", "GTEST_*",
+};
+
+static
+bool MatchesVariable(const std::string &name, const std::vector<std::string> &patterns)
+{
+	for (const std::string &pattern : patterns) {
+		if (!pattern.empty() && pattern.back() == '*' ?
+			name.compare(0, pattern.size() - 1, pattern, 0, pattern.size() - 1) == 0 :
+			name == pattern) {
+			return true;
+		}
+	}
+	return false;
+}
+
+std::string TestCacheKey(const TestCase &test, const std::vector<std::string> &runtime_libraries, const std::vector<std::string> &variables, FileHashes &hashes)
+{
+	uint64_t hash = HashBytes(TEST_CACHE_VERSION);
+	auto field = [&hash](const std::string &value) {
+		hash = HashBytes(value, hash);
+		hash = HashBytes(std::string(1, '\0'), hash);
+	};
+	auto file = [&](const std::string &path) {
+		field(path);
+		field(HashToHex(HashFile(path, hashes)));
+	};
+
+	field("command");
+	for (size_t i = 0; i < test.command.size(); ++i) {
+		field(test.command[i]);
+		std::string path = FileOfArgument(test.command[i], test.working_directory, i == 0);
+		if (!path.empty()) {
+			file(path);
+		}
+	}
+	field("libraries");
+	for (const std::string &library : runtime_libraries) {
+		file(library);
+	}
+	field("required");
+	for (const std::string &required : test.required_files) {
+		file((fs::path(test.working_directory) / required).string());
+	}
+
+	field("properties");
+	field(test.working_directory);
+	field(std::to_string(test.timeout));
+	field(test.will_fail ? "will_fail" : "");
+	for (const std::string &variable : test.environment) {
+		field(variable);
+	}
+
+	// the test inherits the environment of cake
+	field("environment");
+	std::vector<std::string> inherited;
+	for (char **variable = environ; *variable != nullptr; ++variable) {
+		std::string entry = *variable;
+		std::string name = entry.substr(0, entry.find('='));
+		if (MatchesVariable(name, default_variables) || MatchesVariable(name, variables)) {
+			inherited.push_back(entry);
+		}
+	}
+	std::sort(inherited.begin(), inherited.end());
+	for (const std::string &variable : inherited) {
+		field(variable);
+	}
+
+	return HashToHex(hash);
+}
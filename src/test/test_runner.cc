@@ -0,0 +1,464 @@
+#include "test/test_runner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <list>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "utility/common.h"
+#include "utility/json.h"
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+/// Same as in `runtime/fork_server.h`.
+#define FORK_SERVER_ENV "CAKE_FORK_SERVER"
+
+/// A test executable initialized once, forking a child per test it is sent.
+struct ForkServer {
+	std::string key; ///< executable, working directory and environment it serves
+	pid_t pid;
+	int channel; ///< requests go out, replies come in
+	bool busy = false;
+	bool dead = false;
+	std::string replies; ///< read but not handled yet
+};
+
+/// A test occupying `processors` of the job budget.
+struct RunningTest {
+	size_t index; ///< into the tests
+	pid_t pid; ///< 0 until the fork server told the pid of its child
+	int pidfd; ///< -1 when the kernel lacks pidfd_open, polled instead
+	Clock::time_point start;
+	Clock::time_point deadline;
+	Clock::duration timeout; ///< 0 means none
+	size_t processors;
+	ForkServer *server = nullptr; ///< running in a child of it
+	bool killed = false; ///< past its deadline
+};
+
+std::unordered_map<std::string, double> ReadTestDurations(const std::string &file)
+{
+	using nlohmann::json;
+
+	std::unordered_map<std::string, double> durations;
+	std::string content;
+	if (!ReadFileContent(file, content)) {
+		return durations;
+	}
+	json record = json::parse(content, nullptr, false);
+	if (!record.is_object()) {
+		return durations;
+	}
+	for (auto it = record.begin(); it != record.end(); ++it) {
+		if (it.value().is_number()) {
+			durations[it.key()] = it.value().get<double>();
+		}
+	}
+	return durations;
+}
+
+void WriteTestDurations(const std::string &file, const std::unordered_map<std::string, double> &durations)
+{
+	nlohmann::json record = durations;
+	MakeDirectory(fs::path(file).parent_path().string());
+	std::ofstream output(file);
+	output << record.dump(1, '\t');
+}
+
+static
+std::string OutputFileOf(const std::string &output_directory, const std::string &name)
+{
+	std::string file = name;
+	for (char &c : file) {
+		if (!isalnum((unsigned char)c) && c != '-' && c != '_' && c != '.') {
+			c = '_';
+		}
+	}
+	return output_directory + "/" + file + ".log";
+}
+
+static
+const char *StatusName(TestStatus status)
+{
+	switch (status) {
+	case TestStatus::kPassed:
+		return "PASS";
+	case TestStatus::kFailed:
+		return "FAIL";
+	case TestStatus::kTimeout:
+		return "TIMEOUT";
+	case TestStatus::kCached:
+		return "CACHED";
+	default:
+		return "SKIP";
+	}
+}
+
+/// One line per test, the output of a failed test follows it.
+static
+void PrintTestResult(const TestResult &result, size_t done, size_t total)
+{
+	int width = std::to_string(total).size();
+	if (result.status == TestStatus::kNotRun) {
+		printf("[%*zu/%zu] %-7s %s (%s)\n", width, done, total, StatusName(result.status), result.name.c_str(), result.reason.c_str());
+	} else if (result.status == TestStatus::kCached) {
+		printf("[%*zu/%zu] %-7s %s (%.2fs when run)\n", width, done, total, StatusName(result.status), result.name.c_str(), result.duration);
+	} else {
+		printf("[%*zu/%zu] %-7s %s (%.2fs)\n", width, done, total, StatusName(result.status), result.name.c_str(), result.duration);
+	}
+	if (result.status == TestStatus::kFailed || result.status == TestStatus::kTimeout) {
+		std::string output;
+		ReadFileContent(result.output_file, output);
+		if (!output.empty()) {
+			fwrite(output.data(), 1, output.size(), stdout);
+			if (output.back() != '\n') {
+				printf("\n");
+			}
+		}
+	}
+	fflush(stdout);
+}
+
+static
+std::string MissingRequiredFile(const TestCase &test)
+{
+	for (const std::string &file : test.required_files) {
+		if (!fs::exists(fs::path(test.working_directory) / file)) {
+			return file;
+		}
+	}
+	return "";
+}
+
+/// Whether an executable includes the fork server shim, `support` remembers.
+static
+bool SupportsForkServer(const std::string &executable, std::unordered_map<std::string, bool> &support)
+{
+	auto it = support.find(executable);
+	if (it == support.end()) {
+		bool supported = FindInFile(executable, { FORK_SERVER_ENV }) == 0;
+		it = support.emplace(executable, supported).first;
+	}
+	return it->second;
+}
+
+/// A server runs the tests of one executable, working directory and environment.
+static
+std::string ForkServerKey(const TestCase &test)
+{
+	std::string key = test.command[0] + '\0' + test.working_directory;
+	for (const std::string &variable : test.environment) {
+		key += '\0' + variable;
+	}
+	return key;
+}
+
+/// Start `test` as a fork server, on the socket named by `CAKE_FORK_SERVER`.
+/// If the executable doesn't call the shim, it just runs `test`.
+static
+bool StartForkServer(const TestCase &test, const std::string &output_file, ForkServer &server)
+{
+	int sockets[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0) {
+		return false;
+	}
+	int child_socket = sockets[1];
+	ProcessOptions process;
+	process.working_directory = test.working_directory;
+	process.environment = test.environment;
+	process.environment.push_back(std::string(FORK_SERVER_ENV) + "=" + std::to_string(child_socket));
+	process.output_file = output_file;
+	process.process_group = true;
+	process.before_exec = [child_socket]() {
+		fcntl(child_socket, F_SETFD, 0);
+	};
+	server.pid = SpawnCmd(test.command[0], test.command, process);
+	server.channel = sockets[0];
+	close(child_socket);
+	return true;
+}
+
+static
+bool SendForkRequest(ForkServer &server, const TestCase &test, const std::string &output_file)
+{
+	std::string request = std::to_string(test.command.size()) + '\0' + output_file + '\0';
+	for (const std::string &argument : test.command) {
+		request += argument + '\0';
+	}
+	// a dead server must not kill us with SIGPIPE
+	for (size_t sent = 0; sent < request.size();) {
+		ssize_t n = send(server.channel, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+		if (n < 0 && errno != EINTR) {
+			return false;
+		}
+		sent += n > 0 ? n : 0;
+	}
+	return true;
+}
+
+/// Handle the replies of the server of `run` read so far. Returns whether the
+/// test exited, with its wait status and duration.
+static
+bool ReadForkReplies(RunningTest &run, int &wstatus, double &duration)
+{
+	ForkServer &server = *run.server;
+	char buffer[256];
+	ssize_t n;
+	while ((n = recv(server.channel, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) {
+		server.replies.append(buffer, n);
+	}
+	for (size_t end; (end = server.replies.find('\n')) != std::string::npos;) {
+		std::string reply = server.replies.substr(0, end);
+		server.replies.erase(0, end + 1);
+		int pid = 0;
+		long long nanoseconds = 0;
+		if (sscanf(reply.c_str(), "pid %d", &pid) == 1) {
+			// the timeout covers the test, not the startup of the server
+			run.pid = pid;
+			if (run.timeout.count() > 0) {
+				run.deadline = Clock::now() + run.timeout;
+			}
+		} else if (sscanf(reply.c_str(), "exit %d %lld", &wstatus, &nanoseconds) == 2) {
+			duration = nanoseconds / 1e9;
+			server.busy = false;
+			return true;
+		}
+	}
+	if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+		// the server died, or never was one and ran the test itself
+		if (run.pid > 0) {
+			kill(-run.pid, SIGKILL);
+		}
+		waitpid(server.pid, &wstatus, 0);
+		duration = std::chrono::duration<double>(Clock::now() - run.start).count();
+		server.dead = true;
+		return true;
+	}
+	return false;
+}
+
+std::vector<TestResult> RunTests(const std::vector<TestCase> &tests, const TestRunOptions &options)
+{
+	std::vector<TestResult> results(tests.size());
+	std::unordered_map<std::string, double> durations = ReadTestDurations(options.durations_file);
+	MakeDirectory(options.output_directory);
+	size_t jobs = std::max<size_t>(1, options.jobs);
+	size_t done = 0;
+
+	// never recorded tests first, they may be the longest
+	auto recorded = [&durations](const TestCase &test) {
+		auto it = durations.find(test.name);
+		return it == durations.end() ? std::numeric_limits<double>::infinity() : it->second;
+	};
+	std::vector<size_t> parallel, serial;
+	for (size_t i = 0; i < tests.size(); ++i) {
+		const TestCase &test = tests[i];
+		TestResult &result = results[i];
+		result.name = test.name;
+		result.output_file = fs::absolute(OutputFileOf(options.output_directory, test.name)).string();
+
+		std::string missing = MissingRequiredFile(test);
+		auto cached = options.cached.find(test.name);
+		if (test.disabled) {
+			result.reason = "disabled";
+		} else if (test.command.empty()) {
+			result.reason = "no command in this configuration";
+		} else if (!missing.empty()) {
+			result.reason = "required file " + missing + " is missing";
+		} else if (cached != options.cached.end()) {
+			result.status = TestStatus::kCached;
+			result.duration = cached->second;
+		} else {
+			(test.run_serial ? serial : parallel).push_back(i);
+			continue;
+		}
+		PrintTestResult(result, ++done, tests.size());
+	}
+	std::stable_sort(parallel.begin(), parallel.end(), [&](size_t a, size_t b) {
+		return recorded(tests[a]) > recorded(tests[b]);
+	});
+
+	std::vector<RunningTest> running;
+	std::list<ForkServer> servers;
+	std::unordered_map<std::string, bool> fork_server_support;
+	size_t busy = 0;
+	// an idle server of the executable, or a new one
+	auto fork_server = [&](const TestCase &test) -> ForkServer * {
+		std::string key = ForkServerKey(test);
+		for (ForkServer &server : servers) {
+			if (!server.busy && !server.dead && server.key == key) {
+				return &server;
+			}
+		}
+		servers.emplace_back();
+		ForkServer &server = servers.back();
+		server.key = key;
+		std::string output_file = fs::absolute(options.output_directory + "/fork-server-" + std::to_string(servers.size()) + ".log").string();
+		if (!StartForkServer(test, output_file, server)) {
+			servers.pop_back();
+			return nullptr;
+		}
+		return &server;
+	};
+	auto start = [&](size_t index) {
+		const TestCase &test = tests[index];
+		RunningTest run;
+		run.index = index;
+		run.processors = std::min(jobs, test.processors);
+		run.start = Clock::now();
+		double timeout = test.timeout > 0 ? test.timeout : options.timeout;
+		run.timeout = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(timeout));
+		run.deadline = timeout > 0 ? run.start + run.timeout : Clock::time_point::max();
+
+		if (options.fork_server && SupportsForkServer(test.command[0], fork_server_support)) {
+			ForkServer *server = fork_server(test);
+			if (server != nullptr && SendForkRequest(*server, test, results[index].output_file)) {
+				server->busy = true;
+				run.server = server;
+				run.pid = 0;
+				run.pidfd = -1;
+				running.push_back(run);
+				busy += run.processors;
+				return;
+			}
+			if (server != nullptr) {
+				// gone or stuck, it and its forks would stay zombies until cake exits
+				kill(-server->pid, SIGKILL);
+				waitpid(server->pid, nullptr, 0);
+				server->dead = true;
+			}
+		}
+
+		ProcessOptions process;
+		process.working_directory = test.working_directory;
+		process.environment = test.environment;
+		process.output_file = results[index].output_file;
+		process.process_group = true;
+		run.pid = SpawnCmd(test.command[0], test.command, process);
+		run.pidfd = syscall(SYS_pidfd_open, run.pid, 0);
+		running.push_back(run);
+		busy += run.processors;
+	};
+	auto finish = [&](const RunningTest &run, int wstatus, bool timed_out, double duration) {
+		const TestCase &test = tests[run.index];
+		TestResult &result = results[run.index];
+		result.duration = duration >= 0 ? duration : std::chrono::duration<double>(Clock::now() - run.start).count();
+		result.exit_code = WIFSIGNALED(wstatus) ? 128 + WTERMSIG(wstatus) : WEXITSTATUS(wstatus);
+		if (timed_out) {
+			result.status = TestStatus::kTimeout;
+		} else {
+			bool passed = WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0;
+			result.status = passed != test.will_fail ? TestStatus::kPassed : TestStatus::kFailed;
+		}
+		durations[test.name] = result.duration;
+		if (run.pidfd >= 0) {
+			close(run.pidfd);
+		}
+		busy -= run.processors;
+		PrintTestResult(result, ++done, tests.size());
+	};
+
+	size_t next_serial = 0;
+	while (!parallel.empty() || next_serial < serial.size() || !running.empty()) {
+		// longest first, smaller tests fill the processors left
+		for (auto it = parallel.begin(); it != parallel.end() && busy < jobs;) {
+			if (busy + std::min(jobs, tests[*it].processors) <= jobs) {
+				start(*it);
+				it = parallel.erase(it);
+			} else {
+				++it;
+			}
+		}
+		if (parallel.empty() && running.empty() && next_serial < serial.size()) {
+			start(serial[next_serial++]);
+		}
+
+		// sleep until a test exits or reaches its deadline
+		std::vector<struct pollfd> fds;
+		Clock::time_point deadline = Clock::time_point::max();
+		bool polling = false;
+		for (const RunningTest &run : running) {
+			if (run.server != nullptr) {
+				fds.push_back({ run.server->channel, POLLIN, 0 });
+			} else if (run.pidfd >= 0) {
+				fds.push_back({ run.pidfd, POLLIN, 0 });
+			} else {
+				polling = true;
+			}
+			if (!run.killed) {
+				deadline = std::min(deadline, run.deadline);
+			}
+		}
+		int timeout_ms = -1;
+		if (deadline != Clock::time_point::max()) {
+			auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+			timeout_ms = std::max<long long>(0, left + 1);
+		}
+		if (polling && (timeout_ms < 0 || timeout_ms > 10)) {
+			timeout_ms = 10;
+		}
+		if (poll(fds.data(), fds.size(), timeout_ms) < 0 && errno != EINTR) {
+			logger->Error("Could not wait for the tests: ", strerror(errno));
+		}
+
+		Clock::time_point now = Clock::now();
+		for (auto it = running.begin(); it != running.end();) {
+			int wstatus = 0;
+			if (it->server != nullptr) {
+				double duration = 0;
+				if (ReadForkReplies(*it, wstatus, duration)) {
+					RunningTest run = *it;
+					it = running.erase(it);
+					finish(run, wstatus, run.killed, duration);
+					continue;
+				}
+				// the child, or the server still starting up
+				if (now >= it->deadline && !it->killed) {
+					kill(-(it->pid > 0 ? it->pid : it->server->pid), SIGKILL);
+					it->killed = true;
+				}
+				++it;
+				continue;
+			}
+			pid_t pid = waitpid(it->pid, &wstatus, WNOHANG);
+			bool timed_out = pid == 0 && now >= it->deadline;
+			if (timed_out) {
+				// the whole process group, tests may start their own children
+				kill(-it->pid, SIGKILL);
+				waitpid(it->pid, &wstatus, 0);
+			} else if (pid == 0) {
+				++it;
+				continue;
+			}
+			RunningTest run = *it;
+			it = running.erase(it);
+			finish(run, wstatus, timed_out, -1);
+		}
+		servers.remove_if([](const ForkServer &server) {
+			if (server.dead) {
+				close(server.channel);
+			}
+			return server.dead;
+		});
+	}
+
+	// closing the socket ends a server
+	for (ForkServer &server : servers) {
+		close(server.channel);
+		waitpid(server.pid, nullptr, 0);
+	}
+
+	WriteTestDurations(options.durations_file, durations);
+
+	return results;
+}
@@ -1,12 +1,18 @@
+#include <fcntl.h>
 #include <unistd.h>
 
 #include "utility/common.h"
 
+#include <algorithm>
 #include <fstream>
+#include <unordered_map>
 #include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 
-auto logger = Logger::Create();
+std::shared_ptr<Logger> logger = Logger::Create();
 
 static
 char **string_vector_to_char_array(const std::vector<std::string> &vec)
@@ -124,6 +130,212 @@ bool RunCmdSync(const std::string &cmd, const std::vector<std::string> &args)
 	return true;
 }
 
+static
+bool run_cmd_capture(const std::string &cmd, const std::vector<std::string> &args, std::string &output, bool echo)
+{
+	logger->Debug("Executing ", '"', args, '"');
+
+	int fds[2];
+	if (pipe(fds) < 0) {
+		logger->Error("Could not create pipe: ", strerror(errno));
+	}
+
+	pid_t c_pid = fork();
+	if (c_pid < 0) {
+		logger->Error(
+			"Could not fork a child process: ",
+			args,
+			" ",
+			" -> ",
+			strerror(errno)
+		);
+	}
+	if (c_pid == 0) { // child process
+		close(fds[0]);
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[1]);
+		if (execvp(cmd.c_str(), string_vector_to_char_array(args)) == -1) {
+			logger->Error(
+				"Could not exec child process: ",
+				args,
+				" ||| ",
+				strerror(errno)
+			);
+		}
+	}
+
+	close(fds[1]);
+	char buffer[4096];
+	ssize_t n;
+	while ((n = read(fds[0], buffer, sizeof(buffer))) != 0) {
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		output.append(buffer, n);
+		if (echo) {
+			fwrite(buffer, 1, n, stdout);
+			fflush(stdout);
+		}
+	}
+	close(fds[0]);
+
+	int wstatus = 0;
+	while (waitpid(c_pid, &wstatus, 0) < 0) {
+		if (errno != EINTR) {
+			return false;
+		}
+	}
+
+	return WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0;
+}
+
+bool RunCmdCapture(const std::string &cmd, const std::vector<std::string> &args, std::string &output)
+{
+	return run_cmd_capture(cmd, args, output, false);
+}
+
+bool RunCmdTee(const std::string &cmd, const std::vector<std::string> &args, std::string &output)
+{
+	return run_cmd_capture(cmd, args, output, true);
+}
+
+pid_t SpawnCmd(const std::string &cmd, const std::vector<std::string> &args)
+{
+	logger->Debug("Executing ", '"', args, '"');
+
+	pid_t c_pid = fork();
+	if (c_pid < 0) {
+		logger->Error(
+			"Could not fork a child process: ",
+			args,
+			" ",
+			" -> ",
+			strerror(errno)
+		);
+	}
+	if (c_pid == 0) { // child process
+		execvp(cmd.c_str(), string_vector_to_char_array(args));
+		fprintf(stderr, "Could not exec child process: %s: %s\n", cmd.c_str(), strerror(errno));
+		_exit(127);
+	}
+
+	return c_pid;
+}
+
+pid_t SpawnCmd(const std::string &cmd, const std::vector<std::string> &args, const ProcessOptions &options)
+{
+	logger->Debug("Executing ", '"', args, '"');
+
+	pid_t c_pid = fork();
+	if (c_pid < 0) {
+		logger->Error(
+			"Could not fork a child process: ",
+			args,
+			" ",
+			" -> ",
+			strerror(errno)
+		);
+	}
+	if (c_pid == 0) { // child process
+		if (options.process_group) {
+			setpgid(0, 0);
+		}
+		for (const std::string &variable : options.environment) {
+			size_t equal = variable.find('=');
+			if (equal != std::string::npos) {
+				setenv(variable.substr(0, equal).c_str(), variable.substr(equal + 1).c_str(), 1);
+			}
+		}
+		if (!options.output_file.empty()) {
+			int in = open("/dev/null", O_RDONLY);
+			int out = open(options.output_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (in < 0 || out < 0) {
+				fprintf(stderr, "Could not open %s: %s\n", options.output_file.c_str(), strerror(errno));
+				_exit(127);
+			}
+			dup2(in, STDIN_FILENO);
+			dup2(out, STDOUT_FILENO);
+			dup2(out, STDERR_FILENO);
+			close(in);
+			close(out);
+		}
+		if (!options.working_directory.empty() && chdir(options.working_directory.c_str()) != 0) {
+			fprintf(stderr, "Could not enter %s: %s\n", options.working_directory.c_str(), strerror(errno));
+			_exit(127);
+		}
+		if (options.before_exec) {
+			options.before_exec();
+		}
+		execvp(cmd.c_str(), string_vector_to_char_array(args));
+		fprintf(stderr, "Could not exec child process: %s: %s\n", cmd.c_str(), strerror(errno));
+		_exit(127);
+	}
+
+	return c_pid;
+}
+
+int WaitCmd(pid_t pid)
+{
+	struct rusage usage;
+	return WaitCmd(pid, usage);
+}
+
+int WaitCmd(pid_t pid, struct rusage &usage)
+{
+	int wstatus = 0;
+	while (wait4(pid, &wstatus, 0, &usage) < 0) {
+		if (errno != EINTR) {
+			logger->Warning("could not wait on command (pid ", pid, "): ", strerror(errno));
+			return -1;
+		}
+	}
+
+	if (WIFSIGNALED(wstatus)) {
+		return 128 + WTERMSIG(wstatus);
+	}
+	return WEXITSTATUS(wstatus);
+}
+
+bool RunCmdsParallel(const std::vector<std::vector<std::string>> &cmds, size_t jobs)
+{
+	if (jobs == 0) {
+		jobs = 1;
+	}
+
+	bool ok = true;
+	size_t next = 0;
+	std::unordered_map<pid_t, size_t> running;
+	while (next < cmds.size() || !running.empty()) {
+		while (next < cmds.size() && running.size() < jobs) {
+			running[SpawnCmd(cmds[next][0], cmds[next])] = next;
+			++next;
+		}
+
+		int wstatus = 0;
+		pid_t pid = wait(&wstatus);
+		if (pid < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		auto it = running.find(pid);
+		if (it == running.end()) {
+			continue;
+		}
+		if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+			logger->Warning("command failed: ", cmds[it->second]);
+			ok = false;
+		}
+		running.erase(it);
+	}
+
+	return ok;
+}
+
 static bool do_mkdir(const std::string& path) {
     struct stat st;
     if (stat(path.c_str(), &st) != 0) {
@@ -171,3 +383,112 @@ bool WriteContentToFile(const std::string &content, const std::string &file) {
 bool FileExists(const std::string& file) {
   return std::ifstream(file).good();
 }
+
+bool ReadFileContent(const std::string &file, std::string &content) {
+	std::ifstream input(file, std::ios::binary);
+	if (!input) {
+		return false;
+	}
+	content.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+	return true;
+}
+
+int FindInFile(const std::string &file, const std::vector<std::string> &needles)
+{
+	std::ifstream input(file, std::ios::binary);
+	size_t overlap = 0;
+	for (const std::string &needle : needles) {
+		overlap = std::max(overlap, needle.size() - 1);
+	}
+	std::string window;
+	std::vector<char> chunk(1 << 20);
+	while (input.read(chunk.data(), chunk.size()) || input.gcount() > 0) {
+		// keep the tail of the last chunk, a needle may straddle the two
+		window.erase(0, window.size() > overlap ? window.size() - overlap : 0);
+		window.append(chunk.data(), input.gcount());
+		for (size_t i = 0; i < needles.size(); i++) {
+			if (window.find(needles[i]) != std::string::npos) {
+				return (int)i;
+			}
+		}
+	}
+	return -1;
+}
+
+uint64_t HashBytes(const std::string &bytes, uint64_t seed) {
+	uint64_t hash = seed;
+	for (unsigned char c : bytes) {
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+std::string HashToHex(uint64_t hash) {
+	char buffer[17];
+	snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)hash);
+	return buffer;
+}
+
+std::string SelfExecutable() {
+	char path[4096];
+	ssize_t n = readlink("/proc/self/exe", path, sizeof(path) - 1);
+	if (n <= 0) {
+		return "cake";
+	}
+	path[n] = '\0';
+	return path;
+}
+
+std::string FormatCount(double count)
+{
+	char buffer[32];
+	if (count >= 1e9) {
+		snprintf(buffer, sizeof(buffer), "%.3g G", count / 1e9);
+	} else if (count >= 1e6) {
+		snprintf(buffer, sizeof(buffer), "%.3g M", count / 1e6);
+	} else if (count >= 1e3) {
+		snprintf(buffer, sizeof(buffer), "%.3g k", count / 1e3);
+	} else {
+		snprintf(buffer, sizeof(buffer), "%.0f", count);
+	}
+	return buffer;
+}
+
+std::string FormatBytes(double bytes)
+{
+	const char *units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+	size_t unit = 0;
+	while (bytes >= 1024 && unit + 1 < sizeof(units) / sizeof(units[0])) {
+		bytes /= 1024;
+		unit++;
+	}
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), unit == 0 ? "%.0f %s" : "%.1f %s", bytes, units[unit]);
+	return buffer;
+}
+
+std::string FindProgram(const std::string &name) {
+	const char *path = getenv("PATH");
+	std::string directories = path ? path : "";
+	size_t begin = 0;
+	while (begin <= directories.size()) {
+		size_t end = std::min(directories.find(':', begin), directories.size());
+		std::string candidate = directories.substr(begin, end - begin) + "/" + name;
+		struct stat status;
+		if (end > begin && stat(candidate.c_str(), &status) == 0 && S_ISREG(status.st_mode) && access(candidate.c_str(), X_OK) == 0) {
+			return candidate;
+		}
+		begin = end + 1;
+	}
+	return "";
+}
+
+std::string UserCacheDirectory() {
+	const char *xdg_cache_home = getenv("XDG_CACHE_HOME");
+	if (xdg_cache_home && *xdg_cache_home) {
+		return std::string(xdg_cache_home) + "/cake";
+	}
+	const char *home = getenv("HOME");
+	return std::string(home ? home : ".") + "/.cache/cake";
+}
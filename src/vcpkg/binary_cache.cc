@@ -0,0 +1,158 @@
+#include "vcpkg/binary_cache.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <regex>
+#include <sstream>
+#include <sys/stat.h>
+#include <vector>
+
+#include "utility/common.h"
+
+namespace fs = std::filesystem;
+
+/// Escape the separators of `VCPKG_BINARY_SOURCES` with backticks.
+static
+std::string EscapeBinarySource(const std::string &value)
+{
+	std::string escaped;
+	for (char c : value) {
+		if (c == ',' || c == ';' || c == '`') {
+			escaped += '`';
+		}
+		escaped += c;
+	}
+	return escaped;
+}
+
+std::string BinaryCacheSources(const std::string &directory)
+{
+	std::string sources = "clear;files," + EscapeBinarySource(directory) + ",readwrite";
+
+	// a `clear` of the inherited sources, common in CI, would drop the cache of cake
+	const char *configured = getenv("VCPKG_BINARY_SOURCES");
+	std::string segment;
+	for (const char *c = configured; c != nullptr; ++c) {
+		if (*c == '`' && c[1] != '\0') {
+			segment += *c++;
+			segment += *c;
+			continue;
+		}
+		if (*c != ';' && *c != '\0') {
+			segment += *c;
+			continue;
+		}
+		size_t begin = segment.find_first_not_of(" \t");
+		size_t end = segment.find_last_not_of(" \t");
+		if (begin != std::string::npos && segment.substr(begin, end - begin + 1) != "clear") {
+			sources += ";" + segment;
+		}
+		segment.clear();
+		if (*c == '\0') {
+			break;
+		}
+	}
+
+	return sources;
+}
+
+void ParseVcpkgInstallOutput(const std::string &output, BinaryCacheStats &stats)
+{
+	// "Restored 12 package(s) from /home/.../vcpkg-archives in 1.2 s."
+	std::regex restored_pattern("^Restored ([0-9]+) package");
+	// "Building zlib:x64-linux..." or "Building zlib:x64-linux@1.3.1..."
+	std::regex building_pattern("^Building [^ ]+:[^ ]+");
+
+	std::stringstream ss(output);
+	std::string line;
+	std::smatch match;
+	while (std::getline(ss, line)) {
+		if (std::regex_search(line, match, restored_pattern)) {
+			stats.restored += std::stoul(match[1].str());
+		} else if (std::regex_search(line, building_pattern)) {
+			stats.built++;
+		}
+	}
+}
+
+void TouchInstalledArchives(const std::string &directory, const std::string &packages_directory)
+{
+	// the status database and its updates not yet folded in
+	std::vector<fs::path> files{ fs::path(packages_directory) / "vcpkg" / "status" };
+	std::error_code ec;
+	for (const auto &entry : fs::directory_iterator(fs::path(packages_directory) / "vcpkg" / "updates", ec)) {
+		files.push_back(entry.path());
+	}
+	for (const fs::path &file : files) {
+		std::string content;
+		if (!ReadFileContent(file.string(), content)) {
+			continue;
+		}
+		// "Abi: 0123abcd...", archived as `<first two>/<abi>.zip`
+		std::stringstream ss(content);
+		std::string line;
+		while (std::getline(ss, line)) {
+			if (line.rfind("Abi: ", 0) != 0 || line.size() < 7) {
+				continue;
+			}
+			std::string abi = line.substr(5);
+			fs::path archive = fs::path(directory) / abi.substr(0, 2) / (abi + ".zip");
+			if (fs::exists(archive, ec)) {
+				fs::last_write_time(archive, fs::file_time_type::clock::now(), ec);
+			}
+		}
+	}
+}
+
+bool EvictBinaryCache(const std::string &directory, uintmax_t max_bytes, BinaryCacheStats &stats)
+{
+	struct Archive {
+		fs::path path;
+		uintmax_t size;
+		time_t used; ///< modification time, touched on each restore
+	};
+
+	std::error_code ec;
+	if (!fs::exists(directory, ec)) {
+		return true;
+	}
+
+	std::vector<Archive> archives;
+	for (fs::recursive_directory_iterator it(directory, ec), end; it != end; it.increment(ec)) {
+		if (ec) {
+			return false;
+		}
+		if (!it->is_regular_file() || it->path().extension() != ".zip") {
+			continue;
+		}
+		struct stat st;
+		if (stat(it->path().c_str(), &st) != 0) {
+			continue;
+		}
+		archives.push_back({ it->path(), (uintmax_t)st.st_size, st.st_mtime });
+		stats.bytes += st.st_size;
+	}
+	stats.archives = archives.size();
+
+	if (max_bytes == 0 || stats.bytes <= max_bytes) {
+		return true;
+	}
+
+	// least recently used first
+	std::sort(archives.begin(), archives.end(), [](const Archive &a, const Archive &b) {
+		return a.used < b.used;
+	});
+	for (const Archive &archive : archives) {
+		if (stats.bytes <= max_bytes) {
+			break;
+		}
+		if (fs::remove(archive.path, ec)) {
+			logger->Debug("Evicted ", archive.path.string(), " from the binary cache");
+			stats.bytes -= archive.size;
+			stats.archives--;
+			stats.evicted++;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,125 @@
+#include "vcpkg/fingerprint.h"
+
+#include "utility/common.h"
+#include "vcs/git.h"
+
+/// `--triplet=<triplet>`, `--triplet <triplet>` or `VCPKG_DEFAULT_TRIPLET`.
+static
+std::string TripletOf(const std::vector<std::string> &options)
+{
+	for (size_t i = 0; i < options.size(); ++i) {
+		if (options[i].rfind("--triplet=", 0) == 0) {
+			return options[i].substr(10);
+		}
+		if (options[i] == "--triplet" && i + 1 < options.size()) {
+			return options[i + 1];
+		}
+	}
+
+	const char *triplet = getenv("VCPKG_DEFAULT_TRIPLET");
+	return triplet ? triplet : "";
+}
+
+static
+uint64_t HashFile(const std::string &file, uint64_t seed)
+{
+	std::string content;
+	ReadFileContent(file, content);
+	// separate files, so that moving bytes between them changes the hash
+	return HashBytes(content + '\0', HashBytes(file + '\0', seed));
+}
+
+/// The directories of `--overlay-triplets=<directory>` or `--overlay-triplets <directory>`.
+static
+std::vector<std::string> OverlayTripletsOf(const std::vector<std::string> &options)
+{
+	std::vector<std::string> directories;
+	for (size_t i = 0; i < options.size(); ++i) {
+		if (options[i].rfind("--overlay-triplets=", 0) == 0) {
+			directories.push_back(options[i].substr(19));
+		} else if (options[i] == "--overlay-triplets" && i + 1 < options.size()) {
+			directories.push_back(options[++i]);
+		}
+	}
+	return directories;
+}
+
+/// Hash the overlay triplet file of `triplet`, and the triplets it includes,
+/// as a generated one keeps its name when the settings of its profile change.
+static
+uint64_t HashOverlayTriplet(const std::string &triplet, const std::vector<std::string> &directories, uint64_t hash)
+{
+	for (const std::string &directory : directories) {
+		std::string file = directory + "/" + triplet + ".cmake";
+		std::string content;
+		if (!ReadFileContent(file, content)) {
+			continue;
+		}
+		hash = HashFile(file, hash);
+
+		// `include("<file>")`, the base triplet of a generated one
+		size_t begin = 0;
+		while ((begin = content.find("include(\"", begin)) != std::string::npos) {
+			begin += 9;
+			size_t end = content.find('"', begin);
+			if (end == std::string::npos) {
+				break;
+			}
+			hash = HashFile(content.substr(begin, end - begin), hash);
+			begin = end;
+		}
+		// the first overlay with the triplet is the one vcpkg uses
+		break;
+	}
+	return hash;
+}
+
+std::string VcpkgManifestFingerprint(const std::string &manifest_directory, const std::string &vcpkg_root, const std::vector<std::string> &options)
+{
+	uint64_t hash = HashBytes("cake-vcpkg-manifest-v1");
+
+	// the manifest carries the builtin-baseline, the configuration the registries' baselines
+	hash = HashFile(manifest_directory + "/vcpkg.json", hash);
+	hash = HashFile(manifest_directory + "/vcpkg-configuration.json", hash);
+
+	// the ports and the tool, without a builtin-baseline the ports of the checkout are installed
+	std::string commit;
+	if (CheckoutCommit(vcpkg_root, commit)) {
+		hash = HashBytes(commit + '\0', hash);
+	} else {
+		hash = HashFile(vcpkg_root + "/versions/baseline.json", hash);
+		hash = HashFile(vcpkg_root + "/scripts/vcpkg-tool-metadata.txt", hash);
+	}
+
+	std::string triplet = TripletOf(options);
+	hash = HashBytes(triplet + '\0', hash);
+	hash = HashOverlayTriplet(triplet, OverlayTripletsOf(options), hash);
+	for (const std::string &option : options) {
+		hash = HashBytes(option + '\0', hash);
+	}
+
+	return HashToHex(hash);
+}
+
+std::string VcpkgInstallFingerprint(const std::string &manifest_directory, const std::string &vcpkg_root, const std::string &packages_directory, const std::vector<std::string> &options)
+{
+	uint64_t hash = HashBytes(VcpkgManifestFingerprint(manifest_directory, vcpkg_root, options));
+
+	// the installed tree, as recorded by vcpkg
+	hash = HashFile(packages_directory + "/vcpkg/status", hash);
+
+	return HashToHex(hash);
+}
+
+std::string ReadVcpkgInstallFingerprint(const std::string &packages_directory)
+{
+	std::string fingerprint;
+	ReadFileContent(packages_directory + "/" + VCPKG_FINGERPRINT_FILE, fingerprint);
+	fingerprint.erase(fingerprint.find_last_not_of("\r\n") + 1);
+	return fingerprint;
+}
+
+bool WriteVcpkgInstallFingerprint(const std::string &packages_directory, const std::string &fingerprint)
+{
+	return WriteContentToFile(fingerprint + "\n", packages_directory + "/" + VCPKG_FINGERPRINT_FILE);
+}
@@ -0,0 +1,274 @@
+#include "vcpkg/package_store.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "package/package.h"
+#include "utility/common.h"
+#include "utility/json.h"
+
+namespace fs = std::filesystem;
+
+#define STORE_LIST_FILE ".list"
+#define STORE_SET_FILE "packages.json"
+
+struct StoredPackage {
+	std::string port;
+	std::string version;
+	std::string triplet;
+	std::string abi;
+	std::vector<std::string> files; ///< relative to the installed tree
+};
+
+/// `<port>_<version>_<triplet>.list`
+static
+bool ParseListFileName(const std::string &filename, StoredPackage &package)
+{
+	std::string stem = filename.substr(0, filename.size() - std::string(".list").size());
+	size_t first = stem.find('_');
+	size_t last = stem.rfind('_');
+	if (first == std::string::npos || first == last) {
+		return false;
+	}
+	package.port = stem.substr(0, first);
+	package.version = stem.substr(first + 1, last - first - 1);
+	package.triplet = stem.substr(last + 1);
+	return true;
+}
+
+static
+std::vector<std::string> ParseListFile(const std::string &content)
+{
+	std::vector<std::string> files;
+	std::stringstream ss(content);
+	std::string line;
+	while (std::getline(ss, line)) {
+		// directories end with a slash
+		if (!line.empty() && line.back() != '/') {
+			files.push_back(line);
+		}
+	}
+	return files;
+}
+
+/// Packages of an installed tree, from the vcpkg database.
+static
+std::vector<StoredPackage> ResolveInstalledPackages(const std::string &packages_directory)
+{
+	std::vector<StoredPackage> packages;
+	std::error_code ec;
+	for (const auto &entry : fs::directory_iterator(packages_directory + "/vcpkg/info", ec)) {
+		StoredPackage package;
+		if (entry.path().extension() != ".list" || !ParseListFileName(entry.path().filename().string(), package)) {
+			continue;
+		}
+
+		std::string list;
+		ReadFileContent(entry.path().string(), list);
+		package.files = ParseListFile(list);
+
+		// vcpkg hashes the abi info into the package abi, so does cake
+		std::string abi_info;
+		if (!ReadFileContent(packages_directory + "/" + package.triplet + "/share/" + package.port + "/vcpkg_abi_info.txt", abi_info)) {
+			abi_info = list;
+		}
+		package.abi = HashToHex(HashBytes(abi_info));
+
+		packages.push_back(package);
+	}
+	return packages;
+}
+
+static
+fs::path EntryOf(const std::string &store_directory, const StoredPackage &package)
+{
+	return fs::path(store_directory) / "packages" / package.port / package.version / package.triplet / package.abi;
+}
+
+/// Link `from` at `to`, with the modification time of `from` so that a
+/// reflink or copy is recognized by `SameFile` later.
+static
+bool LinkFile(const fs::path &from, const fs::path &to)
+{
+	MakeDirectory(to.parent_path().string());
+	StageMethod method;
+	struct stat st;
+	if (!StageFile(from.string(), to.string(), method) || stat(from.c_str(), &st) != 0) {
+		return false;
+	}
+	if (method != StageMethod::kHardlink) {
+		struct timespec times[2] = { st.st_atim, st.st_mtim };
+		utimensat(AT_FDCWD, to.c_str(), times, 0);
+	}
+	return true;
+}
+
+/// The same inode, or a reflink or copy made by `LinkFile`: a reflink is an
+/// inode of its own.
+static
+bool SameFile(const fs::path &a, const fs::path &b)
+{
+	struct stat sa, sb;
+	if (stat(a.c_str(), &sa) != 0 || stat(b.c_str(), &sb) != 0) {
+		return false;
+	}
+	if (sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino) {
+		return true;
+	}
+	return sa.st_size == sb.st_size && sa.st_mtim.tv_sec == sb.st_mtim.tv_sec && sa.st_mtim.tv_nsec == sb.st_mtim.tv_nsec;
+}
+
+bool MaterializeFromPackageStore(const std::string &store_directory, const std::string &key, const std::string &packages_directory, PackageStoreStats &stats)
+{
+	using nlohmann::json;
+
+	fs::path set = fs::path(store_directory) / "sets" / key;
+	std::string content;
+	if (!ReadFileContent((set / STORE_SET_FILE).string(), content)) {
+		return false;
+	}
+
+	// a set cut short by a crash is a miss, not a failure
+	json record = json::parse(content, nullptr, false);
+	if (!record.is_array()) {
+		return false;
+	}
+	std::vector<StoredPackage> packages;
+	for (const auto &item : record) {
+		if (!item.is_object()) {
+			return false;
+		}
+		StoredPackage package;
+		package.port = item.value("port", "");
+		package.version = item.value("version", "");
+		package.triplet = item.value("triplet", "");
+		package.abi = item.value("abi", "");
+		if (package.port.empty() || package.abi.empty()) {
+			return false;
+		}
+
+		std::string list;
+		if (!ReadFileContent((EntryOf(store_directory, package) / STORE_LIST_FILE).string(), list)) {
+			logger->Debug("Package store lacks ", package.port, ":", package.triplet, " ", package.abi);
+			return false;
+		}
+		package.files = ParseListFile(list);
+		packages.push_back(package);
+	}
+
+	// build the installed tree aside, it replaces the one of vcpkg only when complete
+	std::error_code ec;
+	fs::path installed = fs::path(packages_directory).lexically_normal();
+	if (!installed.has_filename()) {
+		installed = installed.parent_path();
+	}
+	fs::path temp = installed.string() + ".tmp-" + std::to_string(getpid());
+	fs::remove_all(temp, ec);
+	MakeDirectory(temp.string());
+
+	for (const StoredPackage &package : packages) {
+		fs::path entry = EntryOf(store_directory, package);
+		for (const std::string &file : package.files) {
+			if (!LinkFile(entry / file, temp / file)) {
+				fs::remove_all(temp, ec);
+				return false;
+			}
+			stats.files++;
+		}
+		stats.packages++;
+	}
+
+	// the vcpkg database is rewritten by vcpkg, copy it
+	fs::copy(set / "vcpkg", temp / "vcpkg", fs::copy_options::recursive, ec);
+	if (ec) {
+		fs::remove_all(temp, ec);
+		return false;
+	}
+
+	// the installed tree is owned by vcpkg, replace it as a whole
+	fs::remove_all(installed, ec);
+	fs::rename(temp, installed, ec);
+	if (ec) {
+		fs::remove_all(temp, ec);
+		return false;
+	}
+	return true;
+}
+
+bool IngestIntoPackageStore(const std::string &store_directory, const std::string &key, const std::string &packages_directory, PackageStoreStats &stats)
+{
+	using nlohmann::json;
+
+	std::error_code ec;
+	std::string suffix = ".tmp-" + std::to_string(getpid());
+
+	json record = json::array();
+	for (const StoredPackage &package : ResolveInstalledPackages(packages_directory)) {
+		fs::path entry = EntryOf(store_directory, package);
+
+		if (!fs::exists(entry)) {
+			// build the entry aside, so concurrent installs never see half of it
+			fs::path temp = entry.string() + suffix;
+			fs::remove_all(temp, ec);
+			for (const std::string &file : package.files) {
+				fs::path stored = temp / file;
+				if (!LinkFile(fs::path(packages_directory) / file, stored)) {
+					fs::remove_all(temp, ec);
+					return false;
+				}
+				// hardlinked into installed trees, guard against in-place edits
+				bool executable = (fs::status(stored).permissions() & fs::perms::owner_exec) != fs::perms::none;
+				chmod(stored.c_str(), executable ? 0555 : 0444);
+			}
+			std::string list;
+			for (const std::string &file : package.files) {
+				list += file + "\n";
+			}
+			WriteContentToFile(list, (temp / STORE_LIST_FILE).string());
+
+			fs::rename(temp, entry, ec);
+			if (ec) { // someone else stored it first
+				fs::remove_all(temp, ec);
+			} else {
+				stats.stored++;
+			}
+		}
+
+		for (const std::string &file : package.files) {
+			fs::path installed = fs::path(packages_directory) / file;
+			if (!SameFile(entry / file, installed)) {
+				LinkFile(entry / file, installed);
+			}
+			stats.files++;
+		}
+		stats.packages++;
+
+		record.push_back({
+			{ "port", package.port },
+			{ "version", package.version },
+			{ "triplet", package.triplet },
+			{ "abi", package.abi },
+		});
+	}
+
+	// record the installed tree for the manifest fingerprint
+	fs::path set = fs::path(store_directory) / "sets" / key;
+	fs::path temp = set.string() + suffix;
+	fs::remove_all(temp, ec);
+	MakeDirectory(temp.string());
+	fs::copy(fs::path(packages_directory) / "vcpkg", temp / "vcpkg", fs::copy_options::recursive, ec);
+	if (ec) {
+		fs::remove_all(temp, ec);
+		return false;
+	}
+	WriteContentToFile(record.dump(4), (temp / STORE_SET_FILE).string());
+	fs::remove_all(set, ec);
+	fs::rename(temp, set, ec);
+
+	return true;
+}
@@ -0,0 +1,103 @@
+#include "vcpkg/triplet.h"
+
+#include <filesystem>
+#include <sys/utsname.h>
+
+#include "utility/common.h"
+
+namespace fs = std::filesystem;
+
+std::string HostTriplet()
+{
+	struct utsname name;
+	if (uname(&name) != 0) {
+		return "x64-linux";
+	}
+
+	std::string machine = name.machine;
+	std::string arch = "x64";
+	if (machine == "aarch64" || machine == "arm64") {
+		arch = "arm64";
+	} else if (machine == "i386" || machine == "i686") {
+		arch = "x86";
+	}
+
+	std::string system = name.sysname;
+	if (system == "Darwin") {
+		return arch + "-osx";
+	}
+	return arch + "-linux";
+}
+
+std::vector<std::string> TripletCompileFlags(const TripletConfig &config)
+{
+	std::vector<std::string> flags;
+	if (!config.march.empty()) {
+		flags.push_back("-march=" + config.march);
+	}
+	if (config.lto) {
+		flags.push_back("-flto");
+	}
+	return flags;
+}
+
+static
+std::string JoinFlags(const std::vector<std::string> &flags)
+{
+	std::string joined;
+	for (const std::string &flag : flags) {
+		joined += " " + flag;
+	}
+	return joined;
+}
+
+std::string WriteOverlayTriplet(const TripletConfig &config)
+{
+	std::string base = config.base.empty() ? HostTriplet() : config.base;
+	if (!config.Custom()) {
+		return base;
+	}
+
+	std::string profile = config.profile.empty() ? "default" : config.profile;
+	std::string name = base + "-cake-" + profile;
+
+	std::string content = "# Generated by cake for profile `" + profile + "`, do not edit.\n";
+
+	// derive from the base triplet shipped with vcpkg
+	fs::path base_file = fs::path(config.vcpkg_root) / "triplets" / (base + ".cmake");
+	if (!fs::exists(base_file)) {
+		base_file = fs::path(config.vcpkg_root) / "triplets" / "community" / (base + ".cmake");
+	}
+	if (fs::exists(base_file)) {
+		content += "include(\"" + fs::absolute(base_file).lexically_normal().string() + "\")\n";
+	} else {
+		logger->Warning("Could not find triplet ", base, " in ", config.vcpkg_root, ", using defaults");
+		std::string arch = base.substr(0, base.find('-'));
+		content += "set(VCPKG_TARGET_ARCHITECTURE " + arch + ")\n";
+		content += "set(VCPKG_CRT_LINKAGE dynamic)\n";
+		content += "set(VCPKG_LIBRARY_LINKAGE static)\n";
+		content += base.find("osx") != std::string::npos ? "set(VCPKG_CMAKE_SYSTEM_NAME Darwin)\n" : "set(VCPKG_CMAKE_SYSTEM_NAME Linux)\n";
+	}
+
+	if (config.release_only) {
+		content += "set(VCPKG_BUILD_TYPE release)\n";
+	}
+	std::string flags = JoinFlags(TripletCompileFlags(config));
+	if (!flags.empty()) {
+		content += "set(VCPKG_C_FLAGS \"${VCPKG_C_FLAGS}" + flags + "\")\n";
+		content += "set(VCPKG_CXX_FLAGS \"${VCPKG_CXX_FLAGS}" + flags + "\")\n";
+	}
+	if (config.lto) {
+		content += "set(VCPKG_LINKER_FLAGS \"${VCPKG_LINKER_FLAGS} -flto\")\n";
+	}
+
+	// the triplet is part of the abi of every port, keep its timestamp and bytes stable
+	std::string file = config.directory + "/" + name + ".cmake";
+	std::string previous;
+	if (!ReadFileContent(file, previous) || previous != content) {
+		MakeDirectory(config.directory);
+		WriteContentToFile(content, file);
+	}
+
+	return name;
+}
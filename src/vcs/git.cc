@@ -0,0 +1,104 @@
+#include "vcs/git.h"
+
+#include <filesystem>
+#include <set>
+#include <sstream>
+
+#include "utility/common.h"
+
+static
+void AppendLines(const std::string &output, std::set<std::string> &lines)
+{
+	std::stringstream ss(output);
+	std::string line;
+	while (std::getline(ss, line)) {
+		if (!line.empty()) {
+			lines.insert(line);
+		}
+	}
+}
+
+bool ChangedFilesSince(const std::string &revision, std::vector<std::string> &files)
+{
+	std::string merge_base;
+	if (!RunCmdCapture(GIT_COMMAND, { GIT_COMMAND, "merge-base", revision, "HEAD" }, merge_base)) {
+		logger->Warning("Could not find merge base of ", revision, " and HEAD");
+		return false;
+	}
+	merge_base.erase(merge_base.find_last_not_of("\r\n") + 1);
+
+	std::set<std::string> changed;
+	std::string output;
+	// committed and uncommitted changes against the merge base
+	if (!RunCmdCapture(GIT_COMMAND, { GIT_COMMAND, "diff", "--name-only", "--relative", merge_base }, output)) {
+		return false;
+	}
+	AppendLines(output, changed);
+
+	output.clear();
+	if (!RunCmdCapture(GIT_COMMAND, { GIT_COMMAND, "ls-files", "--others", "--exclude-standard" }, output)) {
+		return false;
+	}
+	AppendLines(output, changed);
+
+	files.assign(changed.begin(), changed.end());
+	return true;
+}
+
+bool CurrentCommit(std::string &commit, bool &dirty)
+{
+	if (!RunCmdCapture(GIT_COMMAND, { GIT_COMMAND, "rev-parse", "HEAD" }, commit)) {
+		return false;
+	}
+	commit.erase(commit.find_last_not_of("\r\n") + 1);
+
+	std::string status;
+	if (!RunCmdCapture(GIT_COMMAND, { GIT_COMMAND, "status", "--porcelain", "--untracked-files=no" }, status)) {
+		return false;
+	}
+	dirty = !status.empty();
+	return true;
+}
+
+bool ResolveCommit(const std::string &revision, std::string &commit)
+{
+	if (!RunCmdCapture(GIT_COMMAND, { GIT_COMMAND, "rev-parse", "--verify", "--quiet", revision + "^{commit}" }, commit)) {
+		return false;
+	}
+	commit.erase(commit.find_last_not_of("\r\n") + 1);
+	return true;
+}
+
+bool CheckoutCommit(const std::string &directory, std::string &commit)
+{
+	// `.git` is a file in a submodule
+	std::error_code ec;
+	if (!std::filesystem::exists(directory + "/.git", ec)) {
+		return false;
+	}
+	if (!RunCmdCapture(GIT_COMMAND, { GIT_COMMAND, "-C", directory, "rev-parse", "HEAD" }, commit)) {
+		return false;
+	}
+	commit.erase(commit.find_last_not_of("\r\n") + 1);
+	return true;
+}
+
+bool WorkingTreePrefix(std::string &prefix)
+{
+	if (!RunCmdCapture(GIT_COMMAND, { GIT_COMMAND, "rev-parse", "--show-prefix" }, prefix)) {
+		return false;
+	}
+	prefix.erase(prefix.find_last_not_of("\r\n") + 1);
+	return true;
+}
+
+bool CheckoutWorktree(const std::string &directory, const std::string &commit)
+{
+	std::error_code ec;
+	if (std::filesystem::exists(directory + "/.git", ec)) {
+		return RunCmdSync(GIT_COMMAND, { GIT_COMMAND, "-C", directory, "checkout", "--quiet", "--detach", "--force", commit });
+	}
+	// forget worktrees whose directory was removed with the build directory
+	RunCmdSync(GIT_COMMAND, { GIT_COMMAND, "worktree", "prune" });
+	return RunCmdSync(GIT_COMMAND, { GIT_COMMAND, "worktree", "add", "--quiet", "--detach", "--force", directory, commit });
+}